@@ -0,0 +1,613 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host-side tool which converts log files written by writeLog()
+ * into a columnar file and runs aggregation queries over it.
+ *
+ * A log file is an array of 12-byte rows; aggregations over months
+ * of fleet logs typically touch only one or two of the three fields,
+ * so here they are stored as separate columns in chunks of rows:
+ *
+ * - time:      64-bit log time in microseconds; the 32-bit
+ *              timestamps of each log file are unwrapped at each
+ *              EVENT_LOG_TIME_WRAP and carried on from the
+ *              previous maximum at a restart, so that time only
+ *              ever increases within a log file,
+ * - event:     32-bit event,
+ * - parameter: 32-bit parameter,
+ * - source:    32-bit index of the log file the row came from.
+ *
+ * Each chunk carries the minimum and maximum of the time, event
+ * and parameter columns so that a query can skip whole chunks, and
+ * only the columns a query needs are read.  Within a chunk the
+ * filter is evaluated column by column into a selection vector
+ * with branch-free loops that the compiler can vectorise, and the
+ * aggregation then runs over the selected rows.
+ *
+ * Usage:
+ *   log_column convert [-c rows_per_chunk] out_file path...
+ *   log_column query [-e event[,event...]] [-f from] [-u until]
+ *                    [-p min:max] [-b bucket] in_file
+ *
+ * convert: convert the given log files and/or directory trees of
+ *          log files into out_file.
+ * query:   print, for the rows that pass the filter, the count
+ *          and the minimum/maximum/sum/mean of the parameter
+ *          grouped by event or, with -b, the count of rows in
+ *          each time bucket of the given number of microseconds.
+ *          -e keeps only the given events (numbers or names),
+ *          -f/-u keep only times within the given range,
+ *          -p keeps only parameters within the given range.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include "log_host.h"
+#include "../log_enum.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The magic number at the start of a columnar file.
+#define LOG_COLUMN_MAGIC 0x4c4f434c
+
+// The version of the columnar file format.
+#define LOG_COLUMN_VERSION 1
+
+// The default number of rows in a chunk.
+#define LOG_COLUMN_DEFAULT_CHUNK_ROWS 65536
+
+// The number of log entries read from file in one go.
+#define LOG_COLUMN_READ_ENTRIES 4096
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// The header at the start of a columnar file.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t chunkRows;
+    uint32_t reserved;
+} ColumnHeader;
+
+// The header of a chunk, followed by the columns: time
+// (uint64_t), event (int32_t), parameter (int32_t) and
+// source (uint32_t), each numRows long.  A chunk with
+// numRows of zero ends the chunks and is followed by the
+// number of sources (uint32_t) and then, for each source,
+// the length (uint32_t) and characters of its path.
+typedef struct {
+    uint32_t numRows;
+    uint32_t reserved;
+    uint64_t minTime;
+    uint64_t maxTime;
+    int32_t minEvent;
+    int32_t maxEvent;
+    int32_t minParameter;
+    int32_t maxParameter;
+} ColumnChunk;
+
+// A chunk being built or read.
+typedef struct {
+    ColumnChunk header;
+    std::vector<uint64_t> time;
+    std::vector<int32_t> event;
+    std::vector<int32_t> parameter;
+    std::vector<uint32_t> source;
+} Chunk;
+
+// A query.
+typedef struct {
+    std::vector<uint8_t> eventWanted; // 1 for each event wanted, empty for all events
+    int32_t minEventWanted;
+    int32_t maxEventWanted;
+    uint64_t minTime;
+    uint64_t maxTime;
+    int32_t minParameter;
+    int32_t maxParameter;
+    uint64_t bucket; // Zero to group by event
+} Query;
+
+// Aggregate for one group.
+typedef struct {
+    uint64_t count;
+    int64_t sum;
+    int32_t min;
+    int32_t max;
+} Aggregate;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: COMMON
+ * -------------------------------------------------------------- */
+
+// Print the usage.
+static void printUsage(const char *pProgramName)
+{
+    fprintf(stderr, "Usage: %s convert [-c rows_per_chunk] out_file path...\n"
+                    "       %s query [-e event[,event...]] [-f from] [-u until] [-p min:max] [-b bucket] in_file\n",
+            pProgramName, pProgramName);
+}
+
+// Return the name of an event.
+static const char *eventName(int32_t event)
+{
+    const char *pName = "?";
+
+    if ((event >= 0) && (event < gNumLogStrings)) {
+        pName = gLogStrings[event];
+    }
+
+    return pName;
+}
+
+// Work out an event from a number or a name.
+static int32_t parseEvent(const char *pString)
+{
+    const char *pName;
+    char *pEnd;
+    int32_t event;
+
+    event = strtol(pString, &pEnd, 0);
+    if ((pEnd == pString) || (*pEnd != 0)) {
+        event = -1;
+        if (strncmp(pString, "EVENT_", 6) == 0) {
+            pString += 6;
+        }
+        for (int x = 0; (x < gNumLogStrings) && (event < 0); x++) {
+            pName = gLogStrings[x];
+            while ((*pName == ' ') || (*pName == '*')) {
+                pName++;
+            }
+            if (strcmp(pName, pString) == 0) {
+                event = x;
+            }
+        }
+    }
+
+    return event;
+}
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: CONVERSION
+ * -------------------------------------------------------------- */
+
+// Write a chunk, including its statistics.
+static bool writeChunk(FILE *pOut, Chunk *pChunk)
+{
+    ColumnChunk *pHeader = &pChunk->header;
+    uint32_t numRows = pChunk->time.size();
+    bool success = true;
+
+    if (numRows > 0) {
+        memset(pHeader, 0, sizeof(*pHeader));
+        pHeader->numRows = numRows;
+        pHeader->minTime = pChunk->time[0];
+        pHeader->maxTime = pChunk->time[0];
+        pHeader->minEvent = INT32_MAX;
+        pHeader->maxEvent = INT32_MIN;
+        pHeader->minParameter = INT32_MAX;
+        pHeader->maxParameter = INT32_MIN;
+        for (uint32_t x = 0; x < numRows; x++) {
+            pHeader->minTime = std::min(pHeader->minTime, pChunk->time[x]);
+            pHeader->maxTime = std::max(pHeader->maxTime, pChunk->time[x]);
+            pHeader->minEvent = std::min(pHeader->minEvent, pChunk->event[x]);
+            pHeader->maxEvent = std::max(pHeader->maxEvent, pChunk->event[x]);
+            pHeader->minParameter = std::min(pHeader->minParameter, pChunk->parameter[x]);
+            pHeader->maxParameter = std::max(pHeader->maxParameter, pChunk->parameter[x]);
+        }
+        success = (fwrite(pHeader, sizeof(*pHeader), 1, pOut) == 1) &&
+                  (fwrite(pChunk->time.data(), sizeof(uint64_t), numRows, pOut) == numRows) &&
+                  (fwrite(pChunk->event.data(), sizeof(int32_t), numRows, pOut) == numRows) &&
+                  (fwrite(pChunk->parameter.data(), sizeof(int32_t), numRows, pOut) == numRows) &&
+                  (fwrite(pChunk->source.data(), sizeof(uint32_t), numRows, pOut) == numRows);
+        pChunk->time.clear();
+        pChunk->event.clear();
+        pChunk->parameter.clear();
+        pChunk->source.clear();
+    }
+
+    return success;
+}
+
+// Convert log files into a columnar file.
+static int convert(const char *pOutFileName, const std::vector<std::string> &paths,
+                   uint32_t chunkRows)
+{
+    std::vector<std::string> files;
+    LogEntry entries[LOG_COLUMN_READ_ENTRIES];
+    ColumnHeader header = {LOG_COLUMN_MAGIC, LOG_COLUMN_VERSION, chunkRows, 0};
+    ColumnChunk end;
+    Chunk chunk;
+    uint64_t time;
+    uint64_t base;
+    uint64_t maxTime;
+    uint32_t lastTimestamp;
+    uint32_t length;
+    unsigned long long numRows = 0;
+    FILE *pFile;
+    FILE *pOut;
+    size_t got;
+    bool success;
+
+    success = logHostFindFiles(paths, &files);
+
+    pOut = fopen(pOutFileName, "wb");
+    if (pOut == NULL) {
+        perror(pOutFileName);
+        return 1;
+    }
+    success = (fwrite(&header, sizeof(header), 1, pOut) == 1) && success;
+
+    for (size_t x = 0; (x < files.size()) && success; x++) {
+        pFile = fopen(files[x].c_str(), "rb");
+        if (pFile != NULL) {
+            base = 0;
+            maxTime = 0;
+            lastTimestamp = 0;
+            while ((got = fread(entries, sizeof(LogEntry), LOG_COLUMN_READ_ENTRIES, pFile)) > 0) {
+                for (size_t y = 0; y < got; y++) {
+                    if ((entries[y].event == EVENT_LOG_START) ||
+                        (entries[y].event == EVENT_LOG_START_AGAIN)) {
+                        // The timer has restarted, carry on from where we were
+                        base = 0;
+                        if (maxTime > entries[y].timestamp) {
+                            base = maxTime - entries[y].timestamp;
+                        }
+                    } else if ((entries[y].event == EVENT_LOG_TIME_WRAP) ||
+                               (entries[y].timestamp < lastTimestamp)) {
+                        base += 1ULL << 32;
+                    }
+                    lastTimestamp = entries[y].timestamp;
+                    time = base + entries[y].timestamp;
+                    if (time > maxTime) {
+                        maxTime = time;
+                    }
+                    chunk.time.push_back(time);
+                    chunk.event.push_back(entries[y].event);
+                    chunk.parameter.push_back(entries[y].parameter);
+                    chunk.source.push_back(x);
+                    if (chunk.time.size() >= chunkRows) {
+                        success = writeChunk(pOut, &chunk) && success;
+                    }
+                    numRows++;
+                }
+            }
+            fclose(pFile);
+        } else {
+            perror(files[x].c_str());
+            success = false;
+        }
+    }
+
+    // Write the last chunk, the end marker and the sources
+    success = writeChunk(pOut, &chunk) && success;
+    memset(&end, 0, sizeof(end));
+    success = (fwrite(&end, sizeof(end), 1, pOut) == 1) && success;
+    length = files.size();
+    success = (fwrite(&length, sizeof(length), 1, pOut) == 1) && success;
+    for (size_t x = 0; x < files.size(); x++) {
+        length = files[x].size();
+        success = (fwrite(&length, sizeof(length), 1, pOut) == 1) &&
+                  (fwrite(files[x].data(), 1, length, pOut) == length) && success;
+    }
+
+    if (fclose(pOut) != 0) {
+        success = false;
+    }
+
+    fprintf(stderr, "%llu row(s) from %d file(s) written to \"%s\".\n",
+            numRows, (int) files.size(), pOutFileName);
+
+    return success ? 0 : 1;
+}
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: QUERY
+ * -------------------------------------------------------------- */
+
+// Read a column, or skip it if it is not wanted.
+template <typename T>
+static bool readColumn(FILE *pIn, std::vector<T> *pColumn, uint32_t numRows, bool wanted)
+{
+    bool success;
+
+    if (wanted) {
+        pColumn->resize(numRows);
+        success = (fread(pColumn->data(), sizeof(T), numRows, pIn) == numRows);
+    } else {
+        success = (fseek(pIn, (long) sizeof(T) * numRows, SEEK_CUR) == 0);
+    }
+
+    return success;
+}
+
+// Return true if a chunk may contain rows wanted by a query.
+static bool chunkMayMatch(const ColumnChunk *pHeader, const Query *pQuery)
+{
+    return (pHeader->maxTime >= pQuery->minTime) &&
+           (pHeader->minTime <= pQuery->maxTime) &&
+           (pHeader->maxParameter >= pQuery->minParameter) &&
+           (pHeader->minParameter <= pQuery->maxParameter) &&
+           (pHeader->maxEvent >= pQuery->minEventWanted) &&
+           (pHeader->minEvent <= pQuery->maxEventWanted);
+}
+
+// Evaluate the filter of a query over a chunk, column by
+// column, into a selection vector.
+static void filterChunk(const Chunk *pChunk, const Query *pQuery,
+                        bool needTime, bool needParameter, bool needEvent,
+                        std::vector<uint8_t> *pSelected)
+{
+    uint32_t numRows = pChunk->header.numRows;
+    uint8_t *pSelect;
+
+    pSelected->assign(numRows, 1);
+    pSelect = pSelected->data();
+
+    if (needTime) {
+        const uint64_t *pTime = pChunk->time.data();
+        const uint64_t minTime = pQuery->minTime;
+        const uint64_t maxTime = pQuery->maxTime;
+        for (uint32_t x = 0; x < numRows; x++) {
+            pSelect[x] &= (uint8_t) ((pTime[x] >= minTime) & (pTime[x] <= maxTime));
+        }
+    }
+    if (needParameter) {
+        const int32_t *pParameter = pChunk->parameter.data();
+        const int32_t minParameter = pQuery->minParameter;
+        const int32_t maxParameter = pQuery->maxParameter;
+        for (uint32_t x = 0; x < numRows; x++) {
+            pSelect[x] &= (uint8_t) ((pParameter[x] >= minParameter) & (pParameter[x] <= maxParameter));
+        }
+    }
+    if (needEvent && !pQuery->eventWanted.empty()) {
+        const int32_t *pEvent = pChunk->event.data();
+        const uint8_t *pWanted = pQuery->eventWanted.data();
+        const uint32_t numEvents = pQuery->eventWanted.size();
+        uint32_t event;
+        uint32_t inRange;
+        for (uint32_t x = 0; x < numRows; x++) {
+            // An event out of range (negative ones included, as
+            // unsigned) looks up entry 0 and is then masked off
+            event = (uint32_t) pEvent[x];
+            inRange = (uint32_t) (event < numEvents);
+            pSelect[x] &= (uint8_t) (inRange & pWanted[event * inRange]);
+        }
+    }
+}
+
+// Run a query over a columnar file.
+static int runQuery(const char *pInFileName, const Query *pQuery)
+{
+    ColumnHeader header;
+    Chunk chunk;
+    std::vector<uint8_t> selected;
+    std::map<int32_t, Aggregate> byEvent;
+    std::map<uint64_t, uint64_t> byBucket;
+    bool timeFilter = (pQuery->minTime > 0) || (pQuery->maxTime < UINT64_MAX);
+    bool parameterFilter = (pQuery->minParameter > INT32_MIN) || (pQuery->maxParameter < INT32_MAX);
+    bool needTime = timeFilter || (pQuery->bucket > 0);
+    bool needEvent = !pQuery->eventWanted.empty() || (pQuery->bucket == 0);
+    bool needParameter = parameterFilter || (pQuery->bucket == 0);
+    unsigned long long numChunks = 0;
+    unsigned long long numChunksRead = 0;
+    unsigned long long numRows = 0;
+    unsigned long long numSelected = 0;
+    uint32_t rows;
+    FILE *pIn;
+    bool success = true;
+
+    pIn = fopen(pInFileName, "rb");
+    if (pIn == NULL) {
+        perror(pInFileName);
+        return 1;
+    }
+
+    if ((fread(&header, sizeof(header), 1, pIn) != 1) ||
+        (header.magic != LOG_COLUMN_MAGIC) || (header.version != LOG_COLUMN_VERSION)) {
+        fprintf(stderr, "\"%s\" is not a columnar log file.\n", pInFileName);
+        fclose(pIn);
+        return 1;
+    }
+
+    while (success && (fread(&chunk.header, sizeof(chunk.header), 1, pIn) == 1) &&
+           (chunk.header.numRows > 0)) {
+        rows = chunk.header.numRows;
+        numChunks++;
+        numRows += rows;
+        if (chunkMayMatch(&chunk.header, pQuery)) {
+            numChunksRead++;
+            success = readColumn(pIn, &chunk.time, rows, needTime) &&
+                      readColumn(pIn, &chunk.event, rows, needEvent) &&
+                      readColumn(pIn, &chunk.parameter, rows, needParameter) &&
+                      readColumn(pIn, &chunk.source, rows, false);
+            if (success) {
+                // Only filter on a column where the chunk statistics
+                // don't already show that every row passes
+                filterChunk(&chunk, pQuery,
+                            timeFilter && ((chunk.header.minTime < pQuery->minTime) ||
+                                           (chunk.header.maxTime > pQuery->maxTime)),
+                            parameterFilter && ((chunk.header.minParameter < pQuery->minParameter) ||
+                                                (chunk.header.maxParameter > pQuery->maxParameter)),
+                            needEvent, &selected);
+                if (pQuery->bucket > 0) {
+                    for (uint32_t x = 0; x < rows; x++) {
+                        if (selected[x]) {
+                            byBucket[chunk.time[x] / pQuery->bucket]++;
+                            numSelected++;
+                        }
+                    }
+                } else {
+                    for (uint32_t x = 0; x < rows; x++) {
+                        if (selected[x]) {
+                            Aggregate &aggregate = byEvent.emplace(chunk.event[x],
+                                                                   Aggregate {0, 0, INT32_MAX, INT32_MIN}).first->second;
+                            aggregate.count++;
+                            aggregate.sum += chunk.parameter[x];
+                            aggregate.min = std::min(aggregate.min, chunk.parameter[x]);
+                            aggregate.max = std::max(aggregate.max, chunk.parameter[x]);
+                            numSelected++;
+                        }
+                    }
+                }
+            }
+        } else {
+            success = (fseek(pIn, (long) rows * (sizeof(uint64_t) + sizeof(int32_t) * 2 +
+                                                 sizeof(uint32_t)), SEEK_CUR) == 0);
+        }
+    }
+
+    fclose(pIn);
+
+    if (pQuery->bucket > 0) {
+        printf("%20s %12s\n", "bucket_start_us", "count");
+        for (std::map<uint64_t, uint64_t>::const_iterator i = byBucket.begin(); i != byBucket.end(); i++) {
+            printf("%20llu %12llu\n", (unsigned long long) (i->first * pQuery->bucket),
+                   (unsigned long long) i->second);
+        }
+    } else {
+        printf("%12s %12s %12s %20s %14s  %s\n", "count", "min", "max", "sum", "mean", "event");
+        for (std::map<int32_t, Aggregate>::const_iterator i = byEvent.begin(); i != byEvent.end(); i++) {
+            printf("%12llu %12d %12d %20lld %14.1f %s\n", (unsigned long long) i->second.count,
+                   i->second.min, i->second.max, (long long) i->second.sum,
+                   (double) i->second.sum / i->second.count, eventName(i->first));
+        }
+    }
+
+    fprintf(stderr, "%llu of %llu row(s) selected; %llu of %llu chunk(s) read.\n",
+            numSelected, numRows, numChunksRead, numChunks);
+
+    return success ? 0 : 1;
+}
+
+/* ----------------------------------------------------------------
+ * MAIN
+ * -------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+    Query query;
+    std::vector<std::string> paths;
+    uint32_t chunkRows = LOG_COLUMN_DEFAULT_CHUNK_ROWS;
+    char *pEvents;
+    char *pToken;
+    char *pColon;
+    int32_t event;
+    int option;
+
+    if (argc < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // The command comes first, the options follow it
+    optind = 2;
+    if (strcmp(argv[1], "convert") == 0) {
+        while ((option = getopt(argc, argv, "c:")) != -1) {
+            if (option == 'c') {
+                chunkRows = strtoul(optarg, NULL, 0);
+            } else {
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+        if ((argc - optind < 2) || (chunkRows == 0)) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        for (int x = optind + 1; x < argc; x++) {
+            paths.push_back(argv[x]);
+        }
+        return convert(argv[optind], paths, chunkRows);
+    }
+
+    if (strcmp(argv[1], "query") == 0) {
+        query.minEventWanted = INT32_MIN;
+        query.maxEventWanted = INT32_MAX;
+        query.minTime = 0;
+        query.maxTime = UINT64_MAX;
+        query.minParameter = INT32_MIN;
+        query.maxParameter = INT32_MAX;
+        query.bucket = 0;
+        while ((option = getopt(argc, argv, "e:f:u:p:b:")) != -1) {
+            switch (option) {
+                case 'e':
+                    query.eventWanted.assign(gNumLogStrings, 0);
+                    query.minEventWanted = INT32_MAX;
+                    query.maxEventWanted = INT32_MIN;
+                    pEvents = optarg;
+                    while ((pToken = strtok(pEvents, ",")) != NULL) {
+                        pEvents = NULL;
+                        event = parseEvent(pToken);
+                        if ((event < 0) || (event >= gNumLogStrings)) {
+                            fprintf(stderr, "Unknown event \"%s\".\n", pToken);
+                            return 1;
+                        }
+                        query.eventWanted[event] = 1;
+                        query.minEventWanted = std::min(query.minEventWanted, event);
+                        query.maxEventWanted = std::max(query.maxEventWanted, event);
+                    }
+                break;
+                case 'f':
+                    query.minTime = strtoull(optarg, NULL, 0);
+                break;
+                case 'u':
+                    query.maxTime = strtoull(optarg, NULL, 0);
+                break;
+                case 'p':
+                    pColon = strchr(optarg, ':');
+                    if (pColon == NULL) {
+                        printUsage(argv[0]);
+                        return 1;
+                    }
+                    if (pColon > optarg) {
+                        query.minParameter = strtol(optarg, NULL, 0);
+                    }
+                    if (*(pColon + 1) != 0) {
+                        query.maxParameter = strtol(pColon + 1, NULL, 0);
+                    }
+                break;
+                case 'b':
+                    query.bucket = strtoull(optarg, NULL, 0);
+                break;
+                default:
+                    printUsage(argv[0]);
+                    return 1;
+                break;
+            }
+        }
+        if (argc - optind != 1) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return runQuery(argv[optind], &query);
+    }
+
+    printUsage(argv[0]);
+
+    return 1;
+}
+
+// End of file
@@ -0,0 +1,436 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host-side decoder for log files written by writeLog().
+ *
+ * Given any number of log files and/or directory trees of log
+ * files (e.g. the uploads from a fleet of devices) this decodes
+ * them to text, in the same format as printLog(), in parallel.
+ * Large files are split at LogEntry boundaries into chunks so that
+ * all of the workers of a work-stealing pool are kept busy even
+ * when one file dominates; the output of each file is always
+ * written in order.  Aggregate statistics are printed to stderr
+ * at the end.
+ *
+ * Usage: log_decode [-j threads] [-c entries_per_chunk] [-o out_dir] [-q] [-t time] path...
+ *
+ * -j  the number of worker threads (default: number of CPUs).
+ * -c  the number of entries in a chunk (default 65536).
+ * -o  write the decoded form of each file to out_dir, mirroring
+ *     the input path with ".log" replaced by ".txt", rather than
+ *     writing everything to stdout.
+ * -q  don't write any decoded output, just the statistics.
+ * -t  only decode the entries of each file from the given log
+ *     time (in microseconds) onwards, within the last run of
+ *     the file; the starting point is found with a binary search
+ *     (see logFileSeek() in log_reader.h), which is exact if the
+ *     log file has an index file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include "../log_reader.h"
+#include "log_host.h"
+#include "log_pool.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The default number of log entries in a chunk of work.
+#define LOG_DECODE_DEFAULT_CHUNK_ENTRIES 65536
+
+// The number of entries read from file in one go.
+#define LOG_DECODE_READ_ENTRIES 4096
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// Statistics, kept per chunk and then accumulated.
+typedef struct {
+    unsigned long long numEntries;
+    unsigned long long numOutOfRange;
+    std::vector<unsigned long long> eventCount;
+} DecodeStats;
+
+// A file being decoded.
+typedef struct {
+    std::string path;
+    std::string outPath;
+    long long firstEntry;
+    long long numEntries;
+    long long numTrailingBytes;
+    unsigned int numChunks;
+    unsigned int nextChunkToWrite;
+    std::vector<std::string> chunkText;
+    std::vector<bool> chunkReady;
+    FILE *pOut;
+    bool failed;
+} DecodeFile;
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The files being decoded.
+static std::vector<DecodeFile> gFiles;
+
+// Protects all output and the fields of gFiles which
+// are modified after the work has begun.
+static std::mutex gOutputMutex;
+
+// The next file whose output may go to stdout (when
+// not writing to an output directory).
+static size_t gNextFileToWrite = 0;
+
+// The accumulated statistics.
+static DecodeStats gStats;
+
+// Where the output goes.
+static bool gQuiet = false;
+static std::string gOutDir;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Print the usage.
+static void printUsage(const char *pProgramName)
+{
+    fprintf(stderr, "Usage: %s [-j threads] [-c entries_per_chunk] [-o out_dir] [-q] [-t time] path...\n",
+            pProgramName);
+}
+
+// Work out the output path for an input path.
+static std::string outPathFor(const std::string &path)
+{
+    std::filesystem::path relative = std::filesystem::path(path).relative_path();
+
+    relative.replace_extension(".txt");
+
+    return (std::filesystem::path(gOutDir) / relative).string();
+}
+
+// Write the chunks of a file that are ready, in order.
+// gOutputMutex must be locked.
+static void writeReadyChunks(DecodeFile *pFile)
+{
+    std::error_code error;
+
+    while ((pFile->nextChunkToWrite < pFile->numChunks) &&
+           pFile->chunkReady[pFile->nextChunkToWrite]) {
+        std::string &text = pFile->chunkText[pFile->nextChunkToWrite];
+        if (!gOutDir.empty()) {
+            if ((pFile->pOut == NULL) && !pFile->failed) {
+                std::filesystem::create_directories(std::filesystem::path(pFile->outPath).parent_path(), error);
+                pFile->pOut = fopen(pFile->outPath.c_str(), "w");
+                if (pFile->pOut == NULL) {
+                    perror(pFile->outPath.c_str());
+                    pFile->failed = true;
+                }
+            }
+            if (pFile->pOut != NULL) {
+                fwrite(text.data(), 1, text.size(), pFile->pOut);
+            }
+        } else {
+            fwrite(text.data(), 1, text.size(), stdout);
+        }
+        // Free the memory now rather than at the end
+        std::string().swap(text);
+        pFile->nextChunkToWrite++;
+    }
+
+    if ((pFile->nextChunkToWrite >= pFile->numChunks) && (pFile->pOut != NULL)) {
+        fclose(pFile->pOut);
+        pFile->pOut = NULL;
+    }
+}
+
+// Hand a decoded chunk to the output side.
+static void chunkDone(size_t fileIndex, unsigned int chunkIndex,
+                      std::string &text, const DecodeStats &stats)
+{
+    std::lock_guard<std::mutex> lock(gOutputMutex);
+    DecodeFile *pFile = &gFiles[fileIndex];
+
+    gStats.numEntries += stats.numEntries;
+    gStats.numOutOfRange += stats.numOutOfRange;
+    for (size_t x = 0; x < stats.eventCount.size(); x++) {
+        gStats.eventCount[x] += stats.eventCount[x];
+    }
+
+    pFile->chunkText[chunkIndex].swap(text);
+    pFile->chunkReady[chunkIndex] = true;
+
+    if (!gOutDir.empty()) {
+        // Each file has its own output so just keep it in order
+        writeReadyChunks(pFile);
+    } else {
+        // Everything goes to stdout so, in addition, files
+        // have to be written one after the other
+        while (gNextFileToWrite < gFiles.size()) {
+            pFile = &gFiles[gNextFileToWrite];
+            if (pFile->numChunks > 0) {
+                writeReadyChunks(pFile);
+            }
+            if (pFile->nextChunkToWrite < pFile->numChunks) {
+                break;
+            }
+            gNextFileToWrite++;
+        }
+    }
+}
+
+// Decode one chunk of one file.
+static void decodeChunk(size_t fileIndex, unsigned int chunkIndex,
+                        long long firstEntry, long long numEntries)
+{
+    LogEntry entries[LOG_DECODE_READ_ENTRIES];
+    char line[LOG_HOST_MAX_LEN_LINE];
+    std::string text;
+    DecodeStats stats;
+    long long entry = firstEntry;
+    int numRead = 1;
+    int wanted;
+    int fd;
+
+    stats.numEntries = 0;
+    stats.numOutOfRange = 0;
+    stats.eventCount.assign(gNumLogStrings, 0);
+
+    if (!gQuiet) {
+        // A decoded line is typically 40 to 50 characters
+        text.reserve(numEntries * 48);
+    }
+
+    fd = open(gFiles[fileIndex].path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        while ((entry < firstEntry + numEntries) && (numRead > 0)) {
+            wanted = LOG_DECODE_READ_ENTRIES;
+            if (wanted > firstEntry + numEntries - entry) {
+                wanted = firstEntry + numEntries - entry;
+            }
+            numRead = logHostReadEntries(fd, entry, entries, wanted);
+            for (int x = 0; x < numRead; x++) {
+                if ((unsigned int) entries[x].event < (unsigned int) gNumLogStrings) {
+                    stats.eventCount[entries[x].event]++;
+                } else {
+                    stats.numOutOfRange++;
+                }
+                if (!gQuiet) {
+                    text.append(line, logHostFormatEntry(line, sizeof(line), &entries[x], entry + x));
+                }
+            }
+            stats.numEntries += numRead;
+            entry += numRead;
+        }
+        close(fd);
+    }
+
+    if (entry < firstEntry + numEntries) {
+        fprintf(stderr, "Error reading \"%s\" at entry %lld.\n",
+                gFiles[fileIndex].path.c_str(), entry);
+    }
+
+    chunkDone(fileIndex, chunkIndex, text, stats);
+}
+
+// Find the first entry of a file at or after a given time.
+static long long findFirstEntry(const std::string &path, unsigned int timestamp)
+{
+    FILE *pFile = fopen(path.c_str(), "rb");
+    FILE *pIndexFile;
+    long long firstEntry = -1;
+    int runStart = -1;
+
+    if (pFile != NULL) {
+        // With an index the start of the last run is known
+        pIndexFile = fopen(logHostIndexPath(path).c_str(), "rb");
+        if (pIndexFile != NULL) {
+            runStart = logIndexRunStart(pFile, pIndexFile);
+            fclose(pIndexFile);
+        }
+        firstEntry = logFileSeek(pFile, timestamp, runStart);
+        fclose(pFile);
+    }
+
+    return firstEntry;
+}
+
+// Print the accumulated statistics.
+static void printStats(unsigned long long numBytes, unsigned long long numTrailingBytes,
+                       double seconds, const LogWorkPool &pool)
+{
+    fprintf(stderr, "%d file(s), %llu entries, %llu bytes in %.3f s (%.1f Mbytes/s, %u thread(s), %llu steal(s)).\n",
+            (int) gFiles.size(), gStats.numEntries, numBytes, seconds,
+            seconds > 0 ? (double) numBytes / seconds / 1000000 : 0.0,
+            pool.numThreads(), pool.numSteals());
+    if (numTrailingBytes > 0) {
+        fprintf(stderr, "%llu byte(s) at the end of files were not a whole LogEntry.\n",
+                numTrailingBytes);
+    }
+    if (gStats.numOutOfRange > 0) {
+        fprintf(stderr, "%llu entries had an out of range event.\n",
+                gStats.numOutOfRange);
+    }
+    for (size_t x = 0; x < gStats.eventCount.size(); x++) {
+        if (gStats.eventCount[x] > 0) {
+            fprintf(stderr, "%12llu %s\n", gStats.eventCount[x], gLogStrings[x]);
+        }
+    }
+}
+
+/* ----------------------------------------------------------------
+ * MAIN
+ * -------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+    unsigned int numThreads = 0;
+    long long chunkEntries = LOG_DECODE_DEFAULT_CHUNK_ENTRIES;
+    unsigned long long numBytes = 0;
+    unsigned long long numTrailingBytes = 0;
+    std::vector<std::string> paths;
+    std::vector<std::string> files;
+    long long size;
+    long long numEntries;
+    long long firstEntry;
+    bool since = false;
+    unsigned int sinceTimestamp = 0;
+    int option;
+    bool success;
+
+    while ((option = getopt(argc, argv, "j:c:o:qt:")) != -1) {
+        switch (option) {
+            case 'j':
+                numThreads = atoi(optarg);
+            break;
+            case 'c':
+                chunkEntries = atoll(optarg);
+            break;
+            case 'o':
+                gOutDir = optarg;
+            break;
+            case 'q':
+                gQuiet = true;
+            break;
+            case 't':
+                since = true;
+                sinceTimestamp = strtoul(optarg, NULL, 0);
+            break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+            break;
+        }
+    }
+
+    if ((optind >= argc) || (chunkEntries <= 0)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    for (int x = optind; x < argc; x++) {
+        paths.push_back(argv[x]);
+    }
+    success = logHostFindFiles(paths, &files);
+
+    gStats.numEntries = 0;
+    gStats.numOutOfRange = 0;
+    gStats.eventCount.assign(gNumLogStrings, 0);
+
+    // Work out the chunks of every file up front so that
+    // the output side knows what to expect
+    gFiles.resize(files.size());
+    for (size_t x = 0; x < files.size(); x++) {
+        DecodeFile *pFile = &gFiles[x];
+        size = logHostFileSize(files[x]);
+        if (size < 0) {
+            fprintf(stderr, "Unable to read \"%s\".\n", files[x].c_str());
+            size = 0;
+            success = false;
+        }
+        numEntries = size / sizeof(LogEntry);
+        firstEntry = 0;
+        if (since && (numEntries > 0)) {
+            firstEntry = findFirstEntry(files[x], sinceTimestamp);
+            if (firstEntry < 0) {
+                fprintf(stderr, "Unable to search \"%s\".\n", files[x].c_str());
+                firstEntry = 0;
+                success = false;
+            }
+            numEntries -= firstEntry;
+        }
+        pFile->path = files[x];
+        pFile->firstEntry = firstEntry;
+        pFile->numEntries = numEntries;
+        pFile->numTrailingBytes = size % sizeof(LogEntry);
+        pFile->numChunks = (numEntries + chunkEntries - 1) / chunkEntries;
+        pFile->nextChunkToWrite = 0;
+        pFile->chunkText.resize(pFile->numChunks);
+        pFile->chunkReady.assign(pFile->numChunks, false);
+        pFile->pOut = NULL;
+        pFile->failed = false;
+        if (!gOutDir.empty()) {
+            pFile->outPath = outPathFor(files[x]);
+        }
+        numBytes += size;
+        numTrailingBytes += pFile->numTrailingBytes;
+    }
+    if (gQuiet) {
+        gOutDir.clear();
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    {
+        LogWorkPool pool(numThreads);
+
+        for (size_t x = 0; x < gFiles.size(); x++) {
+            for (unsigned int y = 0; y < gFiles[x].numChunks; y++) {
+                long long firstEntry = gFiles[x].firstEntry + y * chunkEntries;
+                long long numChunkEntries = gFiles[x].firstEntry + gFiles[x].numEntries - firstEntry;
+                if (numChunkEntries > chunkEntries) {
+                    numChunkEntries = chunkEntries;
+                }
+                pool.submit([x, y, firstEntry, numChunkEntries] {
+                    decodeChunk(x, y, firstEntry, numChunkEntries);
+                });
+            }
+        }
+        pool.wait();
+        fflush(stdout);
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        printStats(numBytes, numTrailingBytes, elapsed.count(), pool);
+    }
+
+    for (size_t x = 0; x < gFiles.size(); x++) {
+        if (gFiles[x].failed) {
+            success = false;
+        }
+    }
+
+    return success ? 0 : 1;
+}
+
+// End of file
@@ -0,0 +1,146 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <filesystem>
+#include "../log_reader.h"
+#include "log_host.h"
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Return true if the given path ends with the log file extension.
+static bool isLogFile(const std::string &path)
+{
+    size_t lenExtension = strlen(LOG_HOST_FILE_EXTENSION);
+
+    return (path.size() > lenExtension) &&
+           (path.compare(path.size() - lenExtension, lenExtension,
+                         LOG_HOST_FILE_EXTENSION) == 0);
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Format a single log entry as text.
+int logHostFormatEntry(char *pBuf, int lenBuf, const LogEntry *pItem,
+                       unsigned int itemIndex)
+{
+    int x;
+
+    // Note: the comparison is done unsigned so that a
+    // corrupt negative event is also caught
+    if ((unsigned int) pItem->event >= (unsigned int) gNumLogStrings) {
+        x = snprintf(pBuf, lenBuf, "%.3f: out of range event at entry %u (%d when max is %d)\n",
+                     (float) pItem->timestamp / 1000, itemIndex, pItem->event, gNumLogStrings - 1);
+    } else {
+        x = snprintf(pBuf, lenBuf, "%6.3f: %s [%d] %d (%#x)\n", (float) pItem->timestamp / 1000,
+                     gLogStrings[pItem->event], pItem->event, pItem->parameter, pItem->parameter);
+    }
+
+    if (x >= lenBuf) {
+        x = lenBuf - 1;
+    }
+
+    return x;
+}
+
+// Find log files.
+bool logHostFindFiles(const std::vector<std::string> &paths,
+                      std::vector<std::string> *pFiles)
+{
+    bool success = true;
+    std::error_code error;
+
+    for (size_t x = 0; x < paths.size(); x++) {
+        if (std::filesystem::is_directory(paths[x], error)) {
+            std::filesystem::recursive_directory_iterator iterator(paths[x], error);
+            std::filesystem::recursive_directory_iterator end;
+            if (error) {
+                fprintf(stderr, "Unable to read directory \"%s\" (%s).\n",
+                        paths[x].c_str(), error.message().c_str());
+                success = false;
+            }
+            for (; !error && (iterator != end); iterator.increment(error)) {
+                if (iterator->is_regular_file(error) &&
+                    isLogFile(iterator->path().string())) {
+                    pFiles->push_back(iterator->path().string());
+                }
+            }
+        } else if (std::filesystem::is_regular_file(paths[x], error)) {
+            pFiles->push_back(paths[x]);
+        } else {
+            fprintf(stderr, "\"%s\" is not a file or directory.\n", paths[x].c_str());
+            success = false;
+        }
+    }
+
+    std::sort(pFiles->begin(), pFiles->end());
+
+    return success;
+}
+
+// Get the path of the index file of a log file.
+std::string logHostIndexPath(const std::string &path)
+{
+    std::string indexPath = path;
+
+    if (isLogFile(indexPath)) {
+        indexPath.resize(indexPath.size() - strlen(LOG_HOST_FILE_EXTENSION));
+    }
+
+    return indexPath + LOG_INDEX_FILE_EXTENSION;
+}
+
+// Get the size of a file.
+long long logHostFileSize(const std::string &path)
+{
+    struct stat fileStat;
+    long long size = -1;
+
+    if (stat(path.c_str(), &fileStat) == 0) {
+        size = fileStat.st_size;
+    }
+
+    return size;
+}
+
+// Read a range of entries from a log file.
+int logHostReadEntries(int fd, long long firstEntry,
+                       LogEntry *pEntries, int numEntries)
+{
+    char *pBuf = (char *) pEntries;
+    size_t wanted = numEntries * sizeof(LogEntry);
+    size_t got = 0;
+    ssize_t x = 1;
+
+    while ((got < wanted) && (x > 0)) {
+        x = pread(fd, pBuf + got, wanted - got, firstEntry * sizeof(LogEntry) + got);
+        if (x > 0) {
+            got += x;
+        }
+    }
+
+    return got / sizeof(LogEntry);
+}
+
+// End of file
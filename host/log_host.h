@@ -0,0 +1,108 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Helpers shared by the host-side (i.e. PC/server) tools that
+ * process log files written by writeLog().  Log files are simply
+ * arrays of LogEntry structures, written in the byte order of the
+ * target (little-endian for all mbed targets), so these tools
+ * assume a little-endian host.
+ */
+
+#ifndef _LOG_HOST_
+#define _LOG_HOST_
+
+#include <string>
+#include <vector>
+#include "../log_entry.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The extension of log files written by the log client.
+#define LOG_HOST_FILE_EXTENSION ".log"
+
+// Enough room for one decoded log line.
+#define LOG_HOST_MAX_LEN_LINE 128
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The strings associated with the enum values (from log_strings.cpp).
+extern const char *gLogStrings[];
+extern const int gNumLogStrings;
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+/** Format a single log entry as text, in the same format as
+ * printLog() on the target.
+ *
+ * @param pBuf      the buffer to write to.
+ * @param lenBuf    the size of pBuf.
+ * @param pItem     the log entry.
+ * @param itemIndex the index of the entry within its file.
+ * @return          the number of characters written (excluding
+ *                  the terminator).
+ */
+int logHostFormatEntry(char *pBuf, int lenBuf, const LogEntry *pItem,
+                       unsigned int itemIndex);
+
+/** Find log files.  Each path may be a file, which is always
+ * included, or a directory, which is searched recursively for
+ * files ending in LOG_HOST_FILE_EXTENSION.  The result is sorted
+ * so that output is deterministic.
+ *
+ * @param paths   the files/directories to search.
+ * @param pFiles  a place to put the file paths found.
+ * @return        true if all of the paths could be read.
+ */
+bool logHostFindFiles(const std::vector<std::string> &paths,
+                      std::vector<std::string> *pFiles);
+
+/** Get the path of the sidecar index file of a log file
+ * (see log_reader.h).
+ *
+ * @param path  the log file.
+ * @return      the path of its index file.
+ */
+std::string logHostIndexPath(const std::string &path);
+
+/** Get the size of a file in bytes.
+ *
+ * @param path  the file.
+ * @return      the size of the file or negative on error.
+ */
+long long logHostFileSize(const std::string &path);
+
+/** Read a range of entries from a log file without disturbing
+ * any shared file position (so that it may be called from
+ * several threads on the same file).
+ *
+ * @param fd         an open file descriptor.
+ * @param firstEntry the index of the first entry to read.
+ * @param pEntries   a place to put the entries.
+ * @param numEntries the number of entries to read.
+ * @return           the number of entries read.
+ */
+int logHostReadEntries(int fd, long long firstEntry,
+                       LogEntry *pEntries, int numEntries);
+
+#endif
+
+// End of file
@@ -0,0 +1,171 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "log_pool.h"
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The index of the worker that the calling thread is,
+// -1 if it is not a worker.
+static thread_local int gWorkerIndex = -1;
+
+/* ----------------------------------------------------------------
+ * PRIVATE METHODS
+ * -------------------------------------------------------------- */
+
+// Take a task.
+bool LogWorkPool::take(unsigned int index, std::function<void()> *pTask)
+{
+    bool found = false;
+    unsigned int victim;
+
+    // Own queue first, newest task
+    {
+        std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+        if (!_queues[index]->tasks.empty()) {
+            *pTask = std::move(_queues[index]->tasks.back());
+            _queues[index]->tasks.pop_back();
+            _numQueued--;
+            found = true;
+        }
+    }
+
+    // Then steal the oldest task from someone else
+    for (unsigned int x = 1; !found && (x < _queues.size()); x++) {
+        victim = (index + x) % _queues.size();
+        std::lock_guard<std::mutex> lock(_queues[victim]->mutex);
+        if (!_queues[victim]->tasks.empty()) {
+            *pTask = std::move(_queues[victim]->tasks.front());
+            _queues[victim]->tasks.pop_front();
+            _numQueued--;
+            _numSteals++;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+// The body of a worker thread.
+void LogWorkPool::worker(unsigned int index)
+{
+    std::function<void()> task;
+
+    gWorkerIndex = index;
+    for (;;) {
+        if (take(index, &task)) {
+            task();
+            task = nullptr;
+            if (--_numPending == 0) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _allDone.notify_all();
+            }
+        } else {
+            // The queued count is incremented under the lock
+            // after a task is pushed, so checking it here cannot
+            // miss a submission made after take() failed
+            std::unique_lock<std::mutex> lock(_mutex);
+            _workAvailable.wait(lock, [this] { return _stopping || (_numQueued > 0); });
+            if (_stopping && (_numQueued <= 0)) {
+                break;
+            }
+        }
+    }
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC METHODS
+ * -------------------------------------------------------------- */
+
+// Constructor.
+LogWorkPool::LogWorkPool(unsigned int numThreads)
+    : _numPending(0), _numQueued(0), _numSteals(0), _nextQueue(0), _stopping(false)
+{
+    if (numThreads == 0) {
+        numThreads = std::thread::hardware_concurrency();
+        if (numThreads == 0) {
+            numThreads = 1;
+        }
+    }
+
+    for (unsigned int x = 0; x < numThreads; x++) {
+        _queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+    }
+    for (unsigned int x = 0; x < numThreads; x++) {
+        _threads.push_back(std::thread(&LogWorkPool::worker, this, x));
+    }
+}
+
+// Destructor.
+LogWorkPool::~LogWorkPool()
+{
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+        _workAvailable.notify_all();
+    }
+    for (size_t x = 0; x < _threads.size(); x++) {
+        _threads[x].join();
+    }
+}
+
+// Submit a task.
+void LogWorkPool::submit(std::function<void()> task)
+{
+    unsigned int index;
+
+    if (gWorkerIndex >= 0) {
+        index = gWorkerIndex;
+    } else {
+        index = _nextQueue++ % _queues.size();
+    }
+
+    _numPending++;
+    {
+        std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+        _queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _numQueued++;
+        _workAvailable.notify_one();
+    }
+}
+
+// Wait for all tasks to complete.
+void LogWorkPool::wait()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _allDone.wait(lock, [this] { return _numPending == 0; });
+}
+
+// The number of worker threads.
+unsigned int LogWorkPool::numThreads() const
+{
+    return _threads.size();
+}
+
+// The number of stolen tasks.
+unsigned long long LogWorkPool::numSteals() const
+{
+    return _numSteals;
+}
+
+// End of file
@@ -0,0 +1,108 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A small work-stealing thread pool for the host-side tools.
+ *
+ * Each worker owns a double-ended queue of tasks.  A worker takes
+ * tasks from the back of its own queue (so that the most recently
+ * submitted, cache-warm, work is done first) and, when its own queue
+ * is empty, steals from the front of the other workers' queues (so
+ * that the oldest, usually largest, pieces of work migrate).
+ * Tasks submitted from inside a worker go onto that worker's own
+ * queue, tasks submitted from outside are spread round-robin.
+ */
+
+#ifndef _LOG_POOL_
+#define _LOG_POOL_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+class LogWorkPool {
+public:
+
+    /** Constructor: starts the worker threads.
+     *
+     * @param numThreads the number of worker threads; if zero
+     *                   then the number of CPUs is used.
+     */
+    LogWorkPool(unsigned int numThreads = 0);
+
+    /** Destructor: waits for outstanding tasks and stops the
+     * worker threads.
+     */
+    ~LogWorkPool();
+
+    /** Submit a task.
+     *
+     * @param task the task to run.
+     */
+    void submit(std::function<void()> task);
+
+    /** Wait until every task submitted so far, including those
+     * submitted by tasks, has completed.
+     */
+    void wait();
+
+    /** The number of worker threads.
+     */
+    unsigned int numThreads() const;
+
+    /** The number of tasks which were run by a worker other
+     * than the one they were queued on.
+     */
+    unsigned long long numSteals() const;
+
+private:
+
+    // The queue belonging to one worker.
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    // The body of a worker thread.
+    void worker(unsigned int index);
+
+    // Take a task, own queue first then stealing; returns
+    // false if there is nothing to take anywhere.
+    bool take(unsigned int index, std::function<void()> *pTask);
+
+    std::vector<std::unique_ptr<WorkQueue>> _queues;
+    std::vector<std::thread> _threads;
+    std::mutex _mutex;
+    std::condition_variable _workAvailable;
+    std::condition_variable _allDone;
+    std::atomic<unsigned long long> _numPending;
+    std::atomic<long long> _numQueued;
+    std::atomic<unsigned long long> _numSteals;
+    std::atomic<unsigned int> _nextQueue;
+    bool _stopping;
+};
+
+#endif
+
+// End of file
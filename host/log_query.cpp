@@ -0,0 +1,291 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host-side tool to find log entries by event and/or time across
+ * any number of log files, using the sidecar index files (see
+ * log_reader.h) to skip the blocks of each log file which cannot
+ * contain a match.
+ *
+ * Usage: log_query [-b] [-j threads] [-e event] [-f from] [-u until] path...
+ *
+ * -b  first build an index for each log file which has none, or
+ *     whose index is older than the log file (e.g. on an ingestion
+ *     server receiving log files without their index).
+ * -j  the number of worker threads (default: number of CPUs).
+ * -e  the event to find, as a number or as the name printed by
+ *     printLog() (e.g. TCP_CONNECT_FAILURE); default any event.
+ * -f  the earliest log time to find, in microseconds.
+ * -u  the latest log time to find, in microseconds.
+ *
+ * Matching entries are printed, prefixed with the log file name
+ * and entry index, followed by a count of the index blocks that
+ * had to be read.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "../log_reader.h"
+#include "log_host.h"
+#include "log_pool.h"
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// The result of querying one log file.
+typedef struct {
+    std::string path;
+    std::string text;
+    int numFound;
+    int numBlocks;
+    int numBlocksRead;
+    bool indexed;
+} QueryResult;
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// What to look for.
+static int gEvent = -1;
+static unsigned int gMinTimestamp = 0;
+static unsigned int gMaxTimestamp = UINT_MAX;
+
+// Whether to build missing indexes.
+static bool gBuild = false;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Print the usage.
+static void printUsage(const char *pProgramName)
+{
+    fprintf(stderr, "Usage: %s [-b] [-j threads] [-e event] [-f from] [-u until] path...\n",
+            pProgramName);
+}
+
+// Work out an event from a number or a name.
+static int parseEvent(const char *pString)
+{
+    const char *pName;
+    char *pEnd;
+    int event = -1;
+
+    event = strtol(pString, &pEnd, 0);
+    if ((pEnd == pString) || (*pEnd != 0)) {
+        event = -1;
+        for (int x = 0; (x < gNumLogStrings) && (event < 0); x++) {
+            // Skip the "  " or "* " prefix
+            pName = gLogStrings[x];
+            while ((*pName == ' ') || (*pName == '*')) {
+                pName++;
+            }
+            if ((strcmp(pName, pString) == 0) ||
+                ((strncmp(pString, "EVENT_", 6) == 0) && (strcmp(pName, pString + 6) == 0))) {
+                event = x;
+            }
+        }
+    }
+
+    return event;
+}
+
+// Get the modification time of a file, -1 if it doesn't exist.
+static long long modificationTime(const std::string &path)
+{
+    struct stat fileStat;
+    long long modified = -1;
+
+    if (stat(path.c_str(), &fileStat) == 0) {
+        modified = fileStat.st_mtime;
+    }
+
+    return modified;
+}
+
+// Build the index of a log file if it is missing or out of date.
+static void buildIndex(FILE *pFile, const std::string &path, const std::string &indexPath)
+{
+    long long indexModified = modificationTime(indexPath);
+    FILE *pIndexFile;
+
+    if ((indexModified < 0) || (indexModified < modificationTime(path))) {
+        pIndexFile = fopen(indexPath.c_str(), "wb");
+        if (pIndexFile != NULL) {
+            if (logIndexBuild(pFile, pIndexFile) < 0) {
+                fprintf(stderr, "Error building index \"%s\".\n", indexPath.c_str());
+            }
+            fclose(pIndexFile);
+        } else {
+            perror(indexPath.c_str());
+        }
+    }
+}
+
+// Called by logIndexFind() for each entry found.
+static bool entryFound(const LogEntry *pEntry, int index, void *pParam)
+{
+    QueryResult *pResult = (QueryResult *) pParam;
+    char line[LOG_HOST_MAX_LEN_LINE];
+
+    pResult->text += pResult->path + ": " + std::to_string(index) + ": ";
+    pResult->text.append(line, logHostFormatEntry(line, sizeof(line), pEntry, index));
+
+    return true;
+}
+
+// Query one log file.
+static void queryFile(QueryResult *pResult)
+{
+    std::string indexPath = logHostIndexPath(pResult->path);
+    LogIndexBlock block;
+    FILE *pFile;
+    FILE *pIndexFile = NULL;
+
+    pResult->numFound = -1;
+    pResult->numBlocks = 0;
+    pResult->numBlocksRead = 0;
+    pResult->indexed = false;
+
+    pFile = fopen(pResult->path.c_str(), "rb");
+    if (pFile != NULL) {
+        if (gBuild) {
+            buildIndex(pFile, pResult->path, indexPath);
+        }
+        pIndexFile = fopen(indexPath.c_str(), "rb");
+        if (pIndexFile != NULL) {
+            // Count the blocks that will need to be read, for information
+            pResult->numBlocks = logIndexNumBlocks(pIndexFile);
+            pResult->indexed = (pResult->numBlocks >= 0);
+            for (int x = 0; x < pResult->numBlocks; x++) {
+                if (logIndexReadBlock(pIndexFile, x, &block) &&
+                    ((gEvent < 0) || logIndexBlockMayContain(&block, gEvent)) &&
+                    (block.minTimestamp <= gMaxTimestamp) &&
+                    (block.maxTimestamp >= gMinTimestamp)) {
+                    pResult->numBlocksRead++;
+                }
+            }
+        }
+        pResult->numFound = logIndexFind(pFile, pIndexFile, gEvent,
+                                         gMinTimestamp, gMaxTimestamp,
+                                         entryFound, pResult);
+        if (pIndexFile != NULL) {
+            fclose(pIndexFile);
+        }
+        fclose(pFile);
+    }
+}
+
+/* ----------------------------------------------------------------
+ * MAIN
+ * -------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+    unsigned int numThreads = 0;
+    std::vector<std::string> paths;
+    std::vector<std::string> files;
+    std::vector<QueryResult> results;
+    unsigned long long numFound = 0;
+    unsigned long long numBlocks = 0;
+    unsigned long long numBlocksRead = 0;
+    int numUnindexed = 0;
+    int option;
+    int exitCode = 0;
+
+    while ((option = getopt(argc, argv, "bj:e:f:u:")) != -1) {
+        switch (option) {
+            case 'b':
+                gBuild = true;
+            break;
+            case 'j':
+                numThreads = atoi(optarg);
+            break;
+            case 'e':
+                gEvent = parseEvent(optarg);
+                if (gEvent < 0) {
+                    fprintf(stderr, "Unknown event \"%s\".\n", optarg);
+                    return 1;
+                }
+            break;
+            case 'f':
+                gMinTimestamp = strtoul(optarg, NULL, 0);
+            break;
+            case 'u':
+                gMaxTimestamp = strtoul(optarg, NULL, 0);
+            break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+            break;
+        }
+    }
+
+    if (optind >= argc) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    for (int x = optind; x < argc; x++) {
+        paths.push_back(argv[x]);
+    }
+    if (!logHostFindFiles(paths, &files)) {
+        exitCode = 1;
+    }
+
+    results.resize(files.size());
+    {
+        LogWorkPool pool(numThreads);
+        for (size_t x = 0; x < results.size(); x++) {
+            QueryResult *pResult = &results[x];
+            pResult->path = files[x];
+            pool.submit([pResult] { queryFile(pResult); });
+        }
+        pool.wait();
+    }
+
+    for (size_t x = 0; x < results.size(); x++) {
+        fwrite(results[x].text.data(), 1, results[x].text.size(), stdout);
+        if (results[x].numFound >= 0) {
+            numFound += results[x].numFound;
+        } else {
+            fprintf(stderr, "Error reading \"%s\".\n", results[x].path.c_str());
+            exitCode = 1;
+        }
+        if (results[x].indexed) {
+            numBlocks += results[x].numBlocks;
+            numBlocksRead += results[x].numBlocksRead;
+        } else {
+            numUnindexed++;
+        }
+    }
+
+    fprintf(stderr, "%llu entries found in %d file(s); %llu of %llu index block(s) read",
+            numFound, (int) results.size(), numBlocksRead, numBlocks);
+    if (numUnindexed > 0) {
+        fprintf(stderr, ", %d file(s) had no index and were read in full", numUnindexed);
+    }
+    fprintf(stderr, ".\n");
+
+    return exitCode;
+}
+
+// End of file
@@ -0,0 +1,896 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host-side logging server which receives log file uploads from
+ * beginLogFileUpload(), for testing without a real logging server.
+ * Both the legacy protocol (one log file per TCP connection) and
+ * the framed protocol (see log_protocol.h) are understood, the
+ * protocol being detected from the first bytes of each connection.
+ *
+ * Usage: log_receiver [-p port] [-d dir] [-l ms] [-r bytes/s] [-x percent]
+ *
+ * -p  the TCP and UDP port to listen on (default 5060).
+ * -d  the directory to store log files in (default ".").
+ * -l  a latency to add before answering each new connection and
+ *     before each acknowledgement, to stand in for the round trip
+ *     time of e.g. a cellular link.
+ * -r  a limit on the rate at which each connection is received.
+ * -x  a percentage of the datagrams received to lose on purpose.
+ *
+ * A log file received with the framed protocol is stored as
+ * dir/<device ID>/<name>, its size and CRC32 being checked against
+ * the header; while it is being received it is kept in a ".part"
+ * file, which an interrupted upload is resumed from.  A log file
+ * which is already held in full, under its own name or, going by
+ * its size and CRC32, under another, is acknowledged as received
+ * without being sent again.  A log file received with the legacy protocol is
+ * stored as dir/legacy/<address>-<n>.log.  One line is printed
+ * for each log file received.
+ *
+ * Log entries streamed by beginLogStream() are appended to
+ * dir/<device ID>/stream.log as they arrive, which can be decoded
+ * like any other log file.  One line is printed for each batch,
+ * noting any entries lost from the stream and when a device has
+ * begun its stream again.  Over UDP, batches which arrive after
+ * a gap are held back while the missing entries are asked for
+ * again, up to LOG_RECEIVER_MAX_RESEND_REQUESTS times, so that
+ * the stream log file stays in order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include "../log_protocol.h"
+#include "../log_entry.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The default port to listen on.
+#define LOG_RECEIVER_DEFAULT_PORT 5060
+
+// The size of the receive buffer.
+#define LOG_RECEIVER_BUFFER_SIZE 4096
+
+// How long to wait for entries streamed over UDP to be sent
+// again before asking for them again, in milliseconds.
+#define LOG_RECEIVER_RESEND_INTERVAL_MS 500
+
+// The number of times to ask for entries streamed over UDP to
+// be sent again before giving them up as lost.
+#define LOG_RECEIVER_MAX_RESEND_REQUESTS 3
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// A connection from a device, with a receive buffer.
+typedef struct {
+    int sock;
+    std::string address;
+    char buffer[LOG_RECEIVER_BUFFER_SIZE];
+    int start;
+    int end;
+} Connection;
+
+// A device streaming over UDP: batches which arrive beyond a gap
+// are held back, by sequence number, until the gap has been
+// filled or given up on.
+typedef struct {
+    struct sockaddr_in address;
+    unsigned int next;      // The sequence number of the next entry to write
+    std::map<unsigned int, std::vector<LogEntry>> held;
+    std::chrono::steady_clock::time_point requestTime;
+    int numRequests;        // How often the current gap has been asked for
+} DatagramStream;
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// Where to store log files.
+static std::string gDirectory = ".";
+
+// A count of legacy connections, to name their log files.
+static std::atomic<int> gNumLegacyFiles(0);
+
+// The latency to add, in milliseconds.
+static int gLatencyMs = 0;
+
+// The rate limit for each connection, 0 for none.
+static int gBytesPerSecond = 0;
+
+// The percentage of datagrams to lose.
+static int gLossPercent = 0;
+
+// The sequence number of the next streamed log entry expected
+// from each device over TCP, the devices streaming over UDP and
+// a mutex to protect them and the stream log files.
+static std::map<unsigned int, unsigned int> gStreamSequences;
+static std::map<unsigned int, DatagramStream> gDatagramStreams;
+static std::mutex gStreamMutex;
+
+// Mutex so that lines of output don't collide.
+static std::mutex gPrintMutex;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Print the usage.
+static void printUsage(const char *pProgramName)
+{
+    fprintf(stderr, "Usage: %s [-p port] [-d dir] [-l ms] [-r bytes/s] [-x percent]\n",
+            pProgramName);
+}
+
+// Wait for the given latency.
+static void addLatency()
+{
+    if (gLatencyMs > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(gLatencyMs));
+    }
+}
+
+// Make sure that there are at least size bytes (no more than
+// LOG_RECEIVER_BUFFER_SIZE) in the receive buffer of a
+// connection, returning false if it closes first.
+static bool fill(Connection *pConnection, int size)
+{
+    int x;
+
+    if (pConnection->end - pConnection->start < size) {
+        memmove(pConnection->buffer, pConnection->buffer + pConnection->start,
+                pConnection->end - pConnection->start);
+        pConnection->end -= pConnection->start;
+        pConnection->start = 0;
+        while (pConnection->end < size) {
+            x = recv(pConnection->sock, pConnection->buffer + pConnection->end,
+                     sizeof(pConnection->buffer) - pConnection->end, 0);
+            if (x <= 0) {
+                return false;
+            }
+            if (gBytesPerSecond > 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds((long long) x * 1000000 /
+                                                                      gBytesPerSecond));
+            }
+            pConnection->end += x;
+        }
+    }
+
+    return true;
+}
+
+// Receive up to size bytes, returning the number received,
+// 0 if the connection has closed.
+static int receive(Connection *pConnection, char *pBuf, int size)
+{
+    if (!fill(pConnection, 1)) {
+        return 0;
+    }
+    if (size > pConnection->end - pConnection->start) {
+        size = pConnection->end - pConnection->start;
+    }
+    memcpy(pBuf, pConnection->buffer + pConnection->start, size);
+    pConnection->start += size;
+
+    return size;
+}
+
+// Receive exactly size bytes, returning false if the
+// connection closes first.
+static bool receiveAll(Connection *pConnection, char *pBuf, int size)
+{
+    int x;
+
+    while (size > 0) {
+        x = receive(pConnection, pBuf, size);
+        if (x <= 0) {
+            return false;
+        }
+        pBuf += x;
+        size -= x;
+    }
+
+    return true;
+}
+
+// Open a file for writing, creating its directory.
+static FILE *openOutputFile(const std::string &path)
+{
+    std::error_code error;
+
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+    return fopen(path.c_str(), "wb");
+}
+
+// Receive a log file over the legacy protocol, i.e. everything
+// until the connection closes.
+static void receiveLegacy(Connection *pConnection, char *pBuf)
+{
+    std::string path = gDirectory + "/legacy/" + pConnection->address + "-" +
+                       std::to_string(gNumLegacyFiles++) + ".log";
+    FILE *pFile = openOutputFile(path);
+    long long size = 0;
+    int x;
+
+    if (pFile != NULL) {
+        while ((x = receive(pConnection, pBuf, LOG_RECEIVER_BUFFER_SIZE)) > 0) {
+            fwrite(pBuf, 1, x, pFile);
+            size += x;
+        }
+        fclose(pFile);
+        std::lock_guard<std::mutex> lock(gPrintMutex);
+        printf("%s: legacy: %s, %lld byte(s).\n", pConnection->address.c_str(),
+               path.c_str(), size);
+    } else {
+        perror(path.c_str());
+    }
+}
+
+// Send all of a buffer, returning false on failure.
+static bool sendAll(Connection *pConnection, const char *pBuf, int size)
+{
+    int x;
+
+    while (size > 0) {
+        x = send(pConnection->sock, pBuf, size, MSG_NOSIGNAL);
+        if (x <= 0) {
+            return false;
+        }
+        pBuf += x;
+        size -= x;
+    }
+
+    return true;
+}
+
+// Acknowledge a log file up to the given offset.
+static bool sendAck(Connection *pConnection, const LogFrame *pFrame, unsigned int offset)
+{
+    LogFrame ack = *pFrame;
+    char buf[LOG_PROTOCOL_MAX_FRAME_SIZE];
+
+    ack.type = LOG_FRAME_ACK;
+    ack.size = offset;
+    addLatency();
+
+    return sendAll(pConnection, buf, logFrameEncode(&ack, buf));
+}
+
+// Get the size of a file, -1 if it doesn't exist.
+static long long fileSize(const std::string &path)
+{
+    std::error_code error;
+    long long size = std::filesystem::file_size(path, error);
+
+    return error ? -1 : size;
+}
+
+// Work out the CRC32 of a file.
+static unsigned int fileCrc(const std::string &path, char *pBuf)
+{
+    FILE *pFile = fopen(path.c_str(), "rb");
+    unsigned int crc = 0;
+    int x;
+
+    if (pFile != NULL) {
+        while ((x = fread(pBuf, 1, LOG_RECEIVER_BUFFER_SIZE, pFile)) > 0) {
+            crc = logCrc32(crc, pBuf, x);
+        }
+        fclose(pFile);
+    }
+
+    return crc;
+}
+
+// Find a log file from the same device, received in full, with
+// the size and CRC32 given in the header, e.g. one uploaded before
+// under another name, returning its path, or an empty string if
+// there is none.
+static std::string findDuplicate(const LogFrame *pFrame, const std::string &path)
+{
+    std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    std::error_code error;
+    std::string duplicate;
+    std::string logPath;
+    unsigned int size;
+    unsigned int crc;
+    FILE *pFile;
+
+    for (const auto &entry : std::filesystem::directory_iterator(directory, error)) {
+        if (duplicate.empty() && (entry.path().extension() == ".meta")) {
+            logPath = entry.path().string();
+            logPath.resize(logPath.size() - strlen(".meta"));
+            pFile = fopen(entry.path().c_str(), "r");
+            if (pFile != NULL) {
+                if ((fscanf(pFile, "%u %x", &size, &crc) == 2) &&
+                    (size == pFrame->size) && (crc == pFrame->crc) &&
+                    (logPath != path) && (fileSize(logPath) == size)) {
+                    duplicate = logPath;
+                }
+                fclose(pFile);
+            }
+        }
+    }
+
+    return duplicate;
+}
+
+// Work out how much of a log file is held: its identity is
+// kept in a ".meta" file beside it, which is only believed if
+// it matches, and the log file is either complete or in a
+// ".part" file.  If it is held in full under another name (see
+// findDuplicate()) it is linked to that, and *pDuplicate set to
+// its path, so that it needn't be sent again.  If none of it is
+// held, start afresh.
+static unsigned int getOffset(const LogFrame *pFrame, const std::string &path,
+                              bool *pComplete, std::string *pDuplicate)
+{
+    std::string metaPath = path + ".meta";
+    std::error_code error;
+    unsigned int size = 0;
+    unsigned int crc = 0;
+    long long offset = -1;
+    FILE *pFile;
+
+    *pComplete = false;
+    pDuplicate->clear();
+    pFile = fopen(metaPath.c_str(), "r");
+    if (pFile != NULL) {
+        if ((fscanf(pFile, "%u %x", &size, &crc) == 2) &&
+            (size == pFrame->size) && (crc == pFrame->crc)) {
+            if (fileSize(path) == size) {
+                offset = size;
+                *pComplete = true;
+            } else {
+                offset = fileSize(path + ".part");
+                if (offset > size) {
+                    offset = -1;
+                }
+            }
+        }
+        fclose(pFile);
+    }
+
+    if (offset < 0) {
+        offset = 0;
+        if (pFrame->size > 0) {
+            *pDuplicate = findDuplicate(pFrame, path);
+        }
+        if (!pDuplicate->empty()) {
+            std::filesystem::remove(path, error);
+            std::filesystem::create_hard_link(*pDuplicate, path, error);
+            if (error) {
+                std::filesystem::copy_file(*pDuplicate, path, error);
+            }
+            if (!error) {
+                offset = pFrame->size;
+                *pComplete = true;
+            } else {
+                pDuplicate->clear();
+            }
+        }
+        pFile = openOutputFile(metaPath);
+        if (pFile != NULL) {
+            fprintf(pFile, "%u %08x\n", pFrame->size, pFrame->crc);
+            fclose(pFile);
+        }
+    }
+    if (!*pComplete) {
+        if ((offset == 0) && ((pFile = openOutputFile(path + ".part")) != NULL)) {
+            fclose(pFile);
+        }
+        std::filesystem::resize_file(path + ".part", offset, error);
+    }
+
+    return offset;
+}
+
+// Receive a log file over the framed protocol, resuming from
+// however much of it was received before, returning false if
+// the connection closed before the end of it.
+static bool receiveFramedFile(Connection *pConnection, const LogFrame *pFrame, char *pBuf)
+{
+    char deviceId[16];
+    std::string path;
+    std::string duplicate;
+    FILE *pFile = NULL;
+    unsigned int offset;
+    unsigned int remaining;
+    bool complete;
+    bool received;
+    bool ok = false;
+    int size;
+
+    snprintf(deviceId, sizeof(deviceId), "%08x", pFrame->deviceId);
+    // Make sure the name can't go outside the directory
+    path = std::filesystem::path(pFrame->name).filename().string();
+    path = gDirectory + "/" + deviceId + "/" + path;
+    offset = getOffset(pFrame, path, &complete, &duplicate);
+    remaining = pFrame->size - offset;
+    received = sendAck(pConnection, pFrame, offset);
+
+    if (!complete) {
+        pFile = fopen((path + ".part").c_str(), "ab");
+        if (pFile == NULL) {
+            perror(path.c_str());
+        }
+    }
+    while ((remaining > 0) && received) {
+        size = LOG_RECEIVER_BUFFER_SIZE;
+        if ((unsigned int) size > remaining) {
+            size = remaining;
+        }
+        size = receive(pConnection, pBuf, size);
+        received = (size > 0);
+        if (received) {
+            // Flush so that whatever arrives can be resumed from
+            if (pFile != NULL) {
+                fwrite(pBuf, 1, size, pFile);
+                fflush(pFile);
+            }
+            remaining -= size;
+        }
+    }
+    if (pFile != NULL) {
+        fclose(pFile);
+    }
+
+    if (received) {
+        // Check the whole file and tell the device whether it can go
+        ok = complete || (fileCrc(path + ".part", pBuf) == pFrame->crc);
+        if (!complete) {
+            std::error_code error;
+            if (ok) {
+                std::filesystem::rename(path + ".part", path, error);
+                ok = !error;
+            } else {
+                std::filesystem::remove(path + ".part", error);
+                std::filesystem::remove(path + ".meta", error);
+            }
+        }
+        received = sendAck(pConnection, pFrame, ok ? pFrame->size : 0);
+    }
+
+    std::lock_guard<std::mutex> lock(gPrintMutex);
+    printf("%s: device %s: %s, %u byte(s)", pConnection->address.c_str(), deviceId,
+           path.c_str(), pFrame->size - remaining);
+    if (!duplicate.empty()) {
+        printf(" (duplicate of %s)", duplicate.c_str());
+    } else if (offset > 0) {
+        printf(" (from offset %u)", offset);
+    }
+    if (!received) {
+        printf(", INCOMPLETE.\n");
+    } else if (!ok) {
+        printf(", CRC MISMATCH.\n");
+    } else {
+        printf(", OK.\n");
+    }
+
+    return received;
+}
+
+// Check the bytes following a LOG_FRAME_ENTRIES header, returning
+// the number of entries in them, or -1 if they aren't valid.
+static int checkEntries(const LogFrame *pFrame, const char *pBuf)
+{
+    int numEntries = -1;
+
+    if (logCrc32(0, pBuf, pFrame->size) == pFrame->crc) {
+        numEntries = (pFrame->size - LOG_PROTOCOL_SEQUENCE_SIZE) / sizeof(LogEntry);
+    }
+
+    return numEntries;
+}
+
+// Return true if the size of the bytes following a
+// LOG_FRAME_ENTRIES header is possible.
+static bool entriesSizeIsValid(unsigned int size)
+{
+    return (size >= LOG_PROTOCOL_SEQUENCE_SIZE) && (size <= LOG_PROTOCOL_MAX_ENTRIES_SIZE) &&
+           ((size - LOG_PROTOCOL_SEQUENCE_SIZE) % sizeof(LogEntry) == 0);
+}
+
+// Append streamed log entries to the stream log file of a device.
+// Note: gStreamMutex must be locked before calling.
+static void appendStreamEntries(const char *pDeviceId, const void *pEntries, int numEntries)
+{
+    std::string path = gDirectory + "/" + pDeviceId + "/stream.log";
+    std::error_code error;
+    FILE *pFile;
+
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+    pFile = fopen(path.c_str(), "ab");
+    if (pFile != NULL) {
+        fwrite(pEntries, sizeof(LogEntry), numEntries, pFile);
+        fclose(pFile);
+    } else {
+        perror(path.c_str());
+    }
+}
+
+// Receive a batch of streamed log entries, appending them to the
+// stream log file of the device, returning false if the batch
+// isn't valid or the connection closes first.
+static bool receiveFramedEntries(Connection *pConnection, const LogFrame *pFrame, char *pBuf)
+{
+    char deviceId[16];
+    unsigned int sequence;
+    unsigned int expected = 0;
+    bool known = false;
+    int numEntries;
+
+    if (!entriesSizeIsValid(pFrame->size) || !receiveAll(pConnection, pBuf, pFrame->size)) {
+        return false;
+    }
+
+    snprintf(deviceId, sizeof(deviceId), "%08x", pFrame->deviceId);
+    numEntries = checkEntries(pFrame, pBuf);
+    if (numEntries < 0) {
+        std::lock_guard<std::mutex> lock(gPrintMutex);
+        printf("%s: device %s: stream, CRC MISMATCH.\n", pConnection->address.c_str(), deviceId);
+        return false;
+    }
+
+    sequence = logFrameDecodeSequence(pBuf);
+    {
+        std::lock_guard<std::mutex> lock(gStreamMutex);
+        auto iterator = gStreamSequences.find(pFrame->deviceId);
+        if (iterator != gStreamSequences.end()) {
+            expected = iterator->second;
+            known = true;
+        }
+        gStreamSequences[pFrame->deviceId] = sequence + numEntries;
+        appendStreamEntries(deviceId, pBuf + LOG_PROTOCOL_SEQUENCE_SIZE, numEntries);
+    }
+
+    std::lock_guard<std::mutex> lock(gPrintMutex);
+    printf("%s: device %s: stream, %d entries from #%u", pConnection->address.c_str(),
+           deviceId, numEntries, sequence);
+    if (known && (sequence > expected)) {
+        printf(", %u LOST", sequence - expected);
+    } else if (known && (sequence < expected)) {
+        printf(", RESTARTED");
+    }
+    printf(".\n");
+
+    return true;
+}
+
+// Write the entries held back for a device streaming over UDP
+// which now follow on from those written.
+// Note: gStreamMutex must be locked before calling.
+static void writeHeldEntries(const char *pDeviceId, DatagramStream *pStream)
+{
+    unsigned int skip;
+
+    while (!pStream->held.empty() && ((int) (pStream->held.begin()->first - pStream->next) <= 0)) {
+        auto iterator = pStream->held.begin();
+        skip = pStream->next - iterator->first;
+        if (skip < iterator->second.size()) {
+            appendStreamEntries(pDeviceId, iterator->second.data() + skip,
+                                iterator->second.size() - skip);
+            pStream->next = iterator->first + iterator->second.size();
+        }
+        pStream->held.erase(iterator);
+    }
+}
+
+// Ask a device streaming over UDP to send again the entries
+// missing before those held back, if it hasn't been asked
+// recently, giving them up as lost once it has been asked
+// LOG_RECEIVER_MAX_RESEND_REQUESTS times.
+// Note: gStreamMutex must be locked before calling.
+static void requestMissingEntries(int sock, unsigned int deviceIdValue, DatagramStream *pStream)
+{
+    char deviceId[16];
+    char request[LOG_PROTOCOL_HEADER_SIZE + LOG_PROTOCOL_SEQUENCE_SIZE];
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    LogFrame frame;
+    unsigned int missing;
+
+    if (pStream->held.empty() ||
+        ((pStream->numRequests > 0) &&
+         (now - pStream->requestTime < std::chrono::milliseconds(LOG_RECEIVER_RESEND_INTERVAL_MS)))) {
+        return;
+    }
+
+    snprintf(deviceId, sizeof(deviceId), "%08x", deviceIdValue);
+    missing = pStream->held.begin()->first - pStream->next;
+    std::lock_guard<std::mutex> lock(gPrintMutex);
+    if (pStream->numRequests < LOG_RECEIVER_MAX_RESEND_REQUESTS) {
+        memset(&frame, 0, sizeof(frame));
+        frame.type = LOG_FRAME_RESEND;
+        frame.deviceId = deviceIdValue;
+        frame.size = missing;
+        logFrameEncode(&frame, request);
+        logFrameEncodeSequence(pStream->next, request + LOG_PROTOCOL_HEADER_SIZE);
+        sendto(sock, request, sizeof(request), 0, (struct sockaddr *) &(pStream->address),
+               sizeof(pStream->address));
+        pStream->numRequests++;
+        pStream->requestTime = now;
+        printf("%s: device %s: stream (UDP), asking again for %u entries from #%u.\n",
+               inet_ntoa(pStream->address.sin_addr), deviceId, missing, pStream->next);
+    } else {
+        printf("%s: device %s: stream (UDP), %u entries from #%u LOST.\n",
+               inet_ntoa(pStream->address.sin_addr), deviceId, missing, pStream->next);
+        pStream->next = pStream->held.begin()->first;
+        pStream->numRequests = 0;
+        writeHeldEntries(deviceId, pStream);
+    }
+}
+
+// Handle a datagram of streamed log entries.
+static void receiveDatagram(int sock, const char *pBuf, int size, const struct sockaddr_in *pAddress)
+{
+    char deviceId[16];
+    LogFrame frame;
+    DatagramStream *pStream;
+    const LogEntry *pEntries;
+    unsigned int sequence;
+    unsigned int skip;
+    int numEntries;
+    bool restarted = false;
+    bool held = false;
+    bool duplicate = false;
+
+    if ((size < LOG_PROTOCOL_HEADER_SIZE) || (logFrameDecodeHeader(pBuf, &frame) != 0) ||
+        (frame.type != LOG_FRAME_ENTRIES) || !entriesSizeIsValid(frame.size) ||
+        (frame.size != (unsigned int) (size - LOG_PROTOCOL_HEADER_SIZE)) ||
+        ((numEntries = checkEntries(&frame, pBuf + LOG_PROTOCOL_HEADER_SIZE)) < 0)) {
+        std::lock_guard<std::mutex> lock(gPrintMutex);
+        printf("%s: bad datagram.\n", inet_ntoa(pAddress->sin_addr));
+        return;
+    }
+
+    snprintf(deviceId, sizeof(deviceId), "%08x", frame.deviceId);
+    sequence = logFrameDecodeSequence(pBuf + LOG_PROTOCOL_HEADER_SIZE);
+    pEntries = (const LogEntry *) (pBuf + LOG_PROTOCOL_HEADER_SIZE + LOG_PROTOCOL_SEQUENCE_SIZE);
+
+    std::lock_guard<std::mutex> lock(gStreamMutex);
+    auto iterator = gDatagramStreams.find(frame.deviceId);
+    if (iterator == gDatagramStreams.end()) {
+        // Take the stream as starting here
+        pStream = &(gDatagramStreams[frame.deviceId]);
+        pStream->next = sequence;
+        pStream->numRequests = 0;
+    } else {
+        pStream = &(iterator->second);
+        if ((sequence == 0) && (pStream->next != 0)) {
+            // The device has begun its stream again
+            pStream->held.clear();
+            pStream->next = 0;
+            pStream->numRequests = 0;
+            restarted = true;
+        }
+    }
+    pStream->address = *pAddress;
+
+    if ((int) (sequence + numEntries - pStream->next) <= 0) {
+        duplicate = true;
+    } else if ((int) (sequence - pStream->next) > 0) {
+        pStream->held[sequence].assign(pEntries, pEntries + numEntries);
+        held = true;
+    } else {
+        skip = pStream->next - sequence;
+        appendStreamEntries(deviceId, pEntries + skip, numEntries - skip);
+        pStream->next = sequence + numEntries;
+        pStream->numRequests = 0;
+        writeHeldEntries(deviceId, pStream);
+    }
+
+    {
+        std::lock_guard<std::mutex> printLock(gPrintMutex);
+        printf("%s: device %s: stream (UDP), %d entries from #%u", inet_ntoa(pAddress->sin_addr),
+               deviceId, numEntries, sequence);
+        if (restarted) {
+            printf(", RESTARTED");
+        }
+        if (held) {
+            printf(", held back");
+        } else if (duplicate) {
+            printf(", duplicate");
+        }
+        printf(".\n");
+    }
+
+    requestMissingEntries(sock, frame.deviceId, pStream);
+}
+
+// Receive streamed log entries over UDP, asking again for any
+// that are missing while waiting.
+static void receiveDatagrams(int sock)
+{
+    char *pBuf = new char[LOG_PROTOCOL_HEADER_SIZE + LOG_PROTOCOL_MAX_ENTRIES_SIZE];
+    struct sockaddr_in address;
+    socklen_t addressLength;
+    struct timeval timeout;
+    int x;
+
+    timeout.tv_sec = 0;
+    timeout.tv_usec = LOG_RECEIVER_RESEND_INTERVAL_MS * 1000;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    for (;;) {
+        addressLength = sizeof(address);
+        x = recvfrom(sock, pBuf, LOG_PROTOCOL_HEADER_SIZE + LOG_PROTOCOL_MAX_ENTRIES_SIZE, 0,
+                     (struct sockaddr *) &address, &addressLength);
+        if ((x > 0) && ((gLossPercent == 0) || (rand() % 100 >= gLossPercent))) {
+            receiveDatagram(sock, pBuf, x, &address);
+        }
+        std::lock_guard<std::mutex> lock(gStreamMutex);
+        for (auto &stream : gDatagramStreams) {
+            requestMissingEntries(sock, stream.first, &(stream.second));
+        }
+    }
+
+    delete[] pBuf;
+}
+
+// Receive log files over the framed protocol.
+static void receiveFramed(Connection *pConnection, char *pBuf)
+{
+    LogFrame frame;
+    int lenName;
+    int numFiles = 0;
+    bool carryOn = true;
+
+    while (carryOn && receiveAll(pConnection, pBuf, LOG_PROTOCOL_HEADER_SIZE)) {
+        carryOn = false;
+        lenName = logFrameDecodeHeader(pBuf, &frame);
+        if ((lenName >= 0) && receiveAll(pConnection, pBuf, lenName)) {
+            logFrameDecodeName(pBuf, lenName, &frame);
+            switch (frame.type) {
+                case LOG_FRAME_FILE:
+                    numFiles++;
+                    carryOn = receiveFramedFile(pConnection, &frame, pBuf);
+                break;
+                case LOG_FRAME_ENTRIES:
+                    carryOn = receiveFramedEntries(pConnection, &frame, pBuf);
+                break;
+                case LOG_FRAME_END:
+                {
+                    std::lock_guard<std::mutex> lock(gPrintMutex);
+                    printf("%s: end of session, %d file(s).\n",
+                           pConnection->address.c_str(), numFiles);
+                }
+                break;
+                default:
+                break;
+            }
+        } else {
+            std::lock_guard<std::mutex> lock(gPrintMutex);
+            printf("%s: bad frame, closing connection.\n", pConnection->address.c_str());
+        }
+    }
+}
+
+// Handle one connection.
+static void handleConnection(int sock, std::string address)
+{
+    Connection *pConnection = new Connection();
+    char *pBuf = new char[LOG_RECEIVER_BUFFER_SIZE];
+
+    pConnection->sock = sock;
+    pConnection->address = address;
+    pConnection->start = 0;
+    pConnection->end = 0;
+
+    addLatency();
+    // Look at the start to see which protocol this is; a
+    // legacy log file shorter than that is still received
+    if (fill(pConnection, LOG_PROTOCOL_START_SIZE) &&
+        logFrameIsStart(pConnection->buffer + pConnection->start)) {
+        receiveFramed(pConnection, pBuf);
+    } else if (pConnection->end > pConnection->start) {
+        receiveLegacy(pConnection, pBuf);
+    }
+
+    close(sock);
+    delete[] pBuf;
+    delete pConnection;
+}
+
+/* ----------------------------------------------------------------
+ * MAIN
+ * -------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+    int port = LOG_RECEIVER_DEFAULT_PORT;
+    struct sockaddr_in address;
+    socklen_t addressLength;
+    int listenSock;
+    int datagramSock;
+    int sock;
+    int option;
+    int x = 1;
+
+    while ((option = getopt(argc, argv, "p:d:l:r:x:")) != -1) {
+        switch (option) {
+            case 'p':
+                port = atoi(optarg);
+            break;
+            case 'd':
+                gDirectory = optarg;
+            break;
+            case 'l':
+                gLatencyMs = atoi(optarg);
+            break;
+            case 'r':
+                gBytesPerSecond = atoi(optarg);
+            break;
+            case 'x':
+                gLossPercent = atoi(optarg);
+            break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+            break;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    listenSock = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(listenSock, SOL_SOCKET, SO_REUSEADDR, &x, sizeof(x));
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if ((bind(listenSock, (struct sockaddr *) &address, sizeof(address)) != 0) ||
+        (listen(listenSock, 16) != 0)) {
+        perror("Unable to listen");
+        return 1;
+    }
+    datagramSock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (bind(datagramSock, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        perror("Unable to listen for datagrams");
+        return 1;
+    }
+    std::thread(receiveDatagrams, datagramSock).detach();
+
+    printf("Listening on port %d, storing log files in \"%s\".\n", port, gDirectory.c_str());
+    for (;;) {
+        addressLength = sizeof(address);
+        sock = accept(listenSock, (struct sockaddr *) &address, &addressLength);
+        if (sock >= 0) {
+            std::thread(handleConnection, sock, std::string(inet_ntoa(address.sin_addr))).detach();
+        }
+    }
+
+    return 0;
+}
+
+// End of file
@@ -0,0 +1,431 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host-side scanner for triaging log files written by writeLog()
+ * without decoding them to text.
+ *
+ * For each file this validates every LogEntry (the event must be
+ * one that log_strings.cpp knows about), counts the occurrences of
+ * each event, keeps the minimum/maximum/sum of the parameter of
+ * each event, and checks that timestamps only go backwards where
+ * expected: at an EVENT_LOG_TIME_WRAP or at a restart
+ * (EVENT_LOG_START/EVENT_LOG_START_AGAIN).  Any other step backwards
+ * is counted as a violation.
+ *
+ * Files are memory-mapped and scanned four entries at a time with
+ * SSE2 (the baseline for x86-64): the three 16-byte loads that
+ * cover four 12-byte entries are de-interleaved into timestamp,
+ * event and parameter vectors, the event range and timestamp order
+ * of all four are checked with a handful of compares and only when
+ * something is out of the ordinary is an entry examined on its
+ * own.  On other architectures the same logic runs one entry at a
+ * time.
+ *
+ * Usage: log_scan [-j threads] [-e] path...
+ *
+ * -j  the number of worker threads (default: number of CPUs).
+ * -e  print the per-event table for every file, rather than
+ *     just for the total.
+ *
+ * One line is printed per file with a verdict of OK, SUSPICIOUS
+ * (unexplained timestamp steps) or CORRUPT (out of range events
+ * or a length which is not a whole number of entries).  The exit
+ * code is 0 if every file is OK, 2 if any is not, 1 on error.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <mutex>
+#include "log_host.h"
+#include "log_pool.h"
+#include "../log_enum.h"
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// Statistics for one event.
+typedef struct {
+    unsigned long long count;
+    long long sum;
+    int min;
+    int max;
+} ScanEventStats;
+
+// The result of scanning one file (or the total of many).
+typedef struct {
+    std::string path;
+    bool readable;
+    unsigned long long numEntries;
+    unsigned long long numTrailingBytes;
+    unsigned long long numOutOfRange;
+    long long firstOutOfRange;
+    unsigned long long numWraps;
+    unsigned long long numRestarts;
+    unsigned long long numViolations;
+    long long firstViolation;
+    std::vector<ScanEventStats> event;
+} ScanResult;
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// Print the per-event table for every file.
+static bool gPrintEventsPerFile = false;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Print the usage.
+static void printUsage(const char *pProgramName)
+{
+    fprintf(stderr, "Usage: %s [-j threads] [-e] path...\n", pProgramName);
+}
+
+// Initialise a result.
+static void initResult(ScanResult *pResult, const std::string &path)
+{
+    ScanEventStats empty = {0, 0, INT_MAX, INT_MIN};
+
+    pResult->path = path;
+    pResult->readable = true;
+    pResult->numEntries = 0;
+    pResult->numTrailingBytes = 0;
+    pResult->numOutOfRange = 0;
+    pResult->firstOutOfRange = -1;
+    pResult->numWraps = 0;
+    pResult->numRestarts = 0;
+    pResult->numViolations = 0;
+    pResult->firstViolation = -1;
+    pResult->event.assign(gNumLogStrings, empty);
+}
+
+// Add the statistics of an event that is known to be in range.
+static inline void addEvent(ScanResult *pResult, int event, int parameter)
+{
+    ScanEventStats *pStats = &pResult->event[event];
+
+    pStats->count++;
+    pStats->sum += parameter;
+    if (parameter < pStats->min) {
+        pStats->min = parameter;
+    }
+    if (parameter > pStats->max) {
+        pStats->max = parameter;
+    }
+}
+
+// Examine a single entry in full: the slow path.
+static inline void scanEntry(ScanResult *pResult, const LogEntry *pEntry,
+                             unsigned long long index, unsigned int *pLastTimestamp)
+{
+    if ((unsigned int) pEntry->event < (unsigned int) gNumLogStrings) {
+        addEvent(pResult, pEntry->event, pEntry->parameter);
+    } else {
+        if (pResult->numOutOfRange == 0) {
+            pResult->firstOutOfRange = index;
+        }
+        pResult->numOutOfRange++;
+    }
+
+    if (pEntry->event == EVENT_LOG_TIME_WRAP) {
+        pResult->numWraps++;
+    } else if ((pEntry->event == EVENT_LOG_START) ||
+               (pEntry->event == EVENT_LOG_START_AGAIN)) {
+        pResult->numRestarts++;
+    } else if ((index > 0) && (pEntry->timestamp < *pLastTimestamp)) {
+        if (pResult->numViolations == 0) {
+            pResult->firstViolation = index;
+        }
+        pResult->numViolations++;
+    }
+    *pLastTimestamp = pEntry->timestamp;
+}
+
+// Scan an array of entries.
+static void scanEntries(ScanResult *pResult, const LogEntry *pEntries,
+                        unsigned long long numEntries)
+{
+    unsigned long long x = 0;
+    unsigned int lastTimestamp = 0;
+
+#if defined(__SSE2__)
+    // Biasing by the sign bit turns the signed compares
+    // of SSE2 into unsigned compares
+    const __m128i bias = _mm_set1_epi32((int) 0x80000000);
+    const __m128i maxEvent = _mm_set1_epi32((int) (0x80000000 + (unsigned int) gNumLogStrings - 1));
+    // Events that are expected to move time backwards (or
+    // which have to be counted) are taken down the slow path
+    const __m128i wrap = _mm_set1_epi32(EVENT_LOG_TIME_WRAP);
+    const __m128i start = _mm_set1_epi32(EVENT_LOG_START);
+    const __m128i startAgain = _mm_set1_epi32(EVENT_LOG_START_AGAIN);
+    const char *pBytes;
+    __m128 a;
+    __m128 b;
+    __m128 c;
+    __m128i timestamps;
+    __m128i previous;
+    __m128i events;
+    __m128i parameters;
+    __m128i bad;
+    int eventArray[4];
+    int parameterArray[4];
+
+    // Entry zero has no predecessor so do it slowly
+    if (numEntries > 0) {
+        scanEntry(pResult, pEntries, 0, &lastTimestamp);
+        x = 1;
+    }
+
+    for (; x + 4 <= numEntries; x += 4) {
+        // Entries x to x + 3 are three 16-byte vectors:
+        // a: t0 e0 p0 t1, b: e1 p1 t2 e2, c: p2 t3 e3 p3
+        pBytes = (const char *) (pEntries + x);
+        a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *) pBytes));
+        b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *) (pBytes + 16)));
+        c = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *) (pBytes + 32)));
+        // De-interleave into columns
+        timestamps = _mm_castps_si128(_mm_shuffle_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 3, 0)),
+                                                     _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)),
+                                                     _MM_SHUFFLE(2, 0, 1, 0)));
+        events = _mm_castps_si128(_mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),
+                                                 _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)),
+                                                 _MM_SHUFFLE(2, 0, 2, 0)));
+        parameters = _mm_castps_si128(_mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),
+                                                     _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)),
+                                                     _MM_SHUFFLE(2, 0, 2, 0)));
+        // The timestamp before each one: lastTimestamp t0 t1 t2
+        previous = _mm_or_si128(_mm_slli_si128(timestamps, 4),
+                                _mm_cvtsi32_si128((int) lastTimestamp));
+        bad = _mm_or_si128(_mm_cmplt_epi32(_mm_xor_si128(timestamps, bias),
+                                           _mm_xor_si128(previous, bias)),
+                           _mm_cmpgt_epi32(_mm_xor_si128(events, bias), maxEvent));
+        bad = _mm_or_si128(bad, _mm_or_si128(_mm_cmpeq_epi32(events, wrap),
+                                             _mm_or_si128(_mm_cmpeq_epi32(events, start),
+                                                          _mm_cmpeq_epi32(events, startAgain))));
+        if (_mm_movemask_epi8(bad) == 0) {
+            // Fast path: all four are valid and in order
+            _mm_storeu_si128((__m128i *) eventArray, events);
+            _mm_storeu_si128((__m128i *) parameterArray, parameters);
+            addEvent(pResult, eventArray[0], parameterArray[0]);
+            addEvent(pResult, eventArray[1], parameterArray[1]);
+            addEvent(pResult, eventArray[2], parameterArray[2]);
+            addEvent(pResult, eventArray[3], parameterArray[3]);
+            lastTimestamp = pEntries[x + 3].timestamp;
+        } else {
+            for (unsigned long long y = x; y < x + 4; y++) {
+                scanEntry(pResult, pEntries + y, y, &lastTimestamp);
+            }
+        }
+    }
+#endif
+
+    // Whatever is left over (or everything if there is no SIMD)
+    for (; x < numEntries; x++) {
+        scanEntry(pResult, pEntries + x, x, &lastTimestamp);
+    }
+
+    pResult->numEntries += numEntries;
+}
+
+// Scan one file.
+static void scanFile(ScanResult *pResult)
+{
+    long long size = logHostFileSize(pResult->path);
+    void *pMap = NULL;
+    int fd;
+
+    if (size < 0) {
+        pResult->readable = false;
+    } else if (size > 0) {
+        fd = open(pResult->path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            pMap = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (pMap != MAP_FAILED) {
+                madvise(pMap, size, MADV_SEQUENTIAL);
+                scanEntries(pResult, (const LogEntry *) pMap, size / sizeof(LogEntry));
+                pResult->numTrailingBytes = size % sizeof(LogEntry);
+                munmap(pMap, size);
+            } else {
+                pResult->readable = false;
+            }
+            close(fd);
+        } else {
+            pResult->readable = false;
+        }
+    }
+}
+
+// Add one result into a total.
+static void addResult(ScanResult *pTotal, const ScanResult *pResult)
+{
+    pTotal->readable = pTotal->readable && pResult->readable;
+    pTotal->numEntries += pResult->numEntries;
+    pTotal->numTrailingBytes += pResult->numTrailingBytes;
+    pTotal->numOutOfRange += pResult->numOutOfRange;
+    pTotal->numWraps += pResult->numWraps;
+    pTotal->numRestarts += pResult->numRestarts;
+    pTotal->numViolations += pResult->numViolations;
+    for (size_t x = 0; x < pResult->event.size(); x++) {
+        const ScanEventStats *pFrom = &pResult->event[x];
+        ScanEventStats *pTo = &pTotal->event[x];
+        pTo->count += pFrom->count;
+        pTo->sum += pFrom->sum;
+        if (pFrom->min < pTo->min) {
+            pTo->min = pFrom->min;
+        }
+        if (pFrom->max > pTo->max) {
+            pTo->max = pFrom->max;
+        }
+    }
+}
+
+// The verdict on a result.
+static const char *verdict(const ScanResult *pResult)
+{
+    const char *pVerdict = "OK";
+
+    if (!pResult->readable) {
+        pVerdict = "UNREADABLE";
+    } else if ((pResult->numOutOfRange > 0) || (pResult->numTrailingBytes > 0)) {
+        pVerdict = "CORRUPT";
+    } else if (pResult->numViolations > 0) {
+        pVerdict = "SUSPICIOUS";
+    }
+
+    return pVerdict;
+}
+
+// Print the per-event table of a result.
+static void printEvents(const ScanResult *pResult)
+{
+    const ScanEventStats *pStats;
+
+    printf("    %12s %12s %12s %20s  %s\n", "count", "min", "max", "sum", "event");
+    for (size_t x = 0; x < pResult->event.size(); x++) {
+        pStats = &pResult->event[x];
+        if (pStats->count > 0) {
+            printf("    %12llu %12d %12d %20lld %s\n", pStats->count,
+                   pStats->min, pStats->max, pStats->sum, gLogStrings[x]);
+        }
+    }
+}
+
+// Print the summary line of a result.
+static void printResult(const ScanResult *pResult)
+{
+    printf("%-10s %s: %llu entries, %llu out of range", verdict(pResult),
+           pResult->path.c_str(), pResult->numEntries, pResult->numOutOfRange);
+    if (pResult->firstOutOfRange >= 0) {
+        printf(" (first at entry %lld)", pResult->firstOutOfRange);
+    }
+    printf(", %llu wrap(s), %llu restart(s), %llu timestamp violation(s)",
+           pResult->numWraps, pResult->numRestarts, pResult->numViolations);
+    if (pResult->firstViolation >= 0) {
+        printf(" (first at entry %lld)", pResult->firstViolation);
+    }
+    if (pResult->numTrailingBytes > 0) {
+        printf(", %llu trailing byte(s)", pResult->numTrailingBytes);
+    }
+    printf(".\n");
+}
+
+/* ----------------------------------------------------------------
+ * MAIN
+ * -------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+    unsigned int numThreads = 0;
+    std::vector<std::string> paths;
+    std::vector<std::string> files;
+    std::vector<ScanResult> results;
+    ScanResult total;
+    int option;
+    int exitCode = 0;
+
+    while ((option = getopt(argc, argv, "j:e")) != -1) {
+        switch (option) {
+            case 'j':
+                numThreads = atoi(optarg);
+            break;
+            case 'e':
+                gPrintEventsPerFile = true;
+            break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+            break;
+        }
+    }
+
+    if (optind >= argc) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    for (int x = optind; x < argc; x++) {
+        paths.push_back(argv[x]);
+    }
+    if (!logHostFindFiles(paths, &files)) {
+        exitCode = 1;
+    }
+
+    results.resize(files.size());
+    for (size_t x = 0; x < files.size(); x++) {
+        initResult(&results[x], files[x]);
+    }
+
+    {
+        LogWorkPool pool(numThreads);
+        for (size_t x = 0; x < results.size(); x++) {
+            ScanResult *pResult = &results[x];
+            pool.submit([pResult] { scanFile(pResult); });
+        }
+        pool.wait();
+    }
+
+    initResult(&total, "total");
+    for (size_t x = 0; x < results.size(); x++) {
+        printResult(&results[x]);
+        if (gPrintEventsPerFile) {
+            printEvents(&results[x]);
+        }
+        addResult(&total, &results[x]);
+        if ((exitCode == 0) && (strcmp(verdict(&results[x]), "OK") != 0)) {
+            exitCode = 2;
+        }
+    }
+    if (results.size() != 1) {
+        printResult(&total);
+    }
+    printEvents(&total);
+
+    return exitCode;
+}
+
+// End of file
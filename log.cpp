@@ -16,7 +16,10 @@
 
 #include "mbed.h"
 #include "errno.h"
+#include <new>
 #include "log.h"
+#include "log_reader.h"
+#include "log_protocol.h"
 
 /* ----------------------------------------------------------------
  * COMPILE-TIME MACROS
@@ -28,292 +31,3349 @@
 // The maximum length of a file name (including extension).
 #define LOGGING_MAX_LEN_FILE_NAME 8
 
+// The extension of log files.
+#define LOGGING_FILE_EXTENSION ".log"
+
+// The number of log file names ("0000.log" to "9999.log"),
+// after which the names wrap.
+#define LOGGING_NUM_FILE_NAMES 10000
+
 #define LOGGING_MAX_LEN_FILE_PATH (LOGGING_MAX_LEN_PATH + LOGGING_MAX_LEN_FILE_NAME)
 
-// The maximum length of the URL of the logging server (including port).
-#define LOGGING_MAX_LEN_SERVER_URL 128
+// The extension of the file alongside a log file which
+// records how far its upload has progressed.
+#define LOGGING_PROGRESS_FILE_EXTENSION ".upl"
+
+// The name of the upload manifest, which lists the log files
+// to be uploaded, and of the file used while rewriting it.
+#define LOGGING_MANIFEST_FILE_NAME "upload.mft"
+#define LOGGING_MANIFEST_TEMP_FILE_NAME "upload.tmp"
+
+// The magic number ("LOGM") and version of the upload manifest.
+#define LOGGING_MANIFEST_MAGIC 0x4d474f4c
+#define LOGGING_MANIFEST_VERSION 4
+
+// The flags of the header of the upload manifest.
+#define LOGGING_MANIFEST_HEADER_FLAG_PARTIAL 0x01 // Not every log file has a record
+
+// The flags of a record in the upload manifest.
+#define LOGGING_MANIFEST_FLAG_UPLOADED 0x01 // The log file has been uploaded
+#define LOGGING_MANIFEST_FLAG_CLOSED   0x02 // The size, CRC32 and severity are known
+#define LOGGING_MANIFEST_FLAG_SEVERE   0x04 // The log file contains a severe event
+#define LOGGING_MANIFEST_FLAG_DISCARDED 0x08 // The log file was deleted to make room
+
+// The flags of a record in the upload manifest whose log file has gone.
+#define LOGGING_MANIFEST_FLAGS_GONE (LOGGING_MANIFEST_FLAG_UPLOADED | \
+                                     LOGGING_MANIFEST_FLAG_DISCARDED)
+
+// The maximum length of the URL of the logging server (including port).
+#define LOGGING_MAX_LEN_SERVER_URL 128
+
+
+// The number of times in a row that sending log upload
+// data may time out before the connection is given up on.
+#define LOGGING_MAX_SEND_RETRIES 3
+
+// How long log file upload waits for the logging server.
+#define LOGGING_UPLOAD_TIMEOUT_MS 10000
+
+// How often to check whether the application has become
+// idle when log files are only uploaded while it is idle.
+#define LOGGING_UPLOAD_IDLE_POLL_MS 100
+
+// How often a log upload worker which is waiting, and
+// stopLogFileUpload() while it waits for log file upload to
+// stop, check whether it has.
+#define LOGGING_UPLOAD_STOP_POLL_MS 100
+
+// How often the log upload state machine checks for a
+// timeout while waiting for the logging server.
+#define LOGGING_UPLOAD_WATCHDOG_MS 1000
+
+// The number of logging server URLs whose addresses are cached
+// by each log, enough for one to upload log files to and one to
+// stream to.
+#define LOGGING_DNS_CACHE_SIZE 2
+
+// The number of records by which the upload manifest grows
+// when it is rebuilt from the log directory.
+#define LOGGING_MANIFEST_BLOCK_RECORDS 16
+
+// Printf() logging data as well as putting it in the
+// logging system
+#if defined(MBED_CONF_APP_LOG_PRINT) && \
+    MBED_CONF_APP_LOG_PRINT
+#define LOG_PRINT
+#endif
+
+// Only printf() the logging data don't put it in the
+// logging system at all (can sometimes be useful
+// where you want local debug but don't want to
+// load the rest of the system with logging data)
+#if defined (MBED_CONF_APP_LOG_PRINT_ONLY) && \
+    MBED_CONF_APP_LOG_PRINT_ONLY
+#define LOG_PRINT_ONLY
+#endif
+
+// Don't allocate memory after initLog(): everything the
+// library itself needs is put in statically sized storage
+// instead (see LOGGING_STATIC_MAX_LOG_FILES in log.h); the
+// file system and network stack may still use the heap
+#if defined (MBED_CONF_APP_LOG_STATIC_ALLOCATION) && \
+    MBED_CONF_APP_LOG_STATIC_ALLOCATION
+#define LOG_STATIC_ALLOCATION
+#endif
+
+// Create and destroy the objects, and arrays, which the
+// library would otherwise allocate: with LOG_STATIC_ALLOCATION
+// an object is constructed in the static storage given, pStore,
+// and an array simply is that storage.
+#ifdef LOG_STATIC_ALLOCATION
+# define LOGGING_NEW(pStore) new (pStore)
+# define LOGGING_DELETE(type, p) do {if ((p) != NULL) {(p)->~type();}} while (0)
+# define LOGGING_NEW_ARRAY(pStore, type, n) (pStore)
+# define LOGGING_DELETE_ARRAY(p) ((void) (p))
+# define LOGGING_STACK(pStore) ((unsigned char *) (pStore))
+#else
+# define LOGGING_NEW(pStore) new
+# define LOGGING_DELETE(type, p) delete (p)
+# define LOGGING_NEW_ARRAY(pStore, type, n) new type[n]
+# define LOGGING_DELETE_ARRAY(p) delete[] (p)
+# define LOGGING_STACK(pStore) NULL
+#endif
+
+// The number of 64-bit words of static storage needed to hold
+// size bytes, e.g. an object or a thread stack, 64-bit words so
+// that it is suitably aligned.
+#define LOGGING_STORE_WORDS(size) (((size) + sizeof(uint64_t) - 1) / sizeof(uint64_t))
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+class LogInstance;
+
+// The header of the upload manifest.
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    int nextSequence;       // The sequence number of the next log file
+    unsigned int flags;     // LOGGING_MANIFEST_HEADER_FLAG_xxx
+} LogManifestHeader;
+
+// A record in the upload manifest, one per log file, in
+// the order in which the log files were created.
+typedef struct {
+    int sequence;           // The sequence number of the log file
+    unsigned int flags;     // LOGGING_MANIFEST_FLAG_xxx
+    unsigned int size;      // The size of the log file, if closed
+    unsigned int crc;       // The CRC32 of the log file, if closed
+} LogManifestRecord;
+
+// A log file in the upload plan.
+typedef struct {
+    char name[LOGGING_MAX_LEN_FILE_NAME + 1];
+    int sequence;           // The sequence number of the log file, higher is newer
+    int manifestIndex;      // The index of its record in the upload manifest
+    unsigned int flags;     // The flags of its record in the upload manifest
+    unsigned int size;      // Only for LOG_UPLOAD_ORDER_SMALLEST_FIRST or if closed
+    unsigned int crc;       // Only if closed
+    bool severe;            // Only for LOG_UPLOAD_ORDER_SEVERE_FIRST
+} LogUploadPlanFile;
+
+// The upload progress of a log file, stored in a file alongside
+// it so that an interrupted upload can be resumed without
+// having to work out the size and CRC of the log file again.
+typedef struct {
+    unsigned int size;
+    unsigned int crc;
+    unsigned int offset; // The number of bytes acknowledged by the logging server
+} LogUploadProgress;
+
+// A buffer in the ring between the reader and sender stages
+// of log file upload.
+typedef struct {
+    char *pData;
+    int size; // The number of bytes in pData, 0 at the end of the file, negative on a read error
+} LogUploadBuffer;
+
+// The two-stage pipeline through which log files are uploaded:
+// the reader stage, in its own thread, fills a ring of buffers
+// from a log file while the sender stage, in the upload thread,
+// sends them, so that the storage and the network are busy at
+// the same time.
+typedef struct {
+    LogUploadBuffer buffers[LOGGING_UPLOAD_NUM_BUFFERS];
+    FILE *pFile;            // The log file to read, NULL to end the reader stage
+    volatile bool abort;    // Set by the sender stage to stop reading early
+    int readIndex;          // The next buffer to fill, used by the reader stage
+    int sendIndex;          // The next buffer to send, used by the sender stage
+    Semaphore *pStart;      // Released by the sender stage when pFile has been set
+    Semaphore *pFull;       // Counts the buffers which have been filled
+    Semaphore *pEmpty;      // Counts the buffers which are free to be filled
+    Thread *pReaderThread;
+} LogUploadPipeline;
+
+// The states of the log upload state machine, which uploads
+// log files without a thread of its own (see
+// setLogFileUploadEventQueue()).
+typedef enum {
+    LOG_UPLOAD_STATE_NEXT_FILE,
+    LOG_UPLOAD_STATE_CONNECT,
+    LOG_UPLOAD_STATE_CRC,
+    LOG_UPLOAD_STATE_SEND_HEADER,
+    LOG_UPLOAD_STATE_RECEIVE_ACK,
+    LOG_UPLOAD_STATE_SEND_DATA,
+    LOG_UPLOAD_STATE_RECEIVE_FINAL_ACK,
+    LOG_UPLOAD_STATE_RETRY,
+    LOG_UPLOAD_STATE_SEND_END
+} LogUploadState;
+
+// What the log upload state machine should do after a state.
+typedef enum {
+    LOG_UPLOAD_STEP_CONTINUE, // Carry on to the next state
+    LOG_UPLOAD_STEP_YIELD,    // Let other events run, then carry on
+    LOG_UPLOAD_STEP_WAIT,     // Wait for the socket
+    LOG_UPLOAD_STEP_DELAY,    // Wait for the rate limit
+    LOG_UPLOAD_STEP_FAIL      // Give up on the connection
+} LogUploadStep;
+
+// The log upload state machine.
+typedef struct {
+    LogUploadState state;
+    EventQueue *pEventQueue;
+    TCPSocket *pTcpSock;
+    FILE *pFile;
+    bool connected;
+    bool connecting;
+    int fileNumber;
+    LogUploadPlanFile *pPlanFile;
+    char name[LOG_PROTOCOL_MAX_LEN_NAME + 1];
+    char path[LOGGING_MAX_LEN_FILE_PATH + 1];
+    LogUploadProgress progress;
+    unsigned int offset;      // The number of bytes of the log file sent
+    unsigned int ackOffset;   // The offset in the last acknowledgement received
+    char frame[LOG_PROTOCOL_MAX_FRAME_SIZE];
+    int frameLength;          // The length of the frame being sent or received, 0 if none
+    int frameCount;           // How much of it has been sent or received
+    char *pBuffer;
+    int bufferLength;         // The number of bytes read into pBuffer
+    int bufferCount;          // How many of them have been sent
+    int watchdogId;           // The event which times out waits and delays
+    int delayMs;              // How long to delay for the rate limit
+    Timer timer;              // Time since the state machine last made progress
+    Timer fileTimer;          // Time since the sending of the current log file began
+    unsigned int startOffset; // The offset in the current log file at which sending began
+    int attempts;             // The number of failed attempts at the current log file
+    int retryDelayMs;         // How long to back off before trying it again
+    Timer retryTimer;         // Time since the last attempt at it failed
+} LogUploadMachine;
+
+// A log upload worker, which uploads log files over a
+// connection of its own.
+typedef struct {
+    TCPSocket *pTcpSock;
+    bool warm;              // True if pTcpSock is a connection kept from the last upload
+    LogUploadPipeline *pPipeline;
+    Thread *pThread;        // NULL if run by the log file upload thread itself
+    LogInstance *pInstance; // The log whose files are being uploaded
+} LogUploadWorker;
+
+// Type used to pass parameters to the log file upload callback.
+typedef struct {
+    FATFileSystem *pFileSystem;
+    NetworkInterface *pNetworkInterface;
+    LogUploadPlanFile *pPlan; // The log files to upload, in order
+    int numPlanFiles;       // The number of log files in pPlan
+    int numFiles;           // The number of log files taken from pPlan so far
+    int numUploaded;        // The number of log files uploaded so far
+    int numWorkers;
+    LogUploadWorker workers[LOGGING_UPLOAD_MAX_CONNECTIONS];
+    LogUploadMachine *pMachine;
+} LogFileUploadData;
+
+// The address of a logging server, cached so that it need not
+// be looked up every time.
+typedef struct {
+    char url[LOGGING_MAX_LEN_SERVER_URL]; // Empty if the entry is unused
+    SocketAddress address;
+    bool found;             // False if the lookup failed
+    Timer timer;            // The time since the lookup
+} LogServerCacheEntry;
+
+// The live log stream: the entries taken from the log by
+// writeLog() wait in a ring here, each with a sequence number,
+// until the stream thread has sent them and, over UDP, after
+// that in case they are lost.
+typedef struct {
+    NetworkInterface *pNetworkInterface;
+    SocketAddress server;
+    unsigned int deviceId;
+    LogStreamTransport transport;
+    LogInstance *pInstance; // The log being streamed
+    TCPSocket *pTcpSock;    // NULL unless the transport is TCP
+    UDPSocket *pUdpSock;    // NULL unless the transport is UDP
+    Thread *pThread;
+    Semaphore *pStop;       // Released to wake the stream thread when it is to stop
+    volatile bool stop;
+    LogEntry entries[LOGGING_STREAM_BUFFER_ENTRIES];
+    unsigned int nextIn;    // The sequence number of the next entry to be put in the ring
+    unsigned int nextSend;  // The sequence number of the next entry to be sent
+    unsigned int oldest;    // The sequence number of the oldest entry in the ring
+    char frame[LOG_PROTOCOL_HEADER_SIZE + LOG_PROTOCOL_SEQUENCE_SIZE +
+               (LOGGING_STREAM_MAX_BATCH * sizeof(LogEntry))];
+} LogStream;
+
+// A log, with its RAM store, log file, log file upload and live
+// log stream: one for the C API and one for each LogClient.
+class LogInstance {
+public:
+    LogInstance();
+
+    void newLogIndexFile();
+    void writeLogIndexBlock();
+    void getLogPath(char *pPath, const char *pName);
+    void getLogFilePath(char *pPath, int sequence);
+    int readLogManifest(LogManifestRecord **ppRecords, int *pNextSequence,
+                        unsigned int *pFlags);
+    bool writeLogManifest(const LogManifestRecord *pRecords, int numRecords,
+                          int nextSequence, unsigned int flags);
+    int findCurrentLogManifestRecord(const LogManifestRecord *pRecords, int numRecords);
+    int rebuildLogManifest(LogManifestRecord **ppRecords, int *pNextSequence);
+    bool compactLogManifest();
+    int loadLogManifest(LogManifestRecord **ppRecords);
+    int getNextLogFileSequence();
+    int appendLogManifestRecord(const LogManifestRecord *pRecord);
+    void updateLogManifestRecord(int index, const LogManifestRecord *pRecord);
+    void closeLogManifestRecord(unsigned int size);
+    FILE *newLogFile();
+    void writeLogFileEntry(const LogEntry *pEntry);
+    bool lookUpLoggingServerAddress(NetworkInterface *pNetworkInterface,
+                                    const char *pLoggingServerUrl,
+                                    SocketAddress *pAddress);
+    LogServerCacheEntry *findLogServerCacheEntry(const char *pLoggingServerUrl);
+    bool getLoggingServerAddress(NetworkInterface *pNetworkInterface,
+                                 const char *pLoggingServerUrl,
+                                 SocketAddress *pAddress);
+    void forgetLoggingServerAddress(const char *pLoggingServerUrl);
+    bool openLogUploadSocket(TCPSocket *pTcpSock, NetworkInterface *pNetworkInterface,
+                             const SocketAddress *pServer, int fileNumber);
+    void logLogUploadRate(unsigned int bytes, int timeUs);
+    bool waitLogUpload(int waitMs);
+    bool logSendIsStopped(LogStream *pStream);
+    bool waitLogSend(int waitMs, LogStream *pStream);
+    bool sendLogUploadData(TCPSocket *pTcpSock, const char *pData, int size,
+                           LogStream *pStream);
+    LogUploadPipeline *newLogUploadPipeline(int index);
+    bool uploadLogFile(TCPSocket *pTcpSock, LogUploadPipeline *pPipeline,
+                       FILE *pFile, const char *pPath,
+                       const LogUploadPlanFile *pPlanFile, bool *pConnected);
+    void endLogUpload(TCPSocket *pTcpSock, LogStream *pStream);
+    void removeLogFile(char *pPath);
+    int buildLogUploadPlan(LogUploadPlanFile **ppPlan);
+    bool logUploadIsBackingOff();
+    void seedLogUploadRandom(NetworkInterface *pNetworkInterface);
+    int getLogUploadRetryDelayMs(int attempts);
+    bool logUploadAttemptFailed(int *pAttempts, bool connectionFailed, int *pDelayMs);
+    LogUploadPlanFile *getNextLogFileToUpload(int *pFileNumber);
+    void logFileUploaded(LogUploadPlanFile *pFile, char *pPath, int fileNumber);
+    TCPSocket *newLogUploadSocket();
+    void deleteLogUploadSocket(TCPSocket *pTcpSock);
+    void closeLogUploadWarmSocket();
+    TCPSocket *takeLogUploadWarmSocket();
+    bool keepLogUploadWarmSocket(LogUploadWorker *pWorker);
+    void logUploadWorkerCallback(LogUploadWorker *pWorker);
+    void deleteLogFileUploadData();
+    void deleteLogUploadWorker(LogUploadWorker *pWorker, bool terminate);
+    void deleteLogUploadWorkers(bool terminate);
+    void logFileUploadCallback();
+    void postLogUploadStep();
+    void logUploadSigio();
+    void logUploadWatchdog();
+    LogUploadStep sendLogUploadFrame(LogUploadMachine *pMachine);
+    void endLogUploadMachineFile(LogUploadMachine *pMachine, bool uploaded);
+    void retryLogUploadMachineFile(LogUploadMachine *pMachine, bool connectionFailed);
+    void failLogUploadMachine(LogUploadMachine *pMachine);
+    void deleteLogUploadMachine(LogUploadMachine *pMachine);
+    void runLogUploadStep();
+    void logUploadStep();
+    void startLogUploadMachine(EventQueue *pEventQueue);
+    bool logStreamHasRoom();
+    void putLogStreamEntry(const LogEntry *pEntry);
+    int getLogStreamEntries(LogStream *pStream, unsigned int *pSequence,
+                            unsigned int end, int numEntries);
+    int getLogStreamBatch(LogStream *pStream, unsigned int *pSequence);
+    void logStreamBatchSent(LogStream *pStream, unsigned int sequence, int numEntries);
+    bool openLogStreamSocket(LogStream *pStream, unsigned int sequence);
+    bool sendLogStreamDatagram(LogStream *pStream, const char *pData, int size);
+    bool sendLogStreamBatch(LogStream *pStream, unsigned int sequence, int numEntries);
+    bool resendLogStreamEntries(LogStream *pStream);
+    void logStreamCallback(LogStream *pStream);
+    void deleteLogStream();
+    bool logFileIsDue(unsigned int numBytes);
+    void applyLogFileRetention();
+    void rotateLogFile();
+    void initLog(void *pBuffer, int numEntries);
+    void suspendLog();
+    void resumeLog(unsigned int intervalUSeconds);
+    int getLog(LogEntry *pEntries, int numEntries);
+    int getNumLogEntries();
+    bool initLogFile(const char *pPath);
+    bool beginLogFileUpload(FATFileSystem *pFileSystem,
+                            NetworkInterface *pNetworkInterface,
+                            const char *pLoggingServerUrl);
+    void setLogFileUploadProtocol(LogUploadProtocol protocol, unsigned int deviceId);
+    void setLogFileRotation(unsigned int maxSize, unsigned int maxAgeSeconds);
+    void setLogFileRetention(unsigned int maxTotalSize, int maxNumFiles);
+    void setLogFileUploadOrder(LogUploadOrder order);
+    void setLogFileUploadConnections(int numConnections);
+    void setLogFileUploadEventQueue(EventQueue *pEventQueue);
+    void stopLogFileUpload();
+    bool beginLogStream(NetworkInterface *pNetworkInterface,
+                        const char *pLoggingServerUrl,
+                        unsigned int deviceId);
+    void setLogStreamTransport(LogStreamTransport transport);
+    void stopLogStream();
+    void LOG(LogEvent event, int parameter);
+    void logAt(unsigned int timeStamp, LogEvent event, int parameter);
+    void LOGX(LogEvent event, int parameter);
+    void writeLogEntry(const LogEntry *pEntry);
+    void flushLog();
+    void writeLog();
+    void deinitLog();
+    void printLog();
+    void printLogSince(unsigned int timestamp);
+
+    // A pointer to the logging context data.
+    // This is stored at the start of the logging
+    // buffer area
+    LogContext *_pContext;
+
+    // The number of entries in the logging buffer area.
+    int _numLogEntries;
+
+    // Mutex to arbitrate logging.
+    // The callback which writes logging to disk
+    // will attempt to lock this mutex while the
+    // function that prints out the log owns the
+    // mutex. Note that the logging functions
+    // themselves shouldn't wait on it (they have
+    // no reason to as the buffering should
+    // handle any overlap); they MUST return quickly.
+    Mutex _logMutex;
+
+    // The number of calls to writeLog().
+    int _numWrites;
+
+    // A logging timestamp.
+    Timer _logTime;
+
+    // What LOG() works on, kept together so that, for the log
+    // of the C API, the inline LOG() in log.h can get at it: the
+    // log store (a copy of _pContext), its last entry, _logTime,
+    // an offset in the logging timestamp (may be non-zero if
+    // logging has been suspended) and the last logging timestamp.
+    LogFastPath _fastPath;
+
+    // A file to write logs to.
+    FILE *_pFile;
+
+    // The path where log files are kept.
+    char _logPath[LOGGING_MAX_LEN_PATH + 1];
+
+    // The name of the current log file.
+    char _currentLogFileName[LOGGING_MAX_LEN_FILE_PATH + 1];
+
+    // The name of the index file of the current log file.
+    char _currentIndexFileName[LOGGING_MAX_LEN_FILE_PATH + 1];
+
+    // The sequence number of the current log file, the index of its record
+    // in the upload manifest (-1 if it has none) and whether a
+    // severe event has been written to it.
+    int _currentLogFileSequence;
+    int _currentLogManifestIndex;
+    bool _currentLogFileSevere;
+
+    // The CRC32 of what has been written to the current log file,
+    // kept as it is written so that, once the log file is closed,
+    // uploading it needn't read it an extra time to work it out.
+    unsigned int _currentLogFileCrc;
+
+    // The number of bytes written to the current log file and
+    // how long it has been open.
+    unsigned int _currentLogFileSize;
+    Timer _currentLogFileTimer;
+
+    // The limits at which a new log file is started, 0 for none.
+    unsigned int _logFileMaxSize;
+    unsigned int _logFileMaxAgeSeconds;
+
+    // The limits on the log files kept awaiting upload, 0 for none.
+    unsigned int _logFileMaxTotalSize;
+    int _logFileMaxNumFiles;
+
+    // Mutex to protect the upload manifest.
+    Mutex _logManifestMutex;
+
+    // The index block currently being filled for the current
+    // log file; this also tells us how many entries have been
+    // written to the log file and where the last
+    // timestamp-ordered run in it started (see log_reader.h).
+    LogIndexBlock _logIndexBlock;
+
+    // The URL and address of the logging server to upload log files to.
+    char _loggingServerUrl[LOGGING_MAX_LEN_SERVER_URL];
+    SocketAddress _loggingServer;
+
+    // The cache of logging server addresses, one per log so that
+    // logs which upload to different logging servers don't keep
+    // pushing each other's out, and a mutex to protect it.
+    LogServerCacheEntry _logServerCache[LOGGING_DNS_CACHE_SIZE];
+    Mutex _logServerCacheMutex;
+
+    // A connection to the logging server kept open after the last
+    // log file upload for the next one to use, NULL if there is
+    // none, the URL of the logging server and how long it has been
+    // idle.
+    TCPSocket *_pLogUploadWarmSocket;
+    char _logUploadWarmSocketUrl[LOGGING_MAX_LEN_SERVER_URL];
+    Timer _logUploadWarmSocketTimer;
+
+    // A thread to run the log upload process.
+    Thread *_pLogUploadThread;
+
+    // Set to ask the log file upload threads to stop.
+    volatile bool _logUploadStop;
+
+    // A buffer to hold some data that is required by the
+    // log file upload thread.
+    LogFileUploadData *_pLogFileUploadData;
+
+    // The protocol to upload log files with.
+    LogUploadProtocol _logUploadProtocol;
+
+    // The device ID sent with each log file in the framed protocol.
+    unsigned int _logUploadDeviceId;
+
+    // The event queue to run the log upload state machine on,
+    // NULL to upload log files in a thread of their own.
+    EventQueue *_pLogUploadEventQueue;
+
+    // True while a step of the log upload state machine is posted
+    // to its event queue; kept here rather than in the state
+    // machine so that posting a step needn't touch the state
+    // machine, which stopLogFileUpload() may be freeing.
+    volatile bool _logUploadStepPending;
+
+    // Mutex held by each step of the log upload state machine,
+    // so that stopLogFileUpload() doesn't free it from under one.
+    Mutex _logUploadMachineMutex;
+
+    // The number of connections over which to upload log files at once.
+    int _logUploadNumConnections;
+
+    // The order in which to upload log files.
+    LogUploadOrder _logUploadOrder;
+
+    // Mutex to protect the choice of log file to upload
+    // next, when there are many workers.
+    Mutex _logUploadFileMutex;
+
+    // The number of times in a row that the connection to the logging
+    // server has failed during log file upload and, once log file upload
+    // has given up on it, the time since; protected by
+    // _logUploadFileMutex.
+    int _logUploadNumFailures;
+    bool _logUploadBackingOff;
+    Timer _logUploadBackOffTimer;
+
+    // The state of the pseudo-random sequence from which the
+    // delays before retrying log files are jittered, seeded from
+    // what makes the device unique so that a fleet of devices
+    // don't retry in step, 0 until seeded; protected by
+    // _logUploadFileMutex.
+    unsigned int _logUploadRandom;
+
+    // The live log stream, NULL if the log isn't being streamed.
+    LogStream *_pLogStream;
+
+    // The transport over which to stream the log.
+    LogStreamTransport _logStreamTransport;
+
+    // Mutex to protect the ring of the live log stream.
+    Mutex _logStreamMutex;
+
+#ifdef LOG_STATIC_ALLOCATION
+
+    // Storage for the records of the upload manifest and for the
+    // upload plan, protected by _logManifestMutex and taken up
+    // by the log file upload data respectively.
+    LogManifestRecord _logManifestRecordStore[LOGGING_STATIC_MAX_LOG_FILES];
+    LogUploadPlanFile _logUploadPlanStore[LOGGING_STATIC_MAX_LOG_FILES];
+
+    // Storage for the log file upload data and the log upload
+    // state machine, with its buffer.
+    uint64_t _logFileUploadDataStore[LOGGING_STORE_WORDS(sizeof(LogFileUploadData))];
+    uint64_t _logUploadMachineStore[LOGGING_STORE_WORDS(sizeof(LogUploadMachine))];
+    char _logUploadMachineBufferStore[LOGGING_UPLOAD_BUFFER_SIZE];
+
+    // Storage for the threads of the log upload workers and their
+    // stacks; the thread of the first is the log file upload thread.
+    uint64_t _logUploadThreadStore[LOGGING_UPLOAD_MAX_CONNECTIONS]
+                                  [LOGGING_STORE_WORDS(sizeof(Thread))];
+    uint64_t _logUploadStackStore[LOGGING_UPLOAD_MAX_CONNECTIONS]
+                                 [LOGGING_STORE_WORDS(OS_STACK_SIZE)];
+
+    // Storage for the pipelines of the log upload workers, with
+    // their buffers, semaphores, reader threads and stacks.
+    LogUploadPipeline _logUploadPipelineStore[LOGGING_UPLOAD_MAX_CONNECTIONS];
+    char _logUploadBufferStore[LOGGING_UPLOAD_MAX_CONNECTIONS]
+                              [LOGGING_UPLOAD_NUM_BUFFERS]
+                              [LOGGING_UPLOAD_BUFFER_SIZE];
+    uint64_t _logUploadSemaphoreStore[LOGGING_UPLOAD_MAX_CONNECTIONS][3]
+                                     [LOGGING_STORE_WORDS(sizeof(Semaphore))];
+    uint64_t _logUploadReaderThreadStore[LOGGING_UPLOAD_MAX_CONNECTIONS]
+                                        [LOGGING_STORE_WORDS(sizeof(Thread))];
+    uint64_t _logUploadReaderStackStore[LOGGING_UPLOAD_MAX_CONNECTIONS]
+                                       [LOGGING_STORE_WORDS(LOGGING_UPLOAD_READER_STACK_SIZE)];
+
+    // Storage for the TCP sockets of log file upload, one per
+    // connection plus the connection kept open after the last
+    // upload, and which of them are in use, protected by
+    // _logUploadFileMutex.
+    uint64_t _logUploadSocketStore[LOGGING_UPLOAD_MAX_CONNECTIONS + 1]
+                                  [LOGGING_STORE_WORDS(sizeof(TCPSocket))];
+    bool _logUploadSocketInUse[LOGGING_UPLOAD_MAX_CONNECTIONS + 1];
+
+    // Storage for the live log stream, its socket, semaphore,
+    // thread and stack.
+    uint64_t _logStreamStore[LOGGING_STORE_WORDS(sizeof(LogStream))];
+    uint64_t _logStreamSocketStore[LOGGING_STORE_WORDS(sizeof(TCPSocket) > sizeof(UDPSocket) ?
+                                                       sizeof(TCPSocket) : sizeof(UDPSocket))];
+    uint64_t _logStreamSemaphoreStore[LOGGING_STORE_WORDS(sizeof(Semaphore))];
+    uint64_t _logStreamThreadStore[LOGGING_STORE_WORDS(sizeof(Thread))];
+    uint64_t _logStreamStackStore[LOGGING_STORE_WORDS(OS_STACK_SIZE)];
+
+#endif
+};
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The strings associated with the enum values.
+extern const char *gLogStrings[];
+extern const int gNumLogStrings;
+
+// The rate limit on log file upload: a token bucket which
+// fills at gLogUploadBytesPerSecond (0 for no limit) up to
+// gLogUploadBurstSize bytes, the tokens being kept in
+// millionths of a byte so that no fractions are lost.
+static unsigned int gLogUploadBytesPerSecond = 0;
+static unsigned int gLogUploadBurstSize = 0;
+static unsigned long long gLogUploadTokens = 0;
+static Timer gLogUploadRateTimer;
+
+// If non-NULL, log files are only uploaded while this returns true.
+static bool (*gpLogUploadIdleCallback)(void) = NULL;
+
+// Mutex to protect the rate limit.
+static Mutex gLogUploadRateMutex;
+
+// The order in which an upload plan is being sorted, since
+// qsort() can't pass it to the comparison function, and a
+// mutex to protect it.
+static LogUploadOrder gLogUploadSortOrder = LOG_UPLOAD_ORDER_OLDEST_FIRST;
+static Mutex gLogUploadSortMutex;
+
+// The logs: the first is the log of the C API, the others are
+// there for LogClients to take, as marked here, protected by
+// gLogInstancesMutex.
+static LogInstance gLogInstances[LOGGING_MAX_NUM_CLIENTS + 1];
+static bool gLogInstanceTaken[LOGGING_MAX_NUM_CLIENTS + 1];
+static Mutex gLogInstancesMutex;
+
+// What the inline LOG() in log.h works on: that of the log of
+// the C API.
+LogFastPath * const gpLogFastPath = &(gLogInstances[0]._fastPath);
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Create a log, which has nowhere to log to until initLog().
+LogInstance::LogInstance()
+{
+    _pContext = NULL;
+    _numLogEntries = 0;
+    _fastPath.pContext = NULL;
+    _fastPath.pLogLast = NULL;
+    _fastPath.pLogTime = &_logTime;
+    _fastPath.logTimeOffset = 0;
+    _fastPath.lastLogTime = 0;
+    _numWrites = 0;
+    _pFile = NULL;
+    _currentLogFileSequence = -1;
+    _currentLogManifestIndex = -1;
+    _currentLogFileSevere = false;
+    _currentLogFileCrc = 0;
+    _currentLogFileSize = 0;
+    _logFileMaxSize = 0;
+    _logFileMaxAgeSeconds = 0;
+    _logFileMaxTotalSize = 0;
+    _logFileMaxNumFiles = 0;
+    for (int x = 0; x < LOGGING_DNS_CACHE_SIZE; x++) {
+        _logServerCache[x].url[0] = 0;
+    }
+    _pLogUploadWarmSocket = NULL;
+    _pLogUploadThread = NULL;
+    _logUploadStop = false;
+    _pLogFileUploadData = NULL;
+    _logUploadProtocol = LOG_UPLOAD_PROTOCOL_LEGACY;
+    _logUploadDeviceId = 0;
+    _pLogUploadEventQueue = NULL;
+    _logUploadStepPending = false;
+    _logUploadNumConnections = 1;
+    _logUploadOrder = LOG_UPLOAD_ORDER_OLDEST_FIRST;
+    _logUploadNumFailures = 0;
+    _logUploadBackingOff = false;
+    _logUploadRandom = 0;
+    _pLogStream = NULL;
+    _logStreamTransport = LOG_STREAM_TRANSPORT_TCP;
+}
+
+// Print a single item from a log.
+void printLogItem(const LogEntry *pItem, unsigned int itemIndex)
+{
+    // Note: the comparison is done unsigned so that a
+    // corrupt negative event is also caught
+    if ((unsigned int) pItem->event >= (unsigned int) gNumLogStrings) {
+        printf("%.3f: out of range event at entry %d (%d when max is %d)\n",
+               (float) pItem->timestamp / 1000, itemIndex, pItem->event, gNumLogStrings - 1);
+    } else {
+        printf ("%6.3f: %s [%d] %d (%#x)\n", (float) pItem->timestamp / 1000,
+                gLogStrings[pItem->event], pItem->event, pItem->parameter, pItem->parameter);
+    }
+
+}
+
+// Get the number of a log file from its name, -1 if
+// the name is not that of a log file.
+static int getLogFileNumber(const char *pName)
+{
+    char name[LOGGING_MAX_LEN_FILE_NAME + 1];
+    int number = -1;
+
+    if (strlen(pName) <= LOGGING_MAX_LEN_FILE_NAME) {
+        number = atoi(pName);
+        // Check that it is exactly what newLogFile() would have named it
+        sprintf(name, "%04d" LOGGING_FILE_EXTENSION, number);
+        if ((number < 0) || (strcmp(name, pName) != 0)) {
+            number = -1;
+        }
+    }
+
+    return number;
+}
+
+// Turn the name of a log file, or one of the files that
+// go with it, into the name of the file with the given
+// extension (all extensions being the same length).
+static void setFileNameExtension(char *pName, const char *pExtension)
+{
+    int x = strlen(pName) - strlen(pExtension);
+
+    if (x >= 0) {
+        strcpy(pName + x, pExtension);
+    }
+}
+
+// Create the index file for a new log file.
+void LogInstance::newLogIndexFile()
+{
+    FILE *pFile;
+
+    strcpy(_currentIndexFileName, _currentLogFileName);
+    setFileNameExtension(_currentIndexFileName, LOG_INDEX_FILE_EXTENSION);
+    logIndexBlockInit(&_logIndexBlock, 0, 0);
+    pFile = fopen(_currentIndexFileName, "wb");
+    if (pFile != NULL) {
+        if (!logIndexWriteHeader(pFile)) {
+            _currentIndexFileName[0] = 0;
+        }
+        fclose(pFile);
+    } else {
+        // Carry on without an index
+        _currentIndexFileName[0] = 0;
+    }
+}
+
+// Append the current index block, if it has anything
+// in it, to the index file of the current log file
+// and start a new one.
+// Note: log file mutex must be locked before calling.
+void LogInstance::writeLogIndexBlock()
+{
+    FILE *pFile;
+
+    if ((_logIndexBlock.numEntries > 0) && (_currentIndexFileName[0] != 0)) {
+        pFile = fopen(_currentIndexFileName, "ab");
+        if (pFile != NULL) {
+            logIndexWriteBlock(pFile, &_logIndexBlock);
+            fclose(pFile);
+        }
+    }
+    logIndexBlockInit(&_logIndexBlock,
+                      _logIndexBlock.firstEntry + _logIndexBlock.numEntries,
+                      _logIndexBlock.runStart);
+}
+
+// Get the path of a file in the log directory.
+void LogInstance::getLogPath(char *pPath, const char *pName)
+{
+    sprintf(pPath, "%s/%s", _logPath, pName);
+}
+
+// Get the path of the log file with the given sequence number.
+void LogInstance::getLogFilePath(char *pPath, int sequence)
+{
+    sprintf(pPath, "%s/%04d" LOGGING_FILE_EXTENSION, _logPath,
+            sequence % LOGGING_NUM_FILE_NAMES);
+}
+
+// Read the header of an open upload manifest, returning true
+// if it is valid.
+static bool readLogManifestHeader(FILE *pFile, LogManifestHeader *pHeader)
+{
+    return (fread(pHeader, sizeof(*pHeader), 1, pFile) == 1) &&
+           (pHeader->magic == LOGGING_MANIFEST_MAGIC) &&
+           (pHeader->version == LOGGING_MANIFEST_VERSION);
+}
+
+// Read the records of the upload manifest, and the flags of its
+// header, returning the number read, or -1 if there is no valid
+// manifest.  With
+// LOG_STATIC_ALLOCATION no more than LOGGING_STATIC_MAX_LOG_FILES
+// are read and the records must be finished with before the
+// mutex is unlocked.
+// Note: log manifest mutex must be locked before calling.
+int LogInstance::readLogManifest(LogManifestRecord **ppRecords, int *pNextSequence,
+                                 unsigned int *pFlags)
+{
+    char path[LOGGING_MAX_LEN_FILE_PATH + 1];
+    LogManifestHeader header;
+    LogManifestRecord *pRecords = NULL;
+    FILE *pFile;
+    long size;
+    int numRecords = -1;
+
+    getLogPath(path, LOGGING_MANIFEST_FILE_NAME);
+    pFile = fopen(path, "rb");
+    if (pFile != NULL) {
+        if (readLogManifestHeader(pFile, &header) && (fseek(pFile, 0, SEEK_END) == 0)) {
+            // A record cut short by a power failure is ignored
+            size = ftell(pFile) - sizeof(header);
+            numRecords = size / sizeof(LogManifestRecord);
+            *pNextSequence = header.nextSequence;
+            *pFlags = header.flags;
+            if (numRecords > 0) {
+#ifdef LOG_STATIC_ALLOCATION
+                // If they don't all fit, keep to the oldest log files
+                if (numRecords > LOGGING_STATIC_MAX_LOG_FILES) {
+                    numRecords = LOGGING_STATIC_MAX_LOG_FILES;
+                }
+#endif
+                pRecords = LOGGING_NEW_ARRAY(_logManifestRecordStore, LogManifestRecord, numRecords);
+                if ((fseek(pFile, sizeof(header), SEEK_SET) != 0) ||
+                    (fread(pRecords, sizeof(LogManifestRecord), numRecords, pFile) !=
+                     (size_t) numRecords)) {
+                    LOGGING_DELETE_ARRAY(pRecords);
+                    pRecords = NULL;
+                    numRecords = -1;
+                }
+            }
+        }
+        fclose(pFile);
+    }
+    *ppRecords = pRecords;
+
+    return numRecords;
+}
+
+// Write the upload manifest afresh, returning true on success.
+// The manifest is written to a temporary file which then
+// replaces it; if power fails in between there is no manifest
+// and it is rebuilt from the log directory.
+// Note: log manifest mutex must be locked before calling.
+bool LogInstance::writeLogManifest(const LogManifestRecord *pRecords, int numRecords,
+                                   int nextSequence, unsigned int flags)
+{
+    char path[LOGGING_MAX_LEN_FILE_PATH + 1];
+    char tempPath[LOGGING_MAX_LEN_FILE_PATH + 1];
+    LogManifestHeader header;
+    FILE *pFile;
+    bool success = false;
+
+    header.magic = LOGGING_MANIFEST_MAGIC;
+    header.version = LOGGING_MANIFEST_VERSION;
+    header.nextSequence = nextSequence;
+    header.flags = flags;
+    getLogPath(path, LOGGING_MANIFEST_FILE_NAME);
+    getLogPath(tempPath, LOGGING_MANIFEST_TEMP_FILE_NAME);
+    pFile = fopen(tempPath, "wb");
+    if (pFile != NULL) {
+        success = (fwrite(&header, sizeof(header), 1, pFile) == 1) &&
+                  ((numRecords == 0) ||
+                   (fwrite(pRecords, sizeof(LogManifestRecord), numRecords, pFile) ==
+                    (size_t) numRecords));
+        fclose(pFile);
+        if (success) {
+            remove(path);
+            success = (rename(tempPath, path) == 0);
+        } else {
+            remove(tempPath);
+        }
+    }
+
+    return success;
+}
+
+// Compare two records of the upload manifest for qsort(),
+// oldest log file first.
+static int compareLogManifestRecords(const void *p1, const void *p2)
+{
+    return ((const LogManifestRecord *) p1)->sequence -
+           ((const LogManifestRecord *) p2)->sequence;
+}
+
+// Find the record of the current log file in the upload manifest.
+int LogInstance::findCurrentLogManifestRecord(const LogManifestRecord *pRecords, int numRecords)
+{
+    int index = -1;
+
+    for (int x = 0; (x < numRecords) && (index < 0); x++) {
+        if (pRecords[x].sequence == _currentLogFileSequence) {
+            index = x;
+        }
+    }
+
+    return index;
+}
+
+// Rebuild the upload manifest from a single pass of the log
+// directory, returning the number of records in it, or -1 if
+// the log directory can't be read.  The sequence numbers of
+// the log files are taken from their names, so if they have
+// wrapped the order of the log files is lost.  With
+// LOG_STATIC_ALLOCATION, if there are more log files than there
+// is room for records, the manifest keeps the oldest and is
+// marked as partial so that the upload planner looks for the
+// rest again.
+// Note: log manifest mutex must be locked before calling.
+int LogInstance::rebuildLogManifest(LogManifestRecord **ppRecords, int *pNextSequence)
+{
+    DIR *pDir;
+    struct dirent *pDirEnt;
+    LogManifestRecord *pRecords = NULL;
+    LogManifestRecord *pRecord;
+    int maxNumRecords = 0;
+    int numRecords = -1;
+    bool complete = true;
+    int x;
+
+    *pNextSequence = 0;
+    LOG(EVENT_DIR_OPEN, 0);
+    pDir = opendir(_logPath);
+    if (pDir != NULL) {
+        numRecords = 0;
+        while ((pDirEnt = readdir(pDir)) != NULL) {
+            if ((pDirEnt->d_type == DT_REG) && ((x = getLogFileNumber(pDirEnt->d_name)) >= 0)) {
+#ifdef LOG_STATIC_ALLOCATION
+                pRecords = _logManifestRecordStore;
+                maxNumRecords = LOGGING_STATIC_MAX_LOG_FILES;
+                if (numRecords < maxNumRecords) {
+                    pRecord = &(pRecords[numRecords]);
+                    numRecords++;
+                } else {
+                    // No room: keep to the oldest log files
+                    complete = false;
+                    pRecord = &(pRecords[0]);
+                    for (int y = 1; y < numRecords; y++) {
+                        if (pRecords[y].sequence > pRecord->sequence) {
+                            pRecord = &(pRecords[y]);
+                        }
+                    }
+                    if (pRecord->sequence < x) {
+                        pRecord = NULL;
+                    }
+                }
+#else
+                if (numRecords >= maxNumRecords) {
+                    maxNumRecords += LOGGING_MANIFEST_BLOCK_RECORDS;
+                    pRecord = new LogManifestRecord[maxNumRecords];
+                    if (pRecords != NULL) {
+                        memcpy(pRecord, pRecords, numRecords * sizeof(LogManifestRecord));
+                        delete[] pRecords;
+                    }
+                    pRecords = pRecord;
+                }
+                pRecord = &(pRecords[numRecords]);
+                numRecords++;
+#endif
+                if (pRecord != NULL) {
+                    pRecord->sequence = x;
+                    pRecord->flags = 0;
+                    pRecord->size = 0;
+                    pRecord->crc = 0;
+                }
+                if (x >= *pNextSequence) {
+                    *pNextSequence = x + 1;
+                }
+            }
+        }
+        closedir(pDir);
+        if (numRecords > 1) {
+            qsort(pRecords, numRecords, sizeof(LogManifestRecord), compareLogManifestRecords);
+        }
+        // If the manifest can't be written it is simply rebuilt next
+        // time; if not all of the log files could be kept it is
+        // still written, for the sequence number of the next log
+        // file, but marked so that those left out are found when
+        // it is next loaded
+        if (writeLogManifest(pRecords, numRecords, *pNextSequence,
+                             complete ? 0 : LOGGING_MANIFEST_HEADER_FLAG_PARTIAL)) {
+            _currentLogManifestIndex = findCurrentLogManifestRecord(pRecords, numRecords);
+        }
+    } else {
+        LOG(EVENT_DIR_OPEN_FAILURE, errno);
+        printf("[Unable to open path \"%s\" (error %d)]\n", _logPath, errno);
+    }
+    *ppRecords = pRecords;
+
+    return numRecords;
+}
+
+// Drop the records of log files which have gone from the upload
+// manifest, copying it a record at a time so that no memory is
+// needed for the records, returning true if it was rewritten.
+// Note: log manifest mutex must be locked before calling.
+bool LogInstance::compactLogManifest()
+{
+    char path[LOGGING_MAX_LEN_FILE_PATH + 1];
+    char tempPath[LOGGING_MAX_LEN_FILE_PATH + 1];
+    LogManifestHeader header;
+    LogManifestRecord record;
+    FILE *pFile;
+    FILE *pTempFile;
+    int numGone = 0;
+    int numPending = 0;
+    int currentIndex = -1;
+    bool success = false;
+
+    getLogPath(path, LOGGING_MANIFEST_FILE_NAME);
+    getLogPath(tempPath, LOGGING_MANIFEST_TEMP_FILE_NAME);
+    pFile = fopen(path, "rb");
+    if (pFile != NULL) {
+        if (readLogManifestHeader(pFile, &header)) {
+            // A record cut short by a power failure is ignored
+            while (fread(&record, sizeof(record), 1, pFile) == 1) {
+                if ((record.flags & LOGGING_MANIFEST_FLAGS_GONE) != 0) {
+                    numGone++;
+                }
+            }
+            if ((numGone > 0) && (fseek(pFile, sizeof(header), SEEK_SET) == 0)) {
+                pTempFile = fopen(tempPath, "wb");
+                if (pTempFile != NULL) {
+                    success = (fwrite(&header, sizeof(header), 1, pTempFile) == 1);
+                    while (success && (fread(&record, sizeof(record), 1, pFile) == 1)) {
+                        if ((record.flags & LOGGING_MANIFEST_FLAGS_GONE) == 0) {
+                            if (record.sequence == _currentLogFileSequence) {
+                                currentIndex = numPending;
+                            }
+                            success = (fwrite(&record, sizeof(record), 1, pTempFile) == 1);
+                            numPending++;
+                        }
+                    }
+                    fclose(pTempFile);
+                }
+            }
+        }
+        fclose(pFile);
+        if (success) {
+            remove(path);
+            success = (rename(tempPath, path) == 0);
+        } else if (numGone > 0) {
+            remove(tempPath);
+        }
+        // Only move the index of the record of the current log file
+        // if the manifest was rewritten, otherwise it would no
+        // longer match the manifest
+        if (success && (_currentLogManifestIndex >= 0)) {
+            _currentLogManifestIndex = currentIndex;
+        }
+    }
+
+    return success;
+}
+
+// Load the upload manifest, rebuilding it if there is none, or
+// it is partial, and otherwise dropping the records of log files
+// which have been uploaded, returning the number of records, or
+// -1 if there is no manifest and the log directory can't be read.
+// Note: log manifest mutex must be locked before calling.
+int LogInstance::loadLogManifest(LogManifestRecord **ppRecords)
+{
+    int numRecords;
+    int nextSequence;
+    unsigned int flags = 0;
+
+    compactLogManifest();
+    numRecords = readLogManifest(ppRecords, &nextSequence, &flags);
+    if ((numRecords >= 0) && ((flags & LOGGING_MANIFEST_HEADER_FLAG_PARTIAL) != 0)) {
+        // Some log files were left out, they may fit now
+        LOGGING_DELETE_ARRAY(*ppRecords);
+        numRecords = -1;
+    }
+    if (numRecords < 0) {
+        numRecords = rebuildLogManifest(ppRecords, &nextSequence);
+    }
+
+    return numRecords;
+}
+
+// Get the sequence number for the next log file from the
+// header of the upload manifest, rebuilding the manifest
+// from the log directory if there is none.
+// Note: log manifest mutex must be locked before calling.
+int LogInstance::getNextLogFileSequence()
+{
+    char path[LOGGING_MAX_LEN_FILE_PATH + 1];
+    LogManifestHeader header;
+    LogManifestRecord *pRecords = NULL;
+    FILE *pFile;
+    int nextSequence = -1;
+
+    getLogPath(path, LOGGING_MANIFEST_FILE_NAME);
+    pFile = fopen(path, "rb");
+    if (pFile != NULL) {
+        if (readLogManifestHeader(pFile, &header)) {
+            nextSequence = header.nextSequence;
+        }
+        fclose(pFile);
+    }
+    if (nextSequence < 0) {
+        rebuildLogManifest(&pRecords, &nextSequence);
+        LOGGING_DELETE_ARRAY(pRecords);
+    }
+
+    return nextSequence;
+}
+
+// Append a record to the upload manifest, and set the sequence
+// number for the next log file, returning the index of the
+// record, or -1 if there is no manifest (in which case the log
+// file will be found when the manifest is rebuilt).
+// Note: log manifest mutex must be locked before calling.
+int LogInstance::appendLogManifestRecord(const LogManifestRecord *pRecord)
+{
+    char path[LOGGING_MAX_LEN_FILE_PATH + 1];
+    LogManifestHeader header;
+    FILE *pFile;
+    long size;
+    int index = -1;
+
+    getLogPath(path, LOGGING_MANIFEST_FILE_NAME);
+    pFile = fopen(path, "r+b");
+    if (pFile != NULL) {
+        if (readLogManifestHeader(pFile, &header) && (fseek(pFile, 0, SEEK_END) == 0)) {
+            size = ftell(pFile) - sizeof(header);
+            // Write over any record cut short by a power failure
+            index = size / sizeof(LogManifestRecord);
+            header.nextSequence = pRecord->sequence + 1;
+            if ((fseek(pFile, sizeof(header) + index * sizeof(LogManifestRecord),
+                       SEEK_SET) != 0) ||
+                (fwrite(pRecord, sizeof(*pRecord), 1, pFile) != 1) ||
+                (fseek(pFile, 0, SEEK_SET) != 0) ||
+                (fwrite(&header, sizeof(header), 1, pFile) != 1)) {
+                index = -1;
+            }
+        }
+        fclose(pFile);
+    }
+
+    return index;
+}
+
+// Overwrite a record in the upload manifest.
+// Note: log manifest mutex must be locked before calling.
+void LogInstance::updateLogManifestRecord(int index, const LogManifestRecord *pRecord)
+{
+    char path[LOGGING_MAX_LEN_FILE_PATH + 1];
+    FILE *pFile;
+
+    getLogPath(path, LOGGING_MANIFEST_FILE_NAME);
+    pFile = fopen(path, "r+b");
+    if (pFile != NULL) {
+        if (fseek(pFile, sizeof(LogManifestHeader) + index * sizeof(LogManifestRecord),
+                  SEEK_SET) == 0) {
+            fwrite(pRecord, sizeof(*pRecord), 1, pFile);
+        }
+        fclose(pFile);
+    }
+}
+
+// Record the size and CRC32 of the current log file, and whether
+// it contains a severe event, in the upload manifest, now that
+// nothing more will be written to it.
+void LogInstance::closeLogManifestRecord(unsigned int size)
+{
+    LogManifestRecord record;
+
+    _logManifestMutex.lock();
+    if (_currentLogManifestIndex >= 0) {
+        record.sequence = _currentLogFileSequence;
+        record.flags = LOGGING_MANIFEST_FLAG_CLOSED;
+        if (_currentLogFileSevere) {
+            record.flags |= LOGGING_MANIFEST_FLAG_SEVERE;
+        }
+        record.size = size;
+        record.crc = _currentLogFileCrc;
+        updateLogManifestRecord(_currentLogManifestIndex, &record);
+        _currentLogManifestIndex = -1;
+    }
+    _logManifestMutex.unlock();
+}
+
+// Open a log file, storing its name in _currentLogFileName
+// and returning a handle to it.  The name comes from the
+// sequence number kept in the upload manifest so that only
+// one name need be tried, however many log files there are.
+FILE *LogInstance::newLogFile()
+{
+    FILE *pFile = NULL;
+    LogManifestRecord record;
+    int sequence;
+    bool tryAgain = true;
+
+    _logManifestMutex.lock();
+    sequence = getNextLogFileSequence();
+    for (unsigned int x = 0; (x < LOGGING_NUM_FILE_NAMES) && tryAgain; x++) {
+        getLogFilePath(_currentLogFileName, sequence);
+        // The file shouldn't exist but, since the names
+        // wrap, check that it doesn't before using it
+        pFile = fopen(_currentLogFileName, "r");
+        if (pFile == NULL) {
+            tryAgain = false;
+            printf("Log file will be \"%s\".\n", _currentLogFileName);
+            pFile = fopen (_currentLogFileName, "wb+");
+            if (pFile != NULL) {
+                newLogIndexFile();
+                _currentLogFileSize = 0;
+                _currentLogFileTimer.reset();
+                _currentLogFileTimer.start();
+                _currentLogFileSequence = sequence;
+                _currentLogFileSevere = false;
+                _currentLogFileCrc = 0;
+                record.sequence = sequence;
+                record.flags = 0;
+                record.size = 0;
+                record.crc = 0;
+                _currentLogManifestIndex = appendLogManifestRecord(&record);
+                LOG(EVENT_LOG_FILE_OPEN, 0);
+            } else {
+                LOG(EVENT_LOG_FILE_OPEN_FAILURE, errno);
+                perror ("Error initialising log file");
+            }
+        } else {
+            fclose(pFile);
+            pFile = NULL;
+            sequence++;
+        }
+    }
+    _logManifestMutex.unlock();
+
+    return pFile;
+}
+
+// Write a log entry to the current log file, adding it
+// to the index.
+// Note: log file mutex must be locked before calling.
+void LogInstance::writeLogFileEntry(const LogEntry *pEntry)
+{
+    fwrite(pEntry, sizeof(*pEntry), 1, _pFile);
+    _currentLogFileSize += sizeof(*pEntry);
+    _currentLogFileCrc = logCrc32(_currentLogFileCrc, pEntry, sizeof(*pEntry));
+    logIndexBlockAdd(&_logIndexBlock, pEntry);
+    if (((unsigned int) pEntry->event < (unsigned int) gNumLogStrings) &&
+        (gLogStrings[pEntry->event][0] == '*')) {
+        _currentLogFileSevere = true;
+    }
+    if (_logIndexBlock.numEntries >= LOG_INDEX_BLOCK_ENTRIES) {
+        writeLogIndexBlock();
+    }
+}
+
+// Get the address portion of a URL, leaving off the port number etc.
+static void getAddressFromUrl(const char * pUrl, char * pAddressBuf, int lenBuf)
+{
+    const char * pPortPos;
+    int lenUrl;
+
+    if (lenBuf > 0) {
+        // Check for the presence of a port number
+        pPortPos = strchr(pUrl, ':');
+        if (pPortPos != NULL) {
+            // Length wanted is up to and including the ':'
+            // (which will be overwritten with the terminator)
+            if (lenBuf > pPortPos - pUrl + 1) {
+                lenBuf = pPortPos - pUrl + 1;
+            }
+        } else {
+            // No port number, take the whole thing
+            // including the terminator
+            lenUrl = strlen (pUrl);
+            if (lenBuf > lenUrl + 1) {
+                lenBuf = lenUrl + 1;
+            }
+        }
+        memcpy (pAddressBuf, pUrl, lenBuf);
+        *(pAddressBuf + lenBuf - 1) = 0;
+    }
+}
+
+// Get the port number from the end of a URL.
+static bool getPortFromUrl(const char * pUrl, int *port)
+{
+    bool success = false;
+    const char * pPortPos = strchr(pUrl, ':');
+
+    if (pPortPos != NULL) {
+        *port = atoi(pPortPos + 1);
+        success = true;
+    }
+
+    return success;
+}
+
+// Look up the address of the logging server from its URL,
+// returning true if it was found.
+bool LogInstance::lookUpLoggingServerAddress(NetworkInterface *pNetworkInterface,
+                                             const char *pLoggingServerUrl,
+                                             SocketAddress *pAddress)
+{
+    bool found = false;
+    char buf[LOGGING_MAX_LEN_SERVER_URL];
+    int port;
+
+    getAddressFromUrl(pLoggingServerUrl, buf, sizeof(buf));
+    LOG(EVENT_DNS_LOOKUP, 0);
+    printf("[Looking for logging server URL \"%s\"...]\n", buf);
+    if (pNetworkInterface->gethostbyname(buf, pAddress) == 0) {
+        printf("[Found it at IP address %s]\n", pAddress->get_ip_address());
+        if (getPortFromUrl(pLoggingServerUrl, &port)) {
+            pAddress->set_port(port);
+            printf("[Logging server port set to %d]\n", pAddress->get_port());
+        } else {
+            printf("[WARNING: no port number was specified in the logging server URL (\"%s\")]\n",
+                    pLoggingServerUrl);
+        }
+        found = true;
+    } else {
+        LOG(EVENT_DNS_LOOKUP_FAILURE, 0);
+        printf("[Unable to locate logging server \"%s\"]\n", pLoggingServerUrl);
+    }
+
+    return found;
+}
+
+// Find the entry for a URL in the cache of logging server
+// addresses, or the entry to replace with it.
+// Note: log server cache mutex must be locked before calling.
+LogServerCacheEntry *LogInstance::findLogServerCacheEntry(const char *pLoggingServerUrl)
+{
+    LogServerCacheEntry *pEntry = NULL;
+    LogServerCacheEntry *pOldest = &(_logServerCache[0]);
+
+    for (int x = 0; (x < LOGGING_DNS_CACHE_SIZE) && (pEntry == NULL); x++) {
+        if (strcmp(_logServerCache[x].url, pLoggingServerUrl) == 0) {
+            pEntry = &(_logServerCache[x]);
+        } else if ((_logServerCache[x].url[0] == 0) ||
+                   ((pOldest->url[0] != 0) &&
+                    (_logServerCache[x].timer.read_high_resolution_us() >
+                     pOldest->timer.read_high_resolution_us()))) {
+            pOldest = &(_logServerCache[x]);
+        }
+    }
+
+    return (pEntry != NULL) ? pEntry : pOldest;
+}
+
+// Get the address of the logging server from its URL, returning
+// true if it was found.  Addresses are cached for
+// LOGGING_DNS_CACHE_SECONDS and failures to find them for
+// LOGGING_DNS_NEGATIVE_CACHE_SECONDS so that repeated uploads
+// don't each pay for a lookup over the network.
+bool LogInstance::getLoggingServerAddress(NetworkInterface *pNetworkInterface,
+                                          const char *pLoggingServerUrl,
+                                          SocketAddress *pAddress)
+{
+    LogServerCacheEntry *pEntry;
+    unsigned long long ageUs;
+    bool found;
+
+    _logServerCacheMutex.lock();
+    pEntry = findLogServerCacheEntry(pLoggingServerUrl);
+    ageUs = pEntry->timer.read_high_resolution_us();
+    if ((strcmp(pEntry->url, pLoggingServerUrl) == 0) &&
+        (ageUs < (unsigned long long) (pEntry->found ? LOGGING_DNS_CACHE_SECONDS :
+                                                       LOGGING_DNS_NEGATIVE_CACHE_SECONDS) * 1000000)) {
+        found = pEntry->found;
+        if (found) {
+            *pAddress = pEntry->address;
+            printf("[Logging server \"%s\" is at %s:%d (cached)]\n", pLoggingServerUrl,
+                   pAddress->get_ip_address(), pAddress->get_port());
+        } else {
+            LOG(EVENT_DNS_LOOKUP_FAILURE, 1);
+            printf("[Logging server \"%s\" was not found %d second(s) ago, not trying again yet]\n",
+                   pLoggingServerUrl, (int) (ageUs / 1000000));
+        }
+    } else {
+        found = lookUpLoggingServerAddress(pNetworkInterface, pLoggingServerUrl, pAddress);
+        if (strlen(pLoggingServerUrl) < sizeof(pEntry->url)) {
+            strcpy(pEntry->url, pLoggingServerUrl);
+            pEntry->address = *pAddress;
+            pEntry->found = found;
+            pEntry->timer.reset();
+            pEntry->timer.start();
+        }
+    }
+    _logServerCacheMutex.unlock();
+
+    return found;
+}
+
+// Forget the cached address of a logging server, e.g. because
+// it could not be connected to, so that it is looked up again.
+void LogInstance::forgetLoggingServerAddress(const char *pLoggingServerUrl)
+{
+    LogServerCacheEntry *pEntry;
+
+    _logServerCacheMutex.lock();
+    pEntry = findLogServerCacheEntry(pLoggingServerUrl);
+    if (strcmp(pEntry->url, pLoggingServerUrl) == 0) {
+        pEntry->url[0] = 0;
+    }
+    _logServerCacheMutex.unlock();
+}
+
+// Open a TCP socket and connect it to the logging server at
+// the given address.
+bool LogInstance::openLogUploadSocket(TCPSocket *pTcpSock, NetworkInterface *pNetworkInterface,
+                                      const SocketAddress *pServer, int fileNumber)
+{
+    nsapi_error_t nsapiError;
+    bool connected = false;
+
+    LOG(EVENT_SOCKET_OPENING, fileNumber);
+    nsapiError = pTcpSock->open(pNetworkInterface);
+    if (nsapiError == NSAPI_ERROR_OK) {
+        LOG(EVENT_SOCKET_OPENED, fileNumber);
+        pTcpSock->set_timeout(LOGGING_UPLOAD_TIMEOUT_MS);
+        LOG(EVENT_TCP_CONNECTING, fileNumber);
+        nsapiError = pTcpSock->connect(*pServer);
+        if (nsapiError == NSAPI_ERROR_OK) {
+            LOG(EVENT_TCP_CONNECTED, fileNumber);
+            connected = true;
+        } else {
+            LOG(EVENT_TCP_CONNECT_FAILURE, nsapiError);
+            pTcpSock->close();
+        }
+    } else {
+        LOG(EVENT_SOCKET_OPENING_FAILURE, nsapiError);
+    }
+
+    return connected;
+}
+
+// Work out how many of size bytes of log file upload may be
+// sent now under the rate limit and the idle condition; if the
+// answer is none, *pWaitMs is set to how long to wait before
+// asking again.  Call useLogUploadAllowance() with the number
+// of bytes actually sent.
+static int getLogUploadAllowance(int size, int *pWaitMs)
+{
+    unsigned long long tokens;
+
+    *pWaitMs = 0;
+    if ((gpLogUploadIdleCallback != NULL) && !gpLogUploadIdleCallback()) {
+        *pWaitMs = LOGGING_UPLOAD_IDLE_POLL_MS;
+        size = 0;
+    } else if (gLogUploadBytesPerSecond > 0) {
+        gLogUploadRateMutex.lock();
+        gLogUploadTokens += (unsigned long long) gLogUploadRateTimer.read_us() *
+                            gLogUploadBytesPerSecond;
+        gLogUploadRateTimer.reset();
+        if (gLogUploadTokens > (unsigned long long) gLogUploadBurstSize * 1000000) {
+            gLogUploadTokens = (unsigned long long) gLogUploadBurstSize * 1000000;
+        }
+        tokens = gLogUploadTokens / 1000000;
+        if ((unsigned long long) size > tokens) {
+            size = (int) tokens;
+        }
+        if (size == 0) {
+            // Wait until there's at least a byte's worth
+            *pWaitMs = (int) ((1000000 - gLogUploadTokens) / gLogUploadBytesPerSecond / 1000) + 1;
+        }
+        gLogUploadRateMutex.unlock();
+    }
+
+    return size;
+}
+
+// Take the number of bytes sent out of the token bucket.
+static void useLogUploadAllowance(int size)
+{
+    if ((gLogUploadBytesPerSecond > 0) && (size > 0)) {
+        gLogUploadRateMutex.lock();
+        if (gLogUploadTokens > (unsigned long long) size * 1000000) {
+            gLogUploadTokens -= (unsigned long long) size * 1000000;
+        } else {
+            gLogUploadTokens = 0;
+        }
+        gLogUploadRateMutex.unlock();
+    }
+}
+
+// Log the rate at which a log file was uploaded, given the
+// number of bytes sent and the time it took.
+void LogInstance::logLogUploadRate(unsigned int bytes, int timeUs)
+{
+    if (timeUs > 0) {
+        LOG(EVENT_LOG_FILE_UPLOAD_RATE, (int) ((unsigned long long) bytes * 1000000 / timeUs));
+    }
+}
+
+// Wait for the given time, returning false early if log file
+// upload has been asked to stop.
+bool LogInstance::waitLogUpload(int waitMs)
+{
+    Timer timer;
+    int x;
+
+    timer.start();
+    while (!_logUploadStop && ((x = waitMs - timer.read_ms()) > 0)) {
+        if (x > LOGGING_UPLOAD_STOP_POLL_MS) {
+            x = LOGGING_UPLOAD_STOP_POLL_MS;
+        }
+        wait_ms(x);
+    }
+
+    return !_logUploadStop;
+}
+
+// Return true if what is sending, the live log stream pStream
+// or, if that is NULL, log file upload, has been asked to stop.
+bool LogInstance::logSendIsStopped(LogStream *pStream)
+{
+    return (pStream != NULL) ? pStream->stop : _logUploadStop;
+}
+
+// Wait for the given time while sending for the live log stream
+// pStream or, if that is NULL, for log file upload, returning
+// false early if it has been asked to stop.
+bool LogInstance::waitLogSend(int waitMs, LogStream *pStream)
+{
+    if (pStream != NULL) {
+        if (!pStream->stop) {
+            pStream->pStop->wait(waitMs);
+        }
+    } else {
+        waitLogUpload(waitMs);
+    }
+
+    return !logSendIsStopped(pStream);
+}
+
+// Send a buffer of data over the log upload socket or, if
+// pStream isn't NULL, the TCP socket of that live log stream,
+// keeping to the rate limit, returning false if the connection
+// has failed or the sending has been asked to stop.
+bool LogInstance::sendLogUploadData(TCPSocket *pTcpSock, const char *pData, int size,
+                                    LogStream *pStream)
+{
+    int sendCount = 0;
+    int retries = 0;
+    int allowance;
+    int waitMs;
+    int x;
+
+    while ((sendCount < size) && (retries < LOGGING_MAX_SEND_RETRIES)) {
+        allowance = getLogUploadAllowance(size - sendCount, &waitMs);
+        if (allowance == 0) {
+            if (!waitLogSend(waitMs, pStream)) {
+                retries = LOGGING_MAX_SEND_RETRIES;
+            }
+        } else {
+            x = pTcpSock->send(pData + sendCount, allowance);
+            useLogUploadAllowance(x);
+            if (x > 0) {
+                sendCount += x;
+                retries = 0;
+            } else if ((x == 0) || (x == NSAPI_ERROR_WOULD_BLOCK)) {
+                // Timed out: try again, but not forever and
+                // not at all if asked to stop
+                retries++;
+                LOG(EVENT_TCP_SEND_TIMEOUT, retries);
+                if (logSendIsStopped(pStream)) {
+                    retries = LOGGING_MAX_SEND_RETRIES;
+                }
+            } else {
+                LOG(EVENT_SEND_FAILURE, x);
+                retries = LOGGING_MAX_SEND_RETRIES;
+            }
+        }
+    }
+
+    return (sendCount == size);
+}
+
+// Receive exactly size bytes over the log upload socket,
+// returning false if the connection has failed.
+static bool receiveLogUploadData(TCPSocket *pTcpSock, char *pData, int size)
+{
+    int receiveCount = 0;
+    int x = 1;
+
+    // Note: the socket timeout applies to each recv() so
+    // there is no need to retry
+    while ((receiveCount < size) && (x > 0)) {
+        x = pTcpSock->recv(pData + receiveCount, size - receiveCount);
+        if (x > 0) {
+            receiveCount += x;
+        }
+    }
+
+    return (receiveCount == size);
+}
+
+// Receive an acknowledgement from the logging server for a
+// log file, returning false if there wasn't a valid one.
+static bool receiveLogUploadAck(TCPSocket *pTcpSock, const char *pName,
+                                char *pBuffer, unsigned int *pOffset)
+{
+    LogFrame frame;
+    int lenName;
+    bool success = false;
+
+    if (receiveLogUploadData(pTcpSock, pBuffer, LOG_PROTOCOL_HEADER_SIZE)) {
+        lenName = logFrameDecodeHeader(pBuffer, &frame);
+        if ((lenName >= 0) && receiveLogUploadData(pTcpSock, pBuffer, lenName)) {
+            logFrameDecodeName(pBuffer, lenName, &frame);
+            if ((frame.type == LOG_FRAME_ACK) && (strcmp(frame.name, pName) == 0)) {
+                *pOffset = frame.size;
+                success = true;
+            }
+        }
+    }
+
+    return success;
+}
+
+// Read the upload progress of an open log file from its
+// progress file or, if there isn't one, make a start from the
+// size and CRC32 recorded in the upload manifest when the log
+// file was closed, returning false if neither is to be had
+// or the log file has changed since.
+static bool readLogUploadProgress(FILE *pFile, const char *pPath,
+                                  const LogUploadPlanFile *pPlanFile,
+                                  LogUploadProgress *pProgress)
+{
+    char progressPath[LOGGING_MAX_LEN_FILE_PATH + 1];
+    FILE *pProgressFile;
+    unsigned int size;
+    bool success = false;
+
+    fseek(pFile, 0, SEEK_END);
+    size = ftell(pFile);
+    rewind(pFile);
+
+    strcpy(progressPath, pPath);
+    setFileNameExtension(progressPath, LOGGING_PROGRESS_FILE_EXTENSION);
+    pProgressFile = fopen(progressPath, "rb");
+    if (pProgressFile != NULL) {
+        success = (fread(pProgress, sizeof(*pProgress), 1, pProgressFile) == 1) &&
+                  (pProgress->size == size);
+        fclose(pProgressFile);
+    }
+    if (!success && ((pPlanFile->flags & LOGGING_MANIFEST_FLAG_CLOSED) != 0) &&
+        (pPlanFile->size == size)) {
+        pProgress->size = size;
+        pProgress->crc = pPlanFile->crc;
+        pProgress->offset = 0;
+        success = true;
+    }
+
+    return success;
+}
+
+// Get the upload progress of an open log file, working out
+// the size and CRC32 of the log file afresh if it wasn't closed
+// properly (e.g. because of a reset) and there is no progress
+// file, or the log file has changed since.
+static void getLogUploadProgress(FILE *pFile, const char *pPath,
+                                 const LogUploadPlanFile *pPlanFile,
+                                 char *pReadBuffer, LogUploadProgress *pProgress)
+{
+    int x;
+
+    if (!readLogUploadProgress(pFile, pPath, pPlanFile, pProgress)) {
+        pProgress->size = 0;
+        pProgress->crc = 0;
+        pProgress->offset = 0;
+        do {
+            x = fread(pReadBuffer, 1, LOGGING_UPLOAD_BUFFER_SIZE, pFile);
+            if (x > 0) {
+                pProgress->crc = logCrc32(pProgress->crc, pReadBuffer, x);
+                pProgress->size += x;
+            }
+        } while (x > 0);
+        rewind(pFile);
+    }
+}
+
+// Write the upload progress of a log file to its progress file.
+static void writeLogUploadProgress(const char *pPath, const LogUploadProgress *pProgress)
+{
+    char progressPath[LOGGING_MAX_LEN_FILE_PATH + 1];
+    FILE *pProgressFile;
+
+    strcpy(progressPath, pPath);
+    setFileNameExtension(progressPath, LOGGING_PROGRESS_FILE_EXTENSION);
+    pProgressFile = fopen(progressPath, "wb");
+    if (pProgressFile != NULL) {
+        fwrite(pProgress, sizeof(*pProgress), 1, pProgressFile);
+        fclose(pProgressFile);
+    }
+}
+
+// The reader stage of the log file upload pipeline: waits to be
+// given a log file then reads it into the ring of buffers until
+// the end of the file, which is marked with an empty buffer.
+static void logUploadReaderCallback(LogUploadPipeline *pPipeline)
+{
+    LogUploadBuffer *pBuffer;
+
+    pPipeline->pStart->wait();
+    while (pPipeline->pFile != NULL) {
+        do {
+            pPipeline->pEmpty->wait();
+            pBuffer = &(pPipeline->buffers[pPipeline->readIndex]);
+            if (pPipeline->abort) {
+                pBuffer->size = -1;
+            } else {
+                pBuffer->size = fread(pBuffer->pData, 1, LOGGING_UPLOAD_BUFFER_SIZE,
+                                      pPipeline->pFile);
+                if ((pBuffer->size == 0) && ferror(pPipeline->pFile)) {
+                    pBuffer->size = -1;
+                }
+            }
+            pPipeline->readIndex++;
+            if (pPipeline->readIndex >= LOGGING_UPLOAD_NUM_BUFFERS) {
+                pPipeline->readIndex = 0;
+            }
+            pPipeline->pFull->release();
+        } while (pBuffer->size > 0);
+        pPipeline->pStart->wait();
+    }
+}
+
+// Create the log file upload pipeline of the log upload worker
+// with the given index and start its reader stage.
+LogUploadPipeline *LogInstance::newLogUploadPipeline(int index)
+{
+    LogUploadPipeline *pPipeline = LOGGING_NEW(&(_logUploadPipelineStore[index])) LogUploadPipeline();
+
+    // index only picks the static storage to use
+    (void) index;
+    for (int x = 0; x < LOGGING_UPLOAD_NUM_BUFFERS; x++) {
+        pPipeline->buffers[x].pData = LOGGING_NEW_ARRAY(_logUploadBufferStore[index][x],
+                                                        char, LOGGING_UPLOAD_BUFFER_SIZE);
+        pPipeline->buffers[x].size = 0;
+    }
+    pPipeline->pFile = NULL;
+    pPipeline->abort = false;
+    pPipeline->readIndex = 0;
+    pPipeline->sendIndex = 0;
+    pPipeline->pStart = LOGGING_NEW(_logUploadSemaphoreStore[index][0]) Semaphore(0);
+    pPipeline->pFull = LOGGING_NEW(_logUploadSemaphoreStore[index][1]) Semaphore(0);
+    pPipeline->pEmpty = LOGGING_NEW(_logUploadSemaphoreStore[index][2]) Semaphore(LOGGING_UPLOAD_NUM_BUFFERS);
+    pPipeline->pReaderThread = LOGGING_NEW(_logUploadReaderThreadStore[index])
+                               Thread(osPriorityNormal, LOGGING_UPLOAD_READER_STACK_SIZE,
+                                      LOGGING_STACK(_logUploadReaderStackStore[index]));
+    if (pPipeline->pReaderThread->start(callback(logUploadReaderCallback, pPipeline)) != osOK) {
+        LOGGING_DELETE(Thread, pPipeline->pReaderThread);
+        pPipeline->pReaderThread = NULL;
+    }
+
+    return pPipeline;
+}
+
+// Free the log file upload pipeline, ending its reader stage
+// (which must be waiting for a log file) if it is running.
+static void deleteLogUploadPipeline(LogUploadPipeline *pPipeline)
+{
+    if (pPipeline->pReaderThread != NULL) {
+        pPipeline->pFile = NULL;
+        pPipeline->pStart->release();
+        pPipeline->pReaderThread->join();
+        LOGGING_DELETE(Thread, pPipeline->pReaderThread);
+    }
+    LOGGING_DELETE(Semaphore, pPipeline->pStart);
+    LOGGING_DELETE(Semaphore, pPipeline->pFull);
+    LOGGING_DELETE(Semaphore, pPipeline->pEmpty);
+    for (int x = 0; x < LOGGING_UPLOAD_NUM_BUFFERS; x++) {
+        LOGGING_DELETE_ARRAY(pPipeline->buffers[x].pData);
+    }
+    LOGGING_DELETE(LogUploadPipeline, pPipeline);
+}
+
+// Upload an open log file over a connected socket, returning
+// true if the logging server has all of it; with the legacy
+// protocol that can only mean that the whole file was sent.
+// If the connection fails *pConnected is set to false.
+bool LogInstance::uploadLogFile(TCPSocket *pTcpSock, LogUploadPipeline *pPipeline,
+                                FILE *pFile, const char *pPath,
+                                const LogUploadPlanFile *pPlanFile, bool *pConnected)
+{
+    const char *pName = pPlanFile->name;
+    LogFrame frame;
+    LogUploadProgress progress;
+    LogUploadBuffer *pBuffer;
+    char frameBuffer[LOG_PROTOCOL_MAX_FRAME_SIZE];
+    unsigned int offset = 0;
+    unsigned int startOffset;
+    Timer timer;
+    int size;
+    bool success = true;
+
+    timer.start();
+
+    if (_logUploadProtocol == LOG_UPLOAD_PROTOCOL_FRAMED) {
+        // Send the header telling the server which file this is,
+        // to which it replies with how much of it it already has:
+        // all of it if the log file was uploaded before but not
+        // deleted, in which case none of it need be sent again
+        // Note: the reader stage is idle so its buffers can be used
+        getLogUploadProgress(pFile, pPath, pPlanFile, pPipeline->buffers[0].pData, &progress);
+        frame.type = LOG_FRAME_FILE;
+        frame.deviceId = _logUploadDeviceId;
+        frame.size = progress.size;
+        frame.crc = progress.crc;
+        strncpy(frame.name, pName, sizeof(frame.name) - 1);
+        frame.name[sizeof(frame.name) - 1] = 0;
+        size = logFrameEncode(&frame, frameBuffer);
+        success = sendLogUploadData(pTcpSock, frameBuffer, size, NULL) &&
+                  receiveLogUploadAck(pTcpSock, pName, frameBuffer, &offset) &&
+                  (offset <= progress.size) &&
+                  (fseek(pFile, offset, SEEK_SET) == 0);
+        if (success && (offset > 0)) {
+            LOG(EVENT_LOG_FILE_BYTE_COUNT, offset);
+            if (offset == progress.size) {
+                LOG(EVENT_LOG_FILE_ALREADY_UPLOADED, offset);
+            }
+        }
+    }
+
+    startOffset = offset;
+    timer.reset();
+    if (success) {
+        if (pPipeline->pReaderThread != NULL) {
+            // Hand the file to the reader stage and send what it
+            // reads until it marks the end of the file; if sending
+            // fails, tell it to stop and wait for it to do so
+            pPipeline->pFile = pFile;
+            pPipeline->abort = false;
+            pPipeline->pStart->release();
+            do {
+                pPipeline->pFull->wait();
+                pBuffer = &(pPipeline->buffers[pPipeline->sendIndex]);
+                pPipeline->sendIndex++;
+                if (pPipeline->sendIndex >= LOGGING_UPLOAD_NUM_BUFFERS) {
+                    pPipeline->sendIndex = 0;
+                }
+                size = pBuffer->size;
+                if ((size > 0) && success) {
+                    success = !_logUploadStop &&
+                              sendLogUploadData(pTcpSock, pBuffer->pData, size, NULL);
+                    if (success) {
+                        offset += size;
+                        LOG(EVENT_LOG_FILE_BYTE_COUNT, offset);
+                    }
+                    pPipeline->abort = !success;
+                }
+                pPipeline->pEmpty->release();
+            } while (size > 0);
+        } else {
+            // No reader stage, do it all here
+            pBuffer = &(pPipeline->buffers[0]);
+            while (success && ((size = fread(pBuffer->pData, 1, LOGGING_UPLOAD_BUFFER_SIZE, pFile)) > 0)) {
+                success = !_logUploadStop &&
+                          sendLogUploadData(pTcpSock, pBuffer->pData, size, NULL);
+                if (success) {
+                    offset += size;
+                    LOG(EVENT_LOG_FILE_BYTE_COUNT, offset);
+                }
+            }
+            if (ferror(pFile)) {
+                size = -1;
+            }
+        }
+        success = success && (size == 0);
+        logLogUploadRate(offset - startOffset, timer.read_us());
+    }
+
+    if (_logUploadProtocol == LOG_UPLOAD_PROTOCOL_FRAMED) {
+        // The logging server acknowledges the whole file once it
+        // has checked the CRC, or 0 if the check failed
+        if (success && receiveLogUploadAck(pTcpSock, pName, frameBuffer, &offset)) {
+            progress.offset = offset;
+            writeLogUploadProgress(pPath, &progress);
+            success = (offset == progress.size);
+        } else {
+            // There's no way to get back in step with the
+            // logging server now
+            success = false;
+            *pConnected = false;
+        }
+    } else if (!success) {
+        *pConnected = false;
+    }
+
+    return success;
+}
+
+// Tell the logging server that the framed upload session, or
+// the live log stream pStream if it isn't NULL, is over.
+void LogInstance::endLogUpload(TCPSocket *pTcpSock, LogStream *pStream)
+{
+    LogFrame frame;
+    char frameBuffer[LOG_PROTOCOL_MAX_FRAME_SIZE];
+
+    memset(&frame, 0, sizeof(frame));
+    frame.type = LOG_FRAME_END;
+    sendLogUploadData(pTcpSock, frameBuffer, logFrameEncode(&frame, frameBuffer), pStream);
+}
+
+// Remove a log file which has been uploaded, along with
+// its index and progress files; pPath is overwritten.
+void LogInstance::removeLogFile(char *pPath)
+{
+    if (remove(pPath) == 0) {
+        LOG(EVENT_FILE_DELETED, 0);
+        setFileNameExtension(pPath, LOG_INDEX_FILE_EXTENSION);
+        remove(pPath);
+        setFileNameExtension(pPath, LOGGING_PROGRESS_FILE_EXTENSION);
+        remove(pPath);
+    } else {
+        LOG(EVENT_FILE_DELETE_FAILURE, 0);
+    }
+}
+
+// Work out whether a log file may contain a severe event (one
+// whose string starts with "*"), using the bloom filters in its
+// index file rather than reading the log file itself; a log
+// file with no index file is assumed not to.
+static bool logFileMayBeSevere(const char *pPath)
+{
+    char indexPath[LOGGING_MAX_LEN_FILE_PATH + 1];
+    LogIndexBlock block;
+    FILE *pIndexFile;
+    int numBlocks;
+    bool severe = false;
+
+    strcpy(indexPath, pPath);
+    setFileNameExtension(indexPath, LOG_INDEX_FILE_EXTENSION);
+    pIndexFile = fopen(indexPath, "r");
+    if (pIndexFile != NULL) {
+        numBlocks = logIndexNumBlocks(pIndexFile);
+        for (int x = 0; (x < numBlocks) && !severe; x++) {
+            if (logIndexReadBlock(pIndexFile, x, &block)) {
+                for (int y = 0; (y < gNumLogStrings) && !severe; y++) {
+                    severe = (gLogStrings[y][0] == '*') && logIndexBlockMayContain(&block, y);
+                }
+            }
+        }
+        fclose(pIndexFile);
+    }
+
+    return severe;
+}
+
+// Compare two log files in the upload plan for qsort(),
+// according to gLogUploadSortOrder; ties go to the newest
+// log file.
+static int compareLogUploadPlanFiles(const void *p1, const void *p2)
+{
+    const LogUploadPlanFile *pFile1 = (const LogUploadPlanFile *) p1;
+    const LogUploadPlanFile *pFile2 = (const LogUploadPlanFile *) p2;
+    int result = 0;
+
+    switch (gLogUploadSortOrder) {
+        case LOG_UPLOAD_ORDER_SEVERE_FIRST:
+            result = (int) pFile2->severe - (int) pFile1->severe;
+        break;
+        case LOG_UPLOAD_ORDER_SMALLEST_FIRST:
+            if (pFile1->size != pFile2->size) {
+                result = (pFile1->size < pFile2->size) ? -1 : 1;
+            }
+        break;
+        default:
+        break;
+    }
+
+    if (result == 0) {
+        result = pFile2->sequence - pFile1->sequence;
+    }
+
+    return result;
+}
+
+// Build the plan of log files to upload from the upload
+// manifest, returning the number of log files in it, or -1
+// if there is no manifest and the log directory can't be read.
+// Only the metadata needed by the upload order, and not
+// already in the manifest, is collected.
+int LogInstance::buildLogUploadPlan(LogUploadPlanFile **ppPlan)
+{
+    LogManifestRecord *pRecords = NULL;
+    LogUploadPlanFile *pPlan = NULL;
+    LogUploadPlanFile *pFile;
+    char fileNameBuffer[LOGGING_MAX_LEN_FILE_PATH + 1];
+    FILE *pLogFile;
+    int numRecords;
+    int numFiles = -1;
+
+    _logManifestMutex.lock();
+    numRecords = loadLogManifest(&pRecords);
+    if (numRecords >= 0) {
+        numFiles = 0;
+        if (numRecords > 0) {
+            pPlan = LOGGING_NEW_ARRAY(_logUploadPlanStore, LogUploadPlanFile, numRecords);
+        }
+        for (int x = 0; x < numRecords; x++) {
+            // Leave out the log file we're currently logging to
+            if (((pRecords[x].flags & LOGGING_MANIFEST_FLAGS_GONE) == 0) &&
+                (pRecords[x].sequence != _currentLogFileSequence)) {
+                pFile = &(pPlan[numFiles]);
+                sprintf(pFile->name, "%04d" LOGGING_FILE_EXTENSION,
+                        pRecords[x].sequence % LOGGING_NUM_FILE_NAMES);
+                pFile->sequence = pRecords[x].sequence;
+                pFile->manifestIndex = x;
+                pFile->flags = pRecords[x].flags;
+                pFile->size = pRecords[x].size;
+                pFile->crc = pRecords[x].crc;
+                pFile->severe = ((pRecords[x].flags & LOGGING_MANIFEST_FLAG_SEVERE) != 0);
+                if ((pRecords[x].flags & LOGGING_MANIFEST_FLAG_CLOSED) == 0) {
+                    getLogPath(fileNameBuffer, pFile->name);
+                    if (_logUploadOrder == LOG_UPLOAD_ORDER_SMALLEST_FIRST) {
+                        pLogFile = fopen(fileNameBuffer, "r");
+                        if (pLogFile != NULL) {
+                            fseek(pLogFile, 0, SEEK_END);
+                            pFile->size = ftell(pLogFile);
+                            fclose(pLogFile);
+                        }
+                    } else if (_logUploadOrder == LOG_UPLOAD_ORDER_SEVERE_FIRST) {
+                        pFile->severe = logFileMayBeSevere(fileNameBuffer);
+                    }
+                }
+                numFiles++;
+            }
+        }
+        LOGGING_DELETE_ARRAY(pRecords);
+    }
+    _logManifestMutex.unlock();
+
+    if ((numFiles > 1) && (_logUploadOrder != LOG_UPLOAD_ORDER_OLDEST_FIRST)) {
+        gLogUploadSortMutex.lock();
+        gLogUploadSortOrder = _logUploadOrder;
+        qsort(pPlan, numFiles, sizeof(LogUploadPlanFile), compareLogUploadPlanFiles);
+        gLogUploadSortMutex.unlock();
+    }
+    *ppPlan = pPlan;
+
+    return numFiles;
+}
+
+// Return true if log file upload has given up on the connection
+// to the logging server and LOGGING_UPLOAD_BACK_OFF_SECONDS have
+// yet to pass.
+// Note: log upload file mutex must be locked before calling.
+bool LogInstance::logUploadIsBackingOff()
+{
+    if (_logUploadBackingOff &&
+        (_logUploadBackOffTimer.read_high_resolution_us() >=
+         (unsigned long long) LOGGING_UPLOAD_BACK_OFF_SECONDS * 1000000)) {
+        _logUploadBackingOff = false;
+    }
+
+    return _logUploadBackingOff;
+}
+
+// Seed the pseudo-random sequence from which retry delays are
+// jittered, if it hasn't been already, from the MAC address of
+// the network interface and the device ID of the framed protocol,
+// which between them should differ from one device to the next;
+// the time since the log began is thrown in for devices which
+// have neither.
+// Note: log upload file mutex must be locked before calling.
+void LogInstance::seedLogUploadRandom(NetworkInterface *pNetworkInterface)
+{
+    const char *pMacAddress;
+    unsigned int seed;
+
+    if (_logUploadRandom == 0) {
+        seed = _logUploadDeviceId ^ (unsigned int) _logTime.read_us();
+        pMacAddress = pNetworkInterface->get_mac_address();
+        if (pMacAddress != NULL) {
+            seed = logCrc32(seed, pMacAddress, (int) strlen(pMacAddress));
+        }
+        if (seed == 0) {
+            // The sequence never leaves 0
+            seed = 1;
+        }
+        _logUploadRandom = seed;
+    }
+}
+
+// Get how long to wait before trying a log file again after
+// the given number of failed attempts: the delay doubles with
+// each attempt, less a random amount of up to half of it, taken
+// from a xorshift sequence seeded by seedLogUploadRandom().
+// Note: log upload file mutex must be locked before calling.
+int LogInstance::getLogUploadRetryDelayMs(int attempts)
+{
+    int delayMs = LOGGING_UPLOAD_RETRY_BASE_MS;
+
+    while ((attempts > 1) && (delayMs < LOGGING_UPLOAD_RETRY_MAX_MS)) {
+        delayMs *= 2;
+        attempts--;
+    }
+    if (delayMs > LOGGING_UPLOAD_RETRY_MAX_MS) {
+        delayMs = LOGGING_UPLOAD_RETRY_MAX_MS;
+    }
+
+    _logUploadRandom ^= _logUploadRandom << 13;
+    _logUploadRandom ^= _logUploadRandom >> 17;
+    _logUploadRandom ^= _logUploadRandom << 5;
+
+    return delayMs - (int) (_logUploadRandom % (delayMs / 2 + 1));
+}
+
+// Record that an attempt at uploading a log file has failed,
+// *pAttempts counting the attempts made at it, returning true
+// if it should be tried again after *pDelayMs.  If it was the
+// connection to the logging server that failed, and it has done
+// so LOGGING_UPLOAD_MAX_FAILURES times in a row, log file upload
+// gives up on it for LOGGING_UPLOAD_BACK_OFF_SECONDS.
+bool LogInstance::logUploadAttemptFailed(int *pAttempts, bool connectionFailed, int *pDelayMs)
+{
+    bool retry;
+
+    (*pAttempts)++;
+    _logUploadFileMutex.lock();
+    if (connectionFailed) {
+        _logUploadNumFailures++;
+        if ((_logUploadNumFailures >= LOGGING_UPLOAD_MAX_FAILURES) &&
+            !logUploadIsBackingOff()) {
+            LOG(EVENT_SOCKET_ERRORS_FOR_TOO_LONG, _logUploadNumFailures);
+            _logUploadBackingOff = true;
+            _logUploadBackOffTimer.reset();
+            _logUploadBackOffTimer.start();
+        }
+    }
+    retry = !logUploadIsBackingOff() && (*pAttempts < LOGGING_UPLOAD_MAX_FILE_ATTEMPTS);
+    if (retry) {
+        *pDelayMs = getLogUploadRetryDelayMs(*pAttempts);
+    }
+    _logUploadFileMutex.unlock();
+
+    return retry;
+}
+
+// Get the next log file to upload, returning NULL if there
+// are none left, log file upload has given up on the
+// connection to the logging server or it has been asked to
+// stop; may be called by any number of log upload workers
+// at once.
+LogUploadPlanFile *LogInstance::getNextLogFileToUpload(int *pFileNumber)
+{
+    LogUploadPlanFile *pFile = NULL;
+
+    _logUploadFileMutex.lock();
+    if ((_pLogFileUploadData->numFiles < _pLogFileUploadData->numPlanFiles) &&
+        !logUploadIsBackingOff() && !_logUploadStop) {
+        pFile = &(_pLogFileUploadData->pPlan[_pLogFileUploadData->numFiles]);
+        _pLogFileUploadData->numFiles++;
+        *pFileNumber = _pLogFileUploadData->numFiles;
+    }
+    _logUploadFileMutex.unlock();
+
+    return pFile;
+}
+
+// Record that a log file has been uploaded, deleting it; it is
+// marked as uploaded in the upload manifest first so that, if
+// power fails in between, it is not uploaded again.
+void LogInstance::logFileUploaded(LogUploadPlanFile *pFile, char *pPath, int fileNumber)
+{
+    LogManifestRecord record;
+
+    LOG(EVENT_LOG_FILE_UPLOAD_COMPLETED, fileNumber);
+    record.sequence = pFile->sequence;
+    record.flags = pFile->flags | LOGGING_MANIFEST_FLAG_UPLOADED;
+    record.size = pFile->size;
+    record.crc = pFile->crc;
+    _logManifestMutex.lock();
+    updateLogManifestRecord(pFile->manifestIndex, &record);
+    _logManifestMutex.unlock();
+    removeLogFile(pPath);
+    _logUploadFileMutex.lock();
+    _pLogFileUploadData->numUploaded++;
+    _logUploadNumFailures = 0;
+    _logUploadFileMutex.unlock();
+}
+
+// Create a TCP socket for log file upload.
+TCPSocket *LogInstance::newLogUploadSocket()
+{
+    TCPSocket *pTcpSock = NULL;
+
+#ifdef LOG_STATIC_ALLOCATION
+    _logUploadFileMutex.lock();
+    for (int x = 0; (x < LOGGING_UPLOAD_MAX_CONNECTIONS + 1) && (pTcpSock == NULL); x++) {
+        if (!_logUploadSocketInUse[x]) {
+            _logUploadSocketInUse[x] = true;
+            pTcpSock = new (_logUploadSocketStore[x]) TCPSocket();
+        }
+    }
+    _logUploadFileMutex.unlock();
+    MBED_ASSERT(pTcpSock != NULL);
+#else
+    pTcpSock = new TCPSocket();
+#endif
+
+    return pTcpSock;
+}
+
+// Free a TCP socket of log file upload.
+void LogInstance::deleteLogUploadSocket(TCPSocket *pTcpSock)
+{
+#ifdef LOG_STATIC_ALLOCATION
+    if (pTcpSock != NULL) {
+        pTcpSock->~TCPSocket();
+        _logUploadFileMutex.lock();
+        for (int x = 0; x < LOGGING_UPLOAD_MAX_CONNECTIONS + 1; x++) {
+            if ((void *) pTcpSock == (void *) _logUploadSocketStore[x]) {
+                _logUploadSocketInUse[x] = false;
+            }
+        }
+        _logUploadFileMutex.unlock();
+    }
+#else
+    delete pTcpSock;
+#endif
+}
+
+// Close the connection kept open after the last log file upload.
+void LogInstance::closeLogUploadWarmSocket()
+{
+    if (_pLogUploadWarmSocket != NULL) {
+        endLogUpload(_pLogUploadWarmSocket, NULL);
+        _pLogUploadWarmSocket->close();
+        deleteLogUploadSocket(_pLogUploadWarmSocket);
+        _pLogUploadWarmSocket = NULL;
+    }
+}
+
+// Take the connection kept open after the last log file upload,
+// if it is to the same logging server and hasn't been idle for
+// longer than LOGGING_UPLOAD_WARM_CONNECTION_SECONDS, returning
+// NULL if there isn't one to take.
+TCPSocket *LogInstance::takeLogUploadWarmSocket()
+{
+    TCPSocket *pTcpSock = NULL;
+
+    _logUploadFileMutex.lock();
+    if ((_pLogUploadWarmSocket != NULL) &&
+        (strcmp(_logUploadWarmSocketUrl, _loggingServerUrl) == 0) &&
+        (_logUploadWarmSocketTimer.read_high_resolution_us() <
+         (unsigned long long) LOGGING_UPLOAD_WARM_CONNECTION_SECONDS * 1000000)) {
+        pTcpSock = _pLogUploadWarmSocket;
+        _pLogUploadWarmSocket = NULL;
+    } else {
+        closeLogUploadWarmSocket();
+    }
+    _logUploadFileMutex.unlock();
+
+    return pTcpSock;
+}
+
+// Keep the connection of a log upload worker open, with the
+// framed protocol, for the next log file upload to use, returning
+// false if it isn't kept, in which case it should be closed.
+bool LogInstance::keepLogUploadWarmSocket(LogUploadWorker *pWorker)
+{
+    bool kept = false;
+
+    _logUploadFileMutex.lock();
+    if ((LOGGING_UPLOAD_WARM_CONNECTION_SECONDS > 0) &&
+        (_logUploadProtocol == LOG_UPLOAD_PROTOCOL_FRAMED) &&
+        (_pLogUploadWarmSocket == NULL)) {
+        _pLogUploadWarmSocket = pWorker->pTcpSock;
+        pWorker->pTcpSock = NULL;
+        strcpy(_logUploadWarmSocketUrl, _loggingServerUrl);
+        _logUploadWarmSocketTimer.reset();
+        _logUploadWarmSocketTimer.start();
+        kept = true;
+    }
+    _logUploadFileMutex.unlock();
+
+    return kept;
+}
+
+// Run a log upload worker in a thread of its own.
+static void runLogUploadWorker(LogUploadWorker *pWorker)
+{
+    pWorker->pInstance->logUploadWorkerCallback(pWorker);
+}
+
+// A log upload worker: uploads log files, one after the other,
+// over a connection of its own until there are none left.
+void LogInstance::logUploadWorkerCallback(LogUploadWorker *pWorker)
+{
+    LogUploadPlanFile *pPlanFile;
+    int fileNumber;
+    int attempts;
+    int delayMs;
+    bool connected = pWorker->warm;
+    bool warm = pWorker->warm;
+    bool uploaded;
+    bool retry;
+    bool connectionFailed;
+    FILE *pFile = NULL;
+    char fileNameBuffer[LOGGING_MAX_LEN_FILE_PATH + 1];
+
+    // Send the log files: with the legacy protocol a
+    // different TCP connection is used for each one so that
+    // the logging server stores them in separate files,
+    // with the framed protocol they all go over one connection
+    while ((pPlanFile = getNextLogFileToUpload(&fileNumber)) != NULL) {
+        getLogPath(fileNameBuffer, pPlanFile->name);
+        attempts = 0;
+        do {
+            uploaded = false;
+            retry = true;
+            connectionFailed = true;
+            if (!connected) {
+                connected = openLogUploadSocket(pWorker->pTcpSock,
+                                                _pLogFileUploadData->pNetworkInterface,
+                                                &_loggingServer, fileNumber);
+                if (!connected) {
+                    forgetLoggingServerAddress(_loggingServerUrl);
+                }
+            }
+            if (connected) {
+                LOG(EVENT_LOG_UPLOAD_STARTING, fileNumber);
+                pFile = fopen(fileNameBuffer, "r");
+                if (pFile != NULL) {
+                    LOG(EVENT_LOG_FILE_OPEN, 0);
+                    uploaded = uploadLogFile(pWorker->pTcpSock, pWorker->pPipeline,
+                                             pFile, fileNameBuffer, pPlanFile, &connected);
+                    if (!uploaded && !connected && warm) {
+                        // The connection kept from the last upload may
+                        // have been closed by the logging server while
+                        // idle, so try again over a new one
+                        pWorker->pTcpSock->close();
+                        connected = openLogUploadSocket(pWorker->pTcpSock,
+                                                        _pLogFileUploadData->pNetworkInterface,
+                                                        &_loggingServer, fileNumber);
+                        if (connected) {
+                            uploaded = uploadLogFile(pWorker->pTcpSock, pWorker->pPipeline,
+                                                     pFile, fileNameBuffer, pPlanFile,
+                                                     &connected);
+                        }
+                    }
+                    LOG(EVENT_LOG_FILE_CLOSE, 0);
+                    fclose(pFile);
+                    // If the upload succeeded, delete the file
+                    if (uploaded) {
+                        logFileUploaded(pPlanFile, fileNameBuffer, fileNumber);
+                    }
+                } else {
+                    // Trying again won't help
+                    LOG(EVENT_LOG_FILE_OPEN_FAILURE, 0);
+                    retry = false;
+                }
+                warm = false;
+                connectionFailed = !connected;
+
+                // With the legacy protocol the end of the
+                // connection marks the end of the file; if the
+                // connection has failed, try a new one
+                if ((_logUploadProtocol == LOG_UPLOAD_PROTOCOL_LEGACY) || !connected) {
+                    pWorker->pTcpSock->close();
+                    connected = false;
+                }
+            }
+
+            // If the upload failed, back off and try again, unless
+            // the log file has had its attempts, log file upload
+            // has given up on the logging server or it is to stop
+            // (in which case the failure is none of the logging
+            // server's doing)
+            retry = !uploaded && retry && !_logUploadStop &&
+                    logUploadAttemptFailed(&attempts, connectionFailed, &delayMs) &&
+                    waitLogUpload(delayMs);
+        } while (retry);
+    }
+
+    if (connected && !keepLogUploadWarmSocket(pWorker)) {
+        endLogUpload(pWorker->pTcpSock, NULL);
+        pWorker->pTcpSock->close();
+    }
+}
+
+// Free the log file upload data.
+void LogInstance::deleteLogFileUploadData()
+{
+    LOGGING_DELETE_ARRAY(_pLogFileUploadData->pPlan);
+    LOGGING_DELETE(LogFileUploadData, _pLogFileUploadData);
+    _pLogFileUploadData = NULL;
+}
+
+// Free a log upload worker, stopping its threads dead
+// if terminate is true, otherwise waiting for them.
+// Note: terminate is a last resort since a thread stopped
+// dead leaves behind whatever it had open.
+void LogInstance::deleteLogUploadWorker(LogUploadWorker *pWorker, bool terminate)
+{
+    if (pWorker->pThread != NULL) {
+        if (terminate) {
+            pWorker->pThread->terminate();
+        }
+        pWorker->pThread->join();
+        LOGGING_DELETE(Thread, pWorker->pThread);
+        pWorker->pThread = NULL;
+    }
+    if (pWorker->pPipeline != NULL) {
+        // If the worker was stopped dead the reader stage
+        // could be anywhere so it has to go the same way
+        if (terminate && (pWorker->pPipeline->pReaderThread != NULL)) {
+            pWorker->pPipeline->pReaderThread->terminate();
+            pWorker->pPipeline->pReaderThread->join();
+            LOGGING_DELETE(Thread, pWorker->pPipeline->pReaderThread);
+            pWorker->pPipeline->pReaderThread = NULL;
+        }
+        deleteLogUploadPipeline(pWorker->pPipeline);
+        pWorker->pPipeline = NULL;
+    }
+    deleteLogUploadSocket(pWorker->pTcpSock);
+    pWorker->pTcpSock = NULL;
+}
+
+// Free the log upload workers, stopping them dead if terminate
+// is true, otherwise waiting for them to finish.
+void LogInstance::deleteLogUploadWorkers(bool terminate)
+{
+    for (int x = 0; x < _pLogFileUploadData->numWorkers; x++) {
+        deleteLogUploadWorker(&(_pLogFileUploadData->workers[x]), terminate);
+    }
+    _pLogFileUploadData->numWorkers = 0;
+}
+
+// Function to sit in a thread and upload log files, starting
+// more threads to upload log files concurrently if required.
+void LogInstance::logFileUploadCallback()
+{
+    LogUploadWorker *pWorker;
+    int x;
+
+    MBED_ASSERT (_pLogFileUploadData != NULL);
+
+    // Set up the workers: the first is run by this thread,
+    // the others by threads of their own
+    for (x = 0; x < _logUploadNumConnections; x++) {
+        pWorker = &(_pLogFileUploadData->workers[x]);
+        // The first worker carries on with the connection kept
+        // from the last upload, if there is one
+        pWorker->pTcpSock = NULL;
+        if (x == 0) {
+            pWorker->pTcpSock = takeLogUploadWarmSocket();
+        }
+        pWorker->warm = (pWorker->pTcpSock != NULL);
+        if (!pWorker->warm) {
+            pWorker->pTcpSock = newLogUploadSocket();
+        }
+        pWorker->pPipeline = newLogUploadPipeline(x);
+        pWorker->pThread = NULL;
+        pWorker->pInstance = this;
+        _pLogFileUploadData->numWorkers++;
+        if (x > 0) {
+            pWorker->pThread = LOGGING_NEW(_logUploadThreadStore[x])
+                               Thread(osPriorityNormal, OS_STACK_SIZE,
+                                      LOGGING_STACK(_logUploadStackStore[x]));
+            if (pWorker->pThread->start(callback(runLogUploadWorker, pWorker)) != osOK) {
+                LOGGING_DELETE(Thread, pWorker->pThread);
+                pWorker->pThread = NULL;
+            }
+        }
+    }
+    logUploadWorkerCallback(&(_pLogFileUploadData->workers[0]));
+    deleteLogUploadWorkers(false);
+
+    LOG(EVENT_LOG_UPLOAD_TASK_COMPLETED, _pLogFileUploadData->numUploaded);
+    printf("[Log file upload background task has completed]\n");
+
+    // Clear up globals
+    deleteLogFileUploadData();
+}
+
+
+// Move the log upload state machine on, posting a step if one
+// isn't already pending; the step finds nothing to do if the
+// state machine has gone by the time it runs.
+void LogInstance::postLogUploadStep()
+{
+    EventQueue *pEventQueue = _pLogUploadEventQueue;
+
+    if (!_logUploadStepPending && (pEventQueue != NULL)) {
+        _logUploadStepPending = true;
+        pEventQueue->call(this, &LogInstance::logUploadStep);
+    }
+}
+
+// Called by the network stack when the log upload socket
+// may be able to make progress.
+// Note: this may be called from interrupt context, and while
+// stopLogFileUpload() is freeing the state machine, so it
+// must do no more than post to the event queue.
+void LogInstance::logUploadSigio()
+{
+    postLogUploadStep();
+}
+
+// Called periodically while the log upload state machine is
+// waiting for the socket, so that it can time out.
+void LogInstance::logUploadWatchdog()
+{
+    _logUploadMachineMutex.lock();
+    if ((_pLogFileUploadData != NULL) && (_pLogFileUploadData->pMachine != NULL)) {
+        _pLogFileUploadData->pMachine->watchdogId = 0;
+        runLogUploadStep();
+    }
+    _logUploadMachineMutex.unlock();
+}
+
+// Send what's left of the frame being sent by the log upload
+// state machine, returning LOG_UPLOAD_STEP_CONTINUE when it
+// has all gone.
+LogUploadStep LogInstance::sendLogUploadFrame(LogUploadMachine *pMachine)
+{
+    LogUploadStep step = LOG_UPLOAD_STEP_CONTINUE;
+    int x;
+
+    while ((pMachine->frameCount < pMachine->frameLength) &&
+           (step == LOG_UPLOAD_STEP_CONTINUE)) {
+        x = pMachine->pTcpSock->send(pMachine->frame + pMachine->frameCount,
+                                     pMachine->frameLength - pMachine->frameCount);
+        if (x > 0) {
+            pMachine->frameCount += x;
+        } else if ((x == 0) || (x == NSAPI_ERROR_WOULD_BLOCK)) {
+            step = LOG_UPLOAD_STEP_WAIT;
+        } else {
+            LOG(EVENT_SEND_FAILURE, x);
+            step = LOG_UPLOAD_STEP_FAIL;
+        }
+    }
+
+    return step;
+}
+
+// Receive what's left of an acknowledgement for the current log
+// file into the frame buffer of the log upload state machine,
+// returning LOG_UPLOAD_STEP_CONTINUE with the acknowledged offset
+// in pMachine->ackOffset once it has all arrived.
+static LogUploadStep receiveLogUploadFrame(LogUploadMachine *pMachine)
+{
+    LogUploadStep step = LOG_UPLOAD_STEP_CONTINUE;
+    LogFrame frame;
+    int lenName;
+    int x;
+
+    while ((pMachine->frameCount < pMachine->frameLength) &&
+           (step == LOG_UPLOAD_STEP_CONTINUE)) {
+        x = pMachine->pTcpSock->recv(pMachine->frame + pMachine->frameCount,
+                                     pMachine->frameLength - pMachine->frameCount);
+        if (x > 0) {
+            pMachine->frameCount += x;
+            if (pMachine->frameCount == LOG_PROTOCOL_HEADER_SIZE) {
+                // Now we know how long the name is
+                lenName = logFrameDecodeHeader(pMachine->frame, &frame);
+                if (lenName >= 0) {
+                    pMachine->frameLength += lenName;
+                } else {
+                    step = LOG_UPLOAD_STEP_FAIL;
+                }
+            }
+        } else if (x == NSAPI_ERROR_WOULD_BLOCK) {
+            step = LOG_UPLOAD_STEP_WAIT;
+        } else {
+            step = LOG_UPLOAD_STEP_FAIL;
+        }
+    }
+
+    if (step == LOG_UPLOAD_STEP_CONTINUE) {
+        lenName = logFrameDecodeHeader(pMachine->frame, &frame);
+        logFrameDecodeName(pMachine->frame + LOG_PROTOCOL_HEADER_SIZE, lenName, &frame);
+        if ((frame.type == LOG_FRAME_ACK) && (strcmp(frame.name, pMachine->name) == 0)) {
+            pMachine->ackOffset = frame.size;
+        } else {
+            step = LOG_UPLOAD_STEP_FAIL;
+        }
+    }
+
+    return step;
+}
+
+// Finish with the current log file in the log upload state
+// machine, deleting it if it has been uploaded, and move on
+// to the next one.
+void LogInstance::endLogUploadMachineFile(LogUploadMachine *pMachine, bool uploaded)
+{
+    if (pMachine->pFile != NULL) {
+        LOG(EVENT_LOG_FILE_CLOSE, 0);
+        fclose(pMachine->pFile);
+        pMachine->pFile = NULL;
+        if (uploaded) {
+            logFileUploaded(pMachine->pPlanFile, pMachine->path, pMachine->fileNumber);
+        }
+    }
+    // With the legacy protocol the end of the
+    // connection marks the end of the file
+    if (pMachine->connected &&
+        (_logUploadProtocol == LOG_UPLOAD_PROTOCOL_LEGACY)) {
+        pMachine->pTcpSock->close();
+        pMachine->connected = false;
+    }
+    pMachine->frameLength = 0;
+    pMachine->frameCount = 0;
+    pMachine->state = LOG_UPLOAD_STATE_NEXT_FILE;
+}
+
+// Back off before trying the current log file again, if
+// it should be, after an attempt at uploading it has failed.
+void LogInstance::retryLogUploadMachineFile(LogUploadMachine *pMachine, bool connectionFailed)
+{
+    if (logUploadAttemptFailed(&(pMachine->attempts), connectionFailed,
+                               &(pMachine->retryDelayMs))) {
+        pMachine->retryTimer.reset();
+        pMachine->state = LOG_UPLOAD_STATE_RETRY;
+    }
+}
+
+// Give up on the connection of the log upload state machine,
+// backing off before trying the current log file again.
+void LogInstance::failLogUploadMachine(LogUploadMachine *pMachine)
+{
+    pMachine->pTcpSock->close();
+    pMachine->connected = false;
+    pMachine->connecting = false;
+    endLogUploadMachineFile(pMachine, false);
+    retryLogUploadMachineFile(pMachine, true);
+}
+
+// Free the log upload state machine and everything it uses.
+void LogInstance::deleteLogUploadMachine(LogUploadMachine *pMachine)
+{
+    if (pMachine->watchdogId != 0) {
+        pMachine->pEventQueue->cancel(pMachine->watchdogId);
+    }
+    pMachine->pTcpSock->sigio(NULL);
+    pMachine->pTcpSock->close();
+    if (pMachine->pFile != NULL) {
+        fclose(pMachine->pFile);
+    }
+    deleteLogUploadSocket(pMachine->pTcpSock);
+    LOGGING_DELETE_ARRAY(pMachine->pBuffer);
+    LOGGING_DELETE(LogUploadMachine, pMachine);
+}
+
+// Run the log upload state machine for as long as it can make
+// progress without blocking, or until it has done one buffer's
+// worth of file I/O, so that other events on the event queue
+// get a look in.
+// Note: log upload machine mutex must be locked before calling.
+void LogInstance::runLogUploadStep()
+{
+    LogUploadMachine *pMachine;
+    LogUploadStep step = LOG_UPLOAD_STEP_CONTINUE;
+    LogFrame frame;
+    nsapi_error_t nsapiError;
+    int x;
+
+    _logUploadStepPending = false;
+    if ((_pLogFileUploadData == NULL) || (_pLogFileUploadData->pMachine == NULL)) {
+        return;
+    }
+    pMachine = _pLogFileUploadData->pMachine;
+
+    while (step == LOG_UPLOAD_STEP_CONTINUE) {
+        switch (pMachine->state) {
+            case LOG_UPLOAD_STATE_NEXT_FILE:
+                pMachine->pPlanFile = getNextLogFileToUpload(&(pMachine->fileNumber));
+                if (pMachine->pPlanFile == NULL) {
+                    pMachine->frameCount = 0;
+                    pMachine->frameLength = 0;
+                    if (pMachine->connected &&
+                        (_logUploadProtocol == LOG_UPLOAD_PROTOCOL_FRAMED)) {
+                        memset(&frame, 0, sizeof(frame));
+                        frame.type = LOG_FRAME_END;
+                        pMachine->frameLength = logFrameEncode(&frame, pMachine->frame);
+                    }
+                    pMachine->state = LOG_UPLOAD_STATE_SEND_END;
+                } else {
+                    strcpy(pMachine->name, pMachine->pPlanFile->name);
+                    getLogPath(pMachine->path, pMachine->name);
+                    pMachine->attempts = 0;
+                    pMachine->state = LOG_UPLOAD_STATE_CONNECT;
+                }
+            break;
+            case LOG_UPLOAD_STATE_CONNECT:
+                if (!pMachine->connected) {
+                    if (!pMachine->connecting) {
+                        LOG(EVENT_SOCKET_OPENING, pMachine->fileNumber);
+                        nsapiError = pMachine->pTcpSock->open(_pLogFileUploadData->pNetworkInterface);
+                        if (nsapiError == NSAPI_ERROR_OK) {
+                            LOG(EVENT_SOCKET_OPENED, pMachine->fileNumber);
+                            pMachine->pTcpSock->set_blocking(false);
+                            pMachine->pTcpSock->sigio(callback(this, &LogInstance::logUploadSigio));
+                            LOG(EVENT_TCP_CONNECTING, pMachine->fileNumber);
+                            pMachine->connecting = true;
+                        } else {
+                            LOG(EVENT_SOCKET_OPENING_FAILURE, nsapiError);
+                            failLogUploadMachine(pMachine);
+                            break;
+                        }
+                    }
+                    nsapiError = pMachine->pTcpSock->connect(_loggingServer);
+                    if ((nsapiError == NSAPI_ERROR_OK) || (nsapiError == NSAPI_ERROR_IS_CONNECTED)) {
+                        LOG(EVENT_TCP_CONNECTED, pMachine->fileNumber);
+                        pMachine->connecting = false;
+                        pMachine->connected = true;
+                    } else if ((nsapiError == NSAPI_ERROR_IN_PROGRESS) ||
+                               (nsapiError == NSAPI_ERROR_ALREADY) ||
+                               (nsapiError == NSAPI_ERROR_WOULD_BLOCK)) {
+                        step = LOG_UPLOAD_STEP_WAIT;
+                    } else {
+                        LOG(EVENT_TCP_CONNECT_FAILURE, nsapiError);
+                        pMachine->connecting = false;
+                        failLogUploadMachine(pMachine);
+                    }
+                }
+                if (pMachine->connected) {
+                    LOG(EVENT_LOG_UPLOAD_STARTING, pMachine->fileNumber);
+                    pMachine->pFile = fopen(pMachine->path, "r");
+                    if (pMachine->pFile != NULL) {
+                        LOG(EVENT_LOG_FILE_OPEN, 0);
+                        pMachine->offset = 0;
+                        pMachine->bufferCount = 0;
+                        pMachine->bufferLength = 0;
+                        if (_logUploadProtocol == LOG_UPLOAD_PROTOCOL_FRAMED) {
+                            pMachine->state = LOG_UPLOAD_STATE_CRC;
+                            if (!readLogUploadProgress(pMachine->pFile, pMachine->path,
+                                                       pMachine->pPlanFile,
+                                                       &pMachine->progress)) {
+                                pMachine->progress.size = 0;
+                                pMachine->progress.crc = 0;
+                                pMachine->progress.offset = 0;
+                            } else {
+                                pMachine->state = LOG_UPLOAD_STATE_SEND_HEADER;
+                            }
+                        } else {
+                            pMachine->startOffset = 0;
+                            pMachine->fileTimer.reset();
+                            pMachine->state = LOG_UPLOAD_STATE_SEND_DATA;
+                        }
+                    } else {
+                        LOG(EVENT_LOG_FILE_OPEN_FAILURE, 0);
+                        endLogUploadMachineFile(pMachine, false);
+                    }
+                }
+            break;
+            case LOG_UPLOAD_STATE_CRC:
+                // Work out the CRC a buffer at a time
+                x = fread(pMachine->pBuffer, 1, LOGGING_UPLOAD_BUFFER_SIZE, pMachine->pFile);
+                if (x > 0) {
+                    pMachine->progress.crc = logCrc32(pMachine->progress.crc, pMachine->pBuffer, x);
+                    pMachine->progress.size += x;
+                    step = LOG_UPLOAD_STEP_YIELD;
+                } else {
+                    rewind(pMachine->pFile);
+                    pMachine->state = LOG_UPLOAD_STATE_SEND_HEADER;
+                }
+            break;
+            case LOG_UPLOAD_STATE_SEND_HEADER:
+                if (pMachine->frameLength == 0) {
+                    frame.type = LOG_FRAME_FILE;
+                    frame.deviceId = _logUploadDeviceId;
+                    frame.size = pMachine->progress.size;
+                    frame.crc = pMachine->progress.crc;
+                    strcpy(frame.name, pMachine->name);
+                    pMachine->frameLength = logFrameEncode(&frame, pMachine->frame);
+                    pMachine->frameCount = 0;
+                }
+                step = sendLogUploadFrame(pMachine);
+                if (step == LOG_UPLOAD_STEP_CONTINUE) {
+                    pMachine->frameLength = LOG_PROTOCOL_HEADER_SIZE;
+                    pMachine->frameCount = 0;
+                    pMachine->state = LOG_UPLOAD_STATE_RECEIVE_ACK;
+                }
+            break;
+            case LOG_UPLOAD_STATE_RECEIVE_ACK:
+                step = receiveLogUploadFrame(pMachine);
+                if (step == LOG_UPLOAD_STEP_CONTINUE) {
+                    pMachine->frameLength = 0;
+                    if ((pMachine->ackOffset <= pMachine->progress.size) &&
+                        (fseek(pMachine->pFile, pMachine->ackOffset, SEEK_SET) == 0)) {
+                        pMachine->offset = pMachine->ackOffset;
+                        if (pMachine->offset > 0) {
+                            LOG(EVENT_LOG_FILE_BYTE_COUNT, pMachine->offset);
+                            if (pMachine->offset == pMachine->progress.size) {
+                                LOG(EVENT_LOG_FILE_ALREADY_UPLOADED, pMachine->offset);
+                            }
+                        }
+                        pMachine->startOffset = pMachine->offset;
+                        pMachine->fileTimer.reset();
+                        pMachine->state = LOG_UPLOAD_STATE_SEND_DATA;
+                    } else {
+                        step = LOG_UPLOAD_STEP_FAIL;
+                    }
+                }
+            break;
+            case LOG_UPLOAD_STATE_SEND_DATA:
+                if (pMachine->bufferCount >= pMachine->bufferLength) {
+                    // Read the next buffer's worth, then let others in
+                    pMachine->bufferCount = 0;
+                    pMachine->bufferLength = fread(pMachine->pBuffer, 1, LOGGING_UPLOAD_BUFFER_SIZE,
+                                                   pMachine->pFile);
+                    if (pMachine->bufferLength > 0) {
+                        step = LOG_UPLOAD_STEP_YIELD;
+                    } else if (ferror(pMachine->pFile)) {
+                        step = LOG_UPLOAD_STEP_FAIL;
+                    } else {
+                        // That's the end of the file
+                        logLogUploadRate(pMachine->offset - pMachine->startOffset,
+                                         pMachine->fileTimer.read_us());
+                        if (_logUploadProtocol == LOG_UPLOAD_PROTOCOL_FRAMED) {
+                            pMachine->frameLength = LOG_PROTOCOL_HEADER_SIZE;
+                            pMachine->frameCount = 0;
+                            pMachine->state = LOG_UPLOAD_STATE_RECEIVE_FINAL_ACK;
+                        } else {
+                            endLogUploadMachineFile(pMachine, true);
+                        }
+                    }
+                } else if ((x = getLogUploadAllowance(pMachine->bufferLength - pMachine->bufferCount,
+                                                      &pMachine->delayMs)) == 0) {
+                    step = LOG_UPLOAD_STEP_DELAY;
+                } else {
+                    x = pMachine->pTcpSock->send(pMachine->pBuffer + pMachine->bufferCount, x);
+                    useLogUploadAllowance(x);
+                    if (x > 0) {
+                        pMachine->bufferCount += x;
+                        pMachine->offset += x;
+                        LOG(EVENT_LOG_FILE_BYTE_COUNT, pMachine->offset);
+                    } else if ((x == 0) || (x == NSAPI_ERROR_WOULD_BLOCK)) {
+                        step = LOG_UPLOAD_STEP_WAIT;
+                    } else {
+                        LOG(EVENT_SEND_FAILURE, x);
+                        step = LOG_UPLOAD_STEP_FAIL;
+                    }
+                }
+            break;
+            case LOG_UPLOAD_STATE_RECEIVE_FINAL_ACK:
+                step = receiveLogUploadFrame(pMachine);
+                if (step == LOG_UPLOAD_STEP_CONTINUE) {
+                    pMachine->frameLength = 0;
+                    pMachine->progress.offset = pMachine->ackOffset;
+                    writeLogUploadProgress(pMachine->path, &pMachine->progress);
+                    if (pMachine->ackOffset == pMachine->progress.size) {
+                        endLogUploadMachineFile(pMachine, true);
+                    } else {
+                        endLogUploadMachineFile(pMachine, false);
+                        retryLogUploadMachineFile(pMachine, false);
+                    }
+                }
+            break;
+            case LOG_UPLOAD_STATE_RETRY:
+                // Back off before trying the log file again
+                x = pMachine->retryDelayMs - pMachine->retryTimer.read_ms();
+                if (x > 0) {
+                    pMachine->delayMs = x;
+                    step = LOG_UPLOAD_STEP_DELAY;
+                } else {
+                    pMachine->state = LOG_UPLOAD_STATE_CONNECT;
+                }
+            break;
+            case LOG_UPLOAD_STATE_SEND_END:
+                step = sendLogUploadFrame(pMachine);
+                if (step != LOG_UPLOAD_STEP_WAIT) {
+                    LOG(EVENT_LOG_UPLOAD_TASK_COMPLETED, _pLogFileUploadData->numUploaded);
+                    printf("[Log file upload has completed]\n");
+                    deleteLogUploadMachine(pMachine);
+                    deleteLogFileUploadData();
+                    return;
+                }
+            break;
+        }
+
+        if (step == LOG_UPLOAD_STEP_FAIL) {
+            failLogUploadMachine(pMachine);
+            step = LOG_UPLOAD_STEP_CONTINUE;
+        }
+        if (step != LOG_UPLOAD_STEP_WAIT) {
+            pMachine->timer.reset();
+        }
+    }
 
-// The TCP buffer size for log file uploads.
-// Note: chose a small value here since the logs are small
-// and it avoids a large malloc().
-// Note: must be a multiple of a LogEntry size, otherwise
-// the overhang can be lost
-#define LOGGING_TCP_BUFFER_SIZE (20 * sizeof (LogEntry))
+    if (step == LOG_UPLOAD_STEP_YIELD) {
+        postLogUploadStep();
+    } else if (step == LOG_UPLOAD_STEP_DELAY) {
+        if (pMachine->watchdogId != 0) {
+            pMachine->pEventQueue->cancel(pMachine->watchdogId);
+        }
+        pMachine->watchdogId = pMachine->pEventQueue->call_in(pMachine->delayMs, this,
+                                                              &LogInstance::logUploadWatchdog);
+    } else if (pMachine->timer.read_ms() > LOGGING_UPLOAD_TIMEOUT_MS) {
+        // Waited too long for the socket, try again with a new connection
+        LOG(EVENT_TCP_SEND_TIMEOUT, pMachine->fileNumber);
+        failLogUploadMachine(pMachine);
+        postLogUploadStep();
+    } else if (pMachine->watchdogId == 0) {
+        pMachine->watchdogId = pMachine->pEventQueue->call_in(LOGGING_UPLOAD_WATCHDOG_MS, this,
+                                                              &LogInstance::logUploadWatchdog);
+    }
+}
 
-// Printf() logging data as well as putting it in the
-// logging system
-#if defined(MBED_CONF_APP_LOG_PRINT) && \
-    MBED_CONF_APP_LOG_PRINT
-#define LOG_PRINT
-#endif
+// Take a step of the log upload state machine, posted to its
+// event queue.
+void LogInstance::logUploadStep()
+{
+    _logUploadMachineMutex.lock();
+    runLogUploadStep();
+    _logUploadMachineMutex.unlock();
+}
 
-// Only printf() the logging data don't put it in the
-// logging system at all (can sometimes be useful
-// where you want local debug but don't want to
-// load the rest of the system with logging data)
-#if defined (MBED_CONF_APP_LOG_PRINT_ONLY) && \
-    MBED_CONF_APP_LOG_PRINT_ONLY
-#define LOG_PRINT_ONLY
-#endif
+// Start the log upload state machine on an event queue.
+void LogInstance::startLogUploadMachine(EventQueue *pEventQueue)
+{
+    LogUploadMachine *pMachine = LOGGING_NEW(_logUploadMachineStore) LogUploadMachine();
 
-/* ----------------------------------------------------------------
- * TYPES
- * -------------------------------------------------------------- */
+    pMachine->state = LOG_UPLOAD_STATE_NEXT_FILE;
+    pMachine->pEventQueue = pEventQueue;
+    pMachine->pTcpSock = newLogUploadSocket();
+    pMachine->pFile = NULL;
+    pMachine->connected = false;
+    pMachine->connecting = false;
+    pMachine->frameLength = 0;
+    pMachine->frameCount = 0;
+    pMachine->pBuffer = LOGGING_NEW_ARRAY(_logUploadMachineBufferStore, char,
+                                          LOGGING_UPLOAD_BUFFER_SIZE);
+    pMachine->fileNumber = 0;
+    pMachine->watchdogId = 0;
+    pMachine->delayMs = 0;
+    pMachine->startOffset = 0;
+    pMachine->attempts = 0;
+    pMachine->retryDelayMs = 0;
+    pMachine->timer.reset();
+    pMachine->timer.start();
+    pMachine->fileTimer.start();
+    pMachine->retryTimer.start();
 
-// Type used to pass parameters to the log file upload callback.
-typedef struct {
-    FATFileSystem *pFileSystem;
-    const char *pCurrentLogFile;
-    NetworkInterface *pNetworkInterface;
-} LogFileUploadData;
+    _pLogFileUploadData->pMachine = pMachine;
+    _logUploadStepPending = false;
+    postLogUploadStep();
+}
 
-/* ----------------------------------------------------------------
- * VARIABLES
- * -------------------------------------------------------------- */
+// Return true if the ring of the live log stream has room for
+// another entry to send and the one that may be inserted before
+// it; entries which have been sent are kept only while there is
+// room for them.
+// Note: log stream mutex must be locked before calling.
+bool LogInstance::logStreamHasRoom()
+{
+    return (_pLogStream->nextIn - _pLogStream->nextSend + 2 <= LOGGING_STREAM_BUFFER_ENTRIES);
+}
 
-// The strings associated with the enum values.
-extern const char *gLogStrings[];
-extern const int gNumLogStrings;
+// Put a log entry in the ring of the live log stream, dropping
+// the oldest entry if the ring is full.
+// Note: log stream mutex must be locked before calling.
+void LogInstance::putLogStreamEntry(const LogEntry *pEntry)
+{
+    if (_pLogStream->nextIn - _pLogStream->oldest >= LOGGING_STREAM_BUFFER_ENTRIES) {
+        _pLogStream->oldest++;
+        if ((int) (_pLogStream->nextSend - _pLogStream->oldest) < 0) {
+            _pLogStream->nextSend = _pLogStream->oldest;
+        }
+    }
+    memcpy(&(_pLogStream->entries[_pLogStream->nextIn % LOGGING_STREAM_BUFFER_ENTRIES]),
+           pEntry, sizeof(*pEntry));
+    _pLogStream->nextIn++;
+}
 
-// A pointer to the logging context data.
-// This is stored at the start of the logging
-// buffer area
-static LogContext *gpContext = NULL;
+// Copy up to numEntries entries from the ring of the live log
+// stream into its frame, starting at *pSequence or, if that has
+// gone, the oldest entry in the ring, and stopping before end,
+// returning the number of entries; *pSequence is set to the
+// sequence number of the first.
+int LogInstance::getLogStreamEntries(LogStream *pStream, unsigned int *pSequence,
+                                     unsigned int end, int numEntries)
+{
+    char *pData = pStream->frame + LOG_PROTOCOL_HEADER_SIZE + LOG_PROTOCOL_SEQUENCE_SIZE;
+    int count = 0;
 
-// Mutex to arbitrate logging.
-// The callback which writes logging to disk
-// will attempt to lock this mutex while the
-// function that prints out the log owns the
-// mutex. Note that the logging functions
-// themselves shouldn't wait on it (they have
-// no reason to as the buffering should
-// handle any overlap); they MUST return quickly.
-static Mutex gLogMutex;
+    _logStreamMutex.lock();
+    if ((int) (*pSequence - pStream->oldest) < 0) {
+        *pSequence = pStream->oldest;
+    }
+    if (numEntries > LOGGING_STREAM_MAX_BATCH) {
+        numEntries = LOGGING_STREAM_MAX_BATCH;
+    }
+    while ((count < numEntries) && ((int) (end - (*pSequence + count)) > 0)) {
+        memcpy(pData, &(pStream->entries[(*pSequence + count) % LOGGING_STREAM_BUFFER_ENTRIES]),
+               sizeof(LogEntry));
+        pData += sizeof(LogEntry);
+        count++;
+    }
+    _logStreamMutex.unlock();
 
-// The number of calls to writeLog().
-static int gNumWrites = 0;
+    return count;
+}
 
-// A logging timestamp.
-static Timer gLogTime;
+// Copy the next batch of entries to send from the ring of the
+// live log stream into its frame, leaving them in the ring until
+// they have been sent, returning the number of entries;
+// *pSequence is set to the sequence number of the first.
+int LogInstance::getLogStreamBatch(LogStream *pStream, unsigned int *pSequence)
+{
+    unsigned int end;
 
-// Remember the last logging timestamp.
-static unsigned int gLastLogTime;
+    _logStreamMutex.lock();
+    *pSequence = pStream->nextSend;
+    end = pStream->nextIn;
+    _logStreamMutex.unlock();
 
-// An offset in the logging timestamp (may be non-zero
-// if logging has been suspended)
-static unsigned int gLogTimeOffset;
+    return getLogStreamEntries(pStream, pSequence, end, LOGGING_STREAM_MAX_BATCH);
+}
 
-// A file to write logs to.
-static FILE *gpFile = NULL;
+// Record that a batch of entries of the live log stream has
+// been sent, unless it has been dropped meanwhile; over UDP the
+// entries are kept in the ring in case the logging server asks
+// for them again, over TCP they are done with.
+void LogInstance::logStreamBatchSent(LogStream *pStream, unsigned int sequence, int numEntries)
+{
+    _logStreamMutex.lock();
+    if ((int) (sequence + numEntries - pStream->nextSend) > 0) {
+        pStream->nextSend = sequence + numEntries;
+    }
+    if (pStream->transport == LOG_STREAM_TRANSPORT_TCP) {
+        pStream->oldest = pStream->nextSend;
+    }
+    _logStreamMutex.unlock();
+}
 
-// The path where log files are kept.
-static char gLogPath[LOGGING_MAX_LEN_PATH + 1];
+// Open the socket of the live log stream, connecting it to the
+// logging server if the transport is TCP.
+bool LogInstance::openLogStreamSocket(LogStream *pStream, unsigned int sequence)
+{
+    nsapi_error_t nsapiError;
+    bool opened = false;
 
-// The name of the current log file.
-static char gCurrentLogFileName[LOGGING_MAX_LEN_FILE_PATH + 1];
+    if (pStream->transport == LOG_STREAM_TRANSPORT_UDP) {
+        LOG(EVENT_SOCKET_OPENING, sequence);
+        nsapiError = pStream->pUdpSock->open(pStream->pNetworkInterface);
+        if (nsapiError == NSAPI_ERROR_OK) {
+            LOG(EVENT_SOCKET_OPENED, sequence);
+            // Requests to send entries again are polled for
+            pStream->pUdpSock->set_blocking(false);
+            opened = true;
+        } else {
+            LOG(EVENT_SOCKET_OPENING_FAILURE, nsapiError);
+        }
+    } else {
+        opened = openLogUploadSocket(pStream->pTcpSock, pStream->pNetworkInterface,
+                                     &(pStream->server), sequence);
+    }
 
-// The address of the logging server.
-static SocketAddress *gpLoggingServer = NULL;
+    return opened;
+}
 
-// A thread to run the log upload process.
-static Thread *gpLogUploadThread = NULL;
+// Close the socket of the live log stream.
+static void closeLogStreamSocket(LogStream *pStream)
+{
+    if (pStream->transport == LOG_STREAM_TRANSPORT_UDP) {
+        pStream->pUdpSock->close();
+    } else {
+        pStream->pTcpSock->close();
+    }
+}
 
-// A buffer to hold some data that is required by the
-// log file upload thread.
-static LogFileUploadData *gpLogFileUploadData = NULL;
+// Send a datagram over the UDP socket of the live log stream,
+// keeping to the rate limit, returning false if it could not be
+// sent.  A datagram can't be sent in pieces, so it goes as soon
+// as there is any allowance and all of it is taken; if the
+// stream is asked to stop while waiting for the allowance the
+// datagram is dropped.
+bool LogInstance::sendLogStreamDatagram(LogStream *pStream, const char *pData, int size)
+{
+    nsapi_size_or_error_t x = 0;
+    int allowance;
+    int waitMs;
 
-/* ----------------------------------------------------------------
- * STATIC FUNCTIONS
- * -------------------------------------------------------------- */
+    allowance = getLogUploadAllowance(size, &waitMs);
+    while ((allowance == 0) && waitLogSend(waitMs, pStream)) {
+        allowance = getLogUploadAllowance(size, &waitMs);
+    }
+    if (allowance > 0) {
+        x = pStream->pUdpSock->sendto(pStream->server, pData, size);
+        useLogUploadAllowance(size);
+        if (x != size) {
+            LOG(EVENT_SEND_FAILURE, x);
+        }
+    }
 
-// Print a single item from a log.
-void printLogItem(const LogEntry *pItem, unsigned int itemIndex)
+    return (x == size);
+}
+
+// Send the batch of entries in the frame of the live log stream,
+// returning false if the connection has failed.
+bool LogInstance::sendLogStreamBatch(LogStream *pStream, unsigned int sequence, int numEntries)
 {
-    if (pItem->event > gNumLogStrings) {
-        printf("%.3f: out of range event at entry %d (%d when max is %d)\n",
-               (float) pItem->timestamp / 1000, itemIndex, pItem->event, gNumLogStrings);
+    LogFrame frame;
+    char *pData = pStream->frame + LOG_PROTOCOL_HEADER_SIZE;
+    int size = LOG_PROTOCOL_SEQUENCE_SIZE + (numEntries * sizeof(LogEntry));
+    bool sent;
+
+    logFrameEncodeSequence(sequence, pData);
+    memset(&frame, 0, sizeof(frame));
+    frame.type = LOG_FRAME_ENTRIES;
+    frame.deviceId = pStream->deviceId;
+    frame.size = size;
+    frame.crc = logCrc32(0, pData, size);
+    // With no name the header is exactly LOG_PROTOCOL_HEADER_SIZE
+    logFrameEncode(&frame, pStream->frame);
+
+    if (pStream->transport == LOG_STREAM_TRANSPORT_UDP) {
+        sent = sendLogStreamDatagram(pStream, pStream->frame, LOG_PROTOCOL_HEADER_SIZE + size);
     } else {
-        printf ("%6.3f: %s [%d] %d (%#x)\n", (float) pItem->timestamp / 1000,
-                gLogStrings[pItem->event], pItem->event, pItem->parameter, pItem->parameter);
+        sent = sendLogUploadData(pStream->pTcpSock, pStream->frame, LOG_PROTOCOL_HEADER_SIZE + size,
+                                 pStream);
     }
 
+    return sent;
 }
 
-// Open a log file, storing its name in gCurrentLogFileName
-// and returning a handle to it.
-FILE *newLogFile()
+// Answer any requests from the logging server to send entries
+// of the live log stream over UDP again, sending those which are
+// still in the ring, returning false if the socket has failed.
+bool LogInstance::resendLogStreamEntries(LogStream *pStream)
 {
-    FILE *pFile = NULL;
+    char request[LOG_PROTOCOL_HEADER_SIZE + LOG_PROTOCOL_SEQUENCE_SIZE];
+    LogFrame frame;
+    unsigned int sequence;
+    unsigned int end;
+    int numEntries;
+    bool sent = true;
 
-    for (unsigned int x = 0; (x < 1000) && (pFile == NULL); x++) {
-        sprintf(gCurrentLogFileName, "%s/%04d.log", gLogPath, x);
-        // Try to open the file to see if it exists
-        pFile = fopen(gCurrentLogFileName, "r");
-        // If it doesn't exist, use it, otherwise close
-        // it and go around again
-        if (pFile == NULL) {
-            printf("Log file will be \"%s\".\n", gCurrentLogFileName);
-            pFile = fopen (gCurrentLogFileName, "wb+");
-            if (pFile != NULL) {
-                LOG(EVENT_LOG_FILE_OPEN, 0);
-            } else {
-                LOG(EVENT_LOG_FILE_OPEN_FAILURE, errno);
-                perror ("Error initialising log file");
+    while (sent && (pStream->pUdpSock->recvfrom(NULL, request, sizeof(request)) ==
+                    (nsapi_size_or_error_t) sizeof(request))) {
+        if ((logFrameDecodeHeader(request, &frame) == 0) &&
+            (frame.type == LOG_FRAME_RESEND) && (frame.deviceId == pStream->deviceId)) {
+            sequence = logFrameDecodeSequence(request + LOG_PROTOCOL_HEADER_SIZE);
+            end = sequence + frame.size;
+            // Entries which haven't been sent yet will be anyway
+            _logStreamMutex.lock();
+            if ((int) (end - pStream->nextSend) > 0) {
+                end = pStream->nextSend;
+            }
+            _logStreamMutex.unlock();
+            while (sent && ((numEntries = getLogStreamEntries(pStream, &sequence, end,
+                                                              end - sequence)) > 0)) {
+                sent = sendLogStreamBatch(pStream, sequence, numEntries);
+                sequence += numEntries;
             }
-        } else {
-            fclose(pFile);
-            pFile = NULL;
         }
     }
 
-    return pFile;
+    return sent;
 }
 
-// Get the address portion of a URL, leaving off the port number etc.
-static void getAddressFromUrl(const char * pUrl, char * pAddressBuf, int lenBuf)
+// Run the live log stream in its thread.
+static void runLogStream(LogStream *pStream)
 {
-    const char * pPortPos;
-    int lenUrl;
+    pStream->pInstance->logStreamCallback(pStream);
+}
 
-    if (lenBuf > 0) {
-        // Check for the presence of a port number
-        pPortPos = strchr(pUrl, ':');
-        if (pPortPos != NULL) {
-            // Length wanted is up to and including the ':'
-            // (which will be overwritten with the terminator)
-            if (lenBuf > pPortPos - pUrl + 1) {
-                lenBuf = pPortPos - pUrl + 1;
+// Function to sit in a thread and stream the log: every
+// LOGGING_STREAM_INTERVAL_MS the new log entries are taken
+// from RAM and sent, connecting to the logging server as
+// necessary, until the stream is stopped, when what is left
+// is sent if possible.
+void LogInstance::logStreamCallback(LogStream *pStream)
+{
+    unsigned int sequence;
+    int numEntries;
+    bool connected = false;
+    bool stopping = false;
+
+    do {
+        stopping = pStream->stop;
+        // Take whatever has been logged since last time
+        writeLog();
+        numEntries = getLogStreamBatch(pStream, &sequence);
+        if (numEntries > 0) {
+            if (!connected && !stopping) {
+                connected = openLogStreamSocket(pStream, sequence);
             }
-        } else {
-            // No port number, take the whole thing
-            // including the terminator
-            lenUrl = strlen (pUrl);
-            if (lenBuf > lenUrl + 1) {
-                lenBuf = lenUrl + 1;
+            if (connected) {
+                if (sendLogStreamBatch(pStream, sequence, numEntries)) {
+                    logStreamBatchSent(pStream, sequence, numEntries);
+                } else {
+                    // Keep the batch and try again over a new connection
+                    closeLogStreamSocket(pStream);
+                    connected = false;
+                }
             }
         }
-        memcpy (pAddressBuf, pUrl, lenBuf);
-        *(pAddressBuf + lenBuf - 1) = 0;
+        if (connected && (pStream->transport == LOG_STREAM_TRANSPORT_UDP) &&
+            !resendLogStreamEntries(pStream)) {
+            closeLogStreamSocket(pStream);
+            connected = false;
+        }
+        // Carry straight on if there's more to send, otherwise
+        // wait for the next interval or to be told to stop (the
+        // wake-up may already have been taken by a wait to send)
+        if (!pStream->stop && ((numEntries < LOGGING_STREAM_MAX_BATCH) || !connected)) {
+            pStream->pStop->wait(LOGGING_STREAM_INTERVAL_MS);
+        }
+    } while (!stopping || (connected && (numEntries == LOGGING_STREAM_MAX_BATCH)));
+
+    if (connected) {
+        if (pStream->transport == LOG_STREAM_TRANSPORT_TCP) {
+            endLogUpload(pStream->pTcpSock, pStream);
+        }
+        closeLogStreamSocket(pStream);
     }
 }
 
-// Get the port number from the end of a URL.
-static bool getPortFromUrl(const char * pUrl, int *port)
+// Free the live log stream, whose thread must have ended.
+void LogInstance::deleteLogStream()
 {
-    bool success = false;
-    const char * pPortPos = strchr(pUrl, ':');
+    LogStream *pStream = _pLogStream;
 
-    if (pPortPos != NULL) {
-        *port = atoi(pPortPos + 1);
-        success = true;
-    }
+    _logMutex.lock();
+    _pLogStream = NULL;
+    _logMutex.unlock();
 
-    return success;
+    LOGGING_DELETE(Thread, pStream->pThread);
+    LOGGING_DELETE(Semaphore, pStream->pStop);
+    LOGGING_DELETE(TCPSocket, pStream->pTcpSock);
+    LOGGING_DELETE(UDPSocket, pStream->pUdpSock);
+    LOGGING_DELETE(LogStream, pStream);
 }
 
-// Function to sit in a thread and upload log files.
-void logFileUploadCallback()
+// Return true if the current log file should be closed and a new
+// one started before numBytes more are written to it.  The age
+// is read at full resolution since read() wraps after 35 minutes.
+bool LogInstance::logFileIsDue(unsigned int numBytes)
 {
-    nsapi_error_t nsapiError;
-    Dir *pDir = new Dir();
-    int x;
-    int y = 0;
-    int z;
-    struct dirent dirEnt;
-    FILE *pFile = NULL;
-    TCPSocket *pTcpSock = new TCPSocket();
-    int sendCount;
-    int sendTotalThisFile;
-    int size;
-    char *pReadBuffer = new char[LOGGING_TCP_BUFFER_SIZE];
-    char fileNameBuffer[LOGGING_MAX_LEN_FILE_PATH];
+    return ((_logFileMaxSize > 0) && (_currentLogFileSize + numBytes > _logFileMaxSize)) ||
+           ((_logFileMaxAgeSeconds > 0) &&
+            (_currentLogFileTimer.read_high_resolution_us() >=
+             (unsigned long long) _logFileMaxAgeSeconds * 1000000));
+}
 
-    MBED_ASSERT (gpLogFileUploadData != NULL);
+// Delete the oldest log files, if need be, to keep the log files
+// awaiting upload within the retention limits.  Nothing is deleted
+// while log files are being uploaded, since they could be in use.
+// Note: log file mutex must be locked before calling.
+void LogInstance::applyLogFileRetention()
+{
+    LogManifestRecord *pRecords;
+    char path[LOGGING_MAX_LEN_FILE_PATH + 1];
+    FILE *pFile;
+    unsigned long long totalSize = 0;
+    int numRecords;
+    int numFiles = 0;
+    int nextSequence;
+    unsigned int flags;
 
-    LOG(EVENT_DIR_OPEN, 0);
-    x = pDir->open(gpLogFileUploadData->pFileSystem, "/");
-    if (x == 0) {
-        // Send those log files, using a different TCP
-        // connection for each one so that the logging server
-        // stores them in separate files
-        do {
-            x = pDir->read(&dirEnt);
-            // Open the file, provided it's not the one we're currently logging to
-            if ((x == 1) && (dirEnt.d_type == DT_REG) &&
-                ((gpLogFileUploadData->pCurrentLogFile == NULL) ||
-                 (strcmp(dirEnt.d_name, gpLogFileUploadData->pCurrentLogFile) != 0))) {
-                y++;
-                LOG(EVENT_SOCKET_OPENING, y);
-                nsapiError = pTcpSock->open(gpLogFileUploadData->pNetworkInterface);
-                if (nsapiError == NSAPI_ERROR_OK) {
-                    LOG(EVENT_SOCKET_OPENED, y);
-                    pTcpSock->set_timeout(10000);
-                    LOG(EVENT_TCP_CONNECTING, y);
-                    nsapiError = pTcpSock->connect(*gpLoggingServer);
-                    if (nsapiError == NSAPI_ERROR_OK) {
-                        LOG(EVENT_TCP_CONNECTED, y);
-                        LOG(EVENT_LOG_UPLOAD_STARTING, y);
-                        sprintf(fileNameBuffer, "%s/%s", gLogPath, dirEnt.d_name);
-                        pFile = fopen(fileNameBuffer, "r");
-                        if (pFile != NULL) {
-                            LOG(EVENT_LOG_FILE_OPEN, 0);
-                            sendTotalThisFile = 0;
-                            do {
-                                // Read the file and send it
-                                size = fread(pReadBuffer, 1, LOGGING_TCP_BUFFER_SIZE, pFile);
-                                sendCount = 0;
-                                while (sendCount < size) {
-                                    z = pTcpSock->send(pReadBuffer + sendCount, size - sendCount);
-                                    if (z > 0) {
-                                        sendCount += z;
-                                        sendTotalThisFile += z;
-                                        LOG(EVENT_LOG_FILE_BYTE_COUNT, sendTotalThisFile);
-                                    }
-                                }
-                            } while (size > 0);
-                            LOG(EVENT_LOG_FILE_UPLOAD_COMPLETED, y);
-
-                            // The file has now been sent, so close the socket
-                            pTcpSock->close();
-
-                            // If the upload succeeded, delete the file
-                            if (feof(pFile)) {
-                                if (remove(fileNameBuffer) == 0) {
-                                    LOG(EVENT_FILE_DELETED, 0);
-                                } else {
-                                    LOG(EVENT_FILE_DELETE_FAILURE, 0);
-                                }
-                            }
-                            LOG(EVENT_LOG_FILE_CLOSE, 0);
-                            fclose(pFile);
-                        } else {
-                            LOG(EVENT_LOG_FILE_OPEN_FAILURE, 0);
-                        }
-                    } else {
-                        LOG(EVENT_TCP_CONNECT_FAILURE, nsapiError);
+    if (((_logFileMaxTotalSize > 0) || (_logFileMaxNumFiles > 0)) &&
+        (_pLogFileUploadData == NULL)) {
+        _logManifestMutex.lock();
+        // Drop the records of log files which have gone first, so
+        // that the manifest doesn't grow without bound while no
+        // log files are uploaded
+        compactLogManifest();
+        numRecords = readLogManifest(&pRecords, &nextSequence, &flags);
+        for (int x = 0; x < numRecords; x++) {
+            if (((pRecords[x].flags & LOGGING_MANIFEST_FLAGS_GONE) == 0) &&
+                (pRecords[x].sequence != _currentLogFileSequence)) {
+                // A log file which wasn't closed (e.g. because
+                // of a reset) has to be measured
+                if ((pRecords[x].flags & LOGGING_MANIFEST_FLAG_CLOSED) == 0) {
+                    getLogFilePath(path, pRecords[x].sequence);
+                    pFile = fopen(path, "r");
+                    if (pFile != NULL) {
+                        fseek(pFile, 0, SEEK_END);
+                        pRecords[x].size = ftell(pFile);
+                        fclose(pFile);
                     }
-                } else {
-                    LOG(EVENT_SOCKET_OPENING_FAILURE, nsapiError);
                 }
+                totalSize += pRecords[x].size;
+                numFiles++;
             }
-        } while (x > 0);
-    } else {
-        LOG(EVENT_DIR_OPEN_FAILURE, x);
+        }
+        // The records are oldest first
+        for (int x = 0; (x < numRecords) &&
+                        (((_logFileMaxTotalSize > 0) && (totalSize > _logFileMaxTotalSize)) ||
+                         ((_logFileMaxNumFiles > 0) && (numFiles > _logFileMaxNumFiles))); x++) {
+            if (((pRecords[x].flags & LOGGING_MANIFEST_FLAGS_GONE) == 0) &&
+                (pRecords[x].sequence != _currentLogFileSequence)) {
+                LOG(EVENT_LOG_FILE_DISCARDED, pRecords[x].sequence);
+                pRecords[x].flags |= LOGGING_MANIFEST_FLAG_DISCARDED;
+                updateLogManifestRecord(x, &(pRecords[x]));
+                getLogFilePath(path, pRecords[x].sequence);
+                removeLogFile(path);
+                totalSize -= pRecords[x].size;
+                numFiles--;
+            }
+        }
+        LOGGING_DELETE_ARRAY(pRecords);
+        _logManifestMutex.unlock();
     }
+}
 
-    LOG(EVENT_LOG_UPLOAD_TASK_COMPLETED, 0);
-    printf("[Log file upload background task has completed]\n");
-
-    // Clear up locals
-    delete pDir;
-    delete pTcpSock;
-    delete pReadBuffer;
-
-    // Clear up globals
-    delete gpLogFileUploadData;
-    gpLogFileUploadData = NULL;
-    delete gpLoggingServer;
-    gpLoggingServer = NULL;
+// Close the current log file and start a new one.
+// Note: log file mutex must be locked before calling.
+void LogInstance::rotateLogFile()
+{
+    // Index whatever is left
+    writeLogIndexBlock();
+    closeLogManifestRecord(_currentLogFileSize);
+    LOG(EVENT_LOG_FILE_CLOSE, 0);
+    fclose(_pFile);
+    _pFile = newLogFile();
+    applyLogFileRetention();
 }
 
 /* ----------------------------------------------------------------
@@ -321,28 +3381,34 @@ void logFileUploadCallback()
  * -------------------------------------------------------------- */
 
 // Initialise logging.
-void initLog(void *pBuffer)
+void LogInstance::initLog(void *pBuffer, int numEntries)
 {
     bool freshStart = false;
 
-    gpContext = (LogContext *) pBuffer;
-    // If the context is uninitialised, initialise it
-    if ((gpContext->magicWord != 0x123456) ||
-        (gpContext->version != LOG_VERSION)){
+    _pContext = (LogContext *) pBuffer;
+    _numLogEntries = numEntries;
+    // If the context is uninitialised, or was for a
+    // smaller number of entries, initialise it
+    if ((_pContext->magicWord != 0x123456) ||
+        (_pContext->version != LOG_VERSION) ||
+        (_pContext->pLogNextEmpty >= _pContext->pLog + numEntries) ||
+        (_pContext->pLogFirstFull >= _pContext->pLog + numEntries)){
         freshStart = true;
-        memset(gpContext, 0, sizeof(*gpContext));
-        gpContext->version = LOG_VERSION;
-        gpContext->pLog = (LogEntry * ) ((char *) pBuffer + sizeof(*gpContext));
-        gpContext->pLogNextEmpty = gpContext->pLog;
-        gpContext->pLogFirstFull = gpContext->pLog;
-        gpContext->numLogItems = 0;
-        gpContext->logEntriesOverwritten = 0;
-        gpContext->magicWord = 0x123456;
-    }
-    gLastLogTime = 0;
-    gLogTime.reset();
-    gLogTime.start();
-    gLogTimeOffset = 0;
+        memset(_pContext, 0, sizeof(*_pContext));
+        _pContext->version = LOG_VERSION;
+        _pContext->pLog = (LogEntry * ) ((char *) pBuffer + sizeof(*_pContext));
+        _pContext->pLogNextEmpty = _pContext->pLog;
+        _pContext->pLogFirstFull = _pContext->pLog;
+        _pContext->numLogItems = 0;
+        _pContext->logEntriesOverwritten = 0;
+        _pContext->magicWord = 0x123456;
+    }
+    _fastPath.lastLogTime = 0;
+    _logTime.reset();
+    _logTime.start();
+    _fastPath.logTimeOffset = 0;
+    _fastPath.pLogLast = _pContext->pLog + numEntries - 1;
+    _fastPath.pContext = _pContext;
     if (freshStart) {
         LOG(EVENT_LOG_START, LOG_VERSION);
     } else {
@@ -351,81 +3417,81 @@ void initLog(void *pBuffer)
 }
 
 // Suspend logging.
-void suspendLog()
+void LogInstance::suspendLog()
 {
-    gLogTime.stop();
+    _logTime.stop();
 }
 
 // Resume logging.
-void resumeLog(unsigned int intervalUSeconds)
+void LogInstance::resumeLog(unsigned int intervalUSeconds)
 {
-    gLogTimeOffset += intervalUSeconds;
-    gLogTime.start();
+    _fastPath.logTimeOffset += intervalUSeconds;
+    _logTime.start();
 }
 
 // Get the first N log entries.
-int getLog(LogEntry *pEntries, int numEntries)
+int LogInstance::getLog(LogEntry *pEntries, int numEntries)
 {
     const LogEntry *pItem;
     int itemCount;
 
-    gLogMutex.lock();
+    _logMutex.lock();
 
     itemCount = 0;
-    pItem = gpContext->pLogFirstFull;
-    while ((pItem != gpContext->pLogNextEmpty) &&
+    pItem = _pContext->pLogFirstFull;
+    while ((pItem != _pContext->pLogNextEmpty) &&
            (itemCount < numEntries)) {
-        if (gpContext->logEntriesOverwritten > 0) {
+        if (_pContext->logEntriesOverwritten > 0) {
             LogEntry insert = {pItem->timestamp,
                                EVENT_LOG_ENTRIES_OVERWRITTEN,
-                               (int) gpContext->logEntriesOverwritten};
+                               (int) _pContext->logEntriesOverwritten};
             memcpy(pEntries, &insert, sizeof(*pEntries));
             itemCount++;
             pEntries++;
-            gpContext->logEntriesOverwritten = 0;
+            _pContext->logEntriesOverwritten = 0;
         }
         if (itemCount < numEntries) {
             memcpy(pEntries, pItem, sizeof(*pEntries));
             itemCount++;
             pEntries++;
             pItem++;
-            if (gpContext->numLogItems > 0) {
-                gpContext->numLogItems--;
+            if (_pContext->numLogItems > 0) {
+                _pContext->numLogItems--;
             }
-            if (pItem >= gpContext->pLog + MAX_NUM_LOG_ENTRIES) {
-                pItem = gpContext->pLog;
+            if (pItem >= _pContext->pLog + _numLogEntries) {
+                pItem = _pContext->pLog;
             }
-            gpContext->pLogFirstFull = pItem;
+            _pContext->pLogFirstFull = pItem;
         }
     }
 
-    gLogMutex.unlock();
+    _logMutex.unlock();
 
     return itemCount;
 }
 
 // Get the number of log entries.
-int getNumLogEntries()
+int LogInstance::getNumLogEntries()
 {
-    return gpContext->numLogItems;
+    return _pContext->numLogItems;
 }
 
 // Initialise the log file.
-bool initLogFile(const char *pPath)
+bool LogInstance::initLogFile(const char *pPath)
 {
     bool goodPath = true;
     int x;
 
     // Save the path
     if (pPath == NULL) {
-        gLogPath[0] = 0;
+        _logPath[0] = 0;
     } else {
-        if (strlen(pPath) < sizeof (gCurrentLogFileName) - LOGGING_MAX_LEN_FILE_NAME) {
-            strcpy(gLogPath, pPath);
-            x = strlen(gLogPath);
+        if (strlen(pPath) < sizeof (_currentLogFileName) - LOGGING_MAX_LEN_FILE_NAME) {
+            strcpy(_logPath, pPath);
+            x = strlen(_logPath);
             // Remove any trailing slash
-            if (gLogPath[x - 1] == '/') {
-                gLogPath[x - 1] = 0;
+            if (_logPath[x - 1] == '/') {
+                _logPath[x - 1] = 0;
             }
         } else {
             goodPath = false;
@@ -433,125 +3499,273 @@ bool initLogFile(const char *pPath)
     }
 
     if (goodPath) {
-        gpFile = newLogFile();
+        _pFile = newLogFile();
     }
 
-    return (gpFile != NULL);
+    return (_pFile != NULL);
 }
 
 // Upload previous log files.
-bool beginLogFileUpload(FATFileSystem *pFileSystem,
-                        NetworkInterface *pNetworkInterface,
-                        const char *pLoggingServerUrl)
+bool LogInstance::beginLogFileUpload(FATFileSystem *pFileSystem,
+                                     NetworkInterface *pNetworkInterface,
+                                     const char *pLoggingServerUrl)
 {
     bool success = false;
-    char *pBuf = new char[LOGGING_MAX_LEN_SERVER_URL];
-    Dir *pDir = new Dir();
-    int port;
-    int x;
-    int y;
-    int z = 0;
-    struct dirent dirEnt;
-    const char * pCurrentLogFile = NULL;
-
-    if (gpLogUploadThread == NULL) {
-        // First, determine if there are any log files to be uploaded.
-        LOG(EVENT_DIR_OPEN, 0);
-        // Note sure I understand why but you can't use the
-        // partition path, which is *required* when opening a
-        // file, when you are opening the root directory of
-        // the partition
-        x = pDir->open(pFileSystem, "/");
-        if (x == 0) {
-            printf("[Checking for log files to upload...]\n");
-            // Point to the name portion of the current log file
-            // (format "*/xxxx.log")
-            pCurrentLogFile = strstr(gCurrentLogFileName, ".log");
-            if (pCurrentLogFile != NULL) {
-                pCurrentLogFile -= 4; // Point to the start of the file name
-            }
-            do {
-                y = pDir->read(&dirEnt);
-                if ((y == 1) && (dirEnt.d_type == DT_REG) &&
-                    ((pCurrentLogFile == NULL) || (strcmp(dirEnt.d_name, pCurrentLogFile) != 0))) {
-                    z++;
-                }
-            } while (y > 0);
+    bool backingOff;
+    int z;
+    LogUploadPlanFile *pPlan = NULL;
+
+    if ((_pLogUploadThread != NULL) && (_pLogFileUploadData == NULL)) {
+        // The last upload has finished, clear up its thread so
+        // that periodic uploads needn't call stopLogFileUpload()
+        _pLogUploadThread->join();
+        LOGGING_DELETE(Thread, _pLogUploadThread);
+        _pLogUploadThread = NULL;
+    }
+
+    _logUploadFileMutex.lock();
+    backingOff = logUploadIsBackingOff();
+    seedLogUploadRandom(pNetworkInterface);
+    _logUploadFileMutex.unlock();
+
+    if (backingOff) {
+        printf("[Log files will not be uploaded until the logging server has been given time to recover]\n");
+    } else if ((_pLogUploadThread == NULL) && (_pLogFileUploadData == NULL)) {
+        // First, determine if there are any log files to be
+        // uploaded: the upload manifest says exactly which,
+        // the log directory is only read if there is none
+        printf("[Checking for log files to upload...]\n");
+        z = buildLogUploadPlan(&pPlan);
+        if (z >= 0) {
 
             LOG(EVENT_LOG_FILES_TO_UPLOAD, z);
             printf("[%d log file(s) to upload]\n", z);
 
             if (z > 0) {
-                gpLoggingServer = new SocketAddress();
-                getAddressFromUrl(pLoggingServerUrl, pBuf, LOGGING_MAX_LEN_SERVER_URL);
-                LOG(EVENT_DNS_LOOKUP, 0);
-                printf("[Looking for logging server URL \"%s\"...]\n", pBuf);
-                if (pNetworkInterface->gethostbyname(pBuf, gpLoggingServer) == 0) {
-                    printf("[Found it at IP address %s]\n", gpLoggingServer->get_ip_address());
-                    if (getPortFromUrl(pLoggingServerUrl, &port)) {
-                        gpLoggingServer->set_port(port);
-                        printf("[Logging server port set to %d]\n", gpLoggingServer->get_port());
-                    } else {
-                        printf("[WARNING: no port number was specified in the logging server URL (\"%s\")]\n",
-                                pLoggingServerUrl);
-                    }
-                } else {
-                    LOG(EVENT_DNS_LOOKUP_FAILURE, 0);
-                    printf("[Unable to locate logging server \"%s\"]\n", pLoggingServerUrl);
-                }
-
-                gpLogUploadThread = new Thread();
-                if (gpLogUploadThread != NULL) {
-                    // Note: this will be destroyed by the log file upload thread when it finishes
-                    gpLogFileUploadData = new LogFileUploadData();
-                    gpLogFileUploadData->pCurrentLogFile = pCurrentLogFile;
-                    gpLogFileUploadData->pFileSystem = pFileSystem;
-                    gpLogFileUploadData->pNetworkInterface = pNetworkInterface;
-                    if (gpLogUploadThread->start(callback(logFileUploadCallback)) == osOK) {
-                        printf("[Log file upload background task is now running]\n");
+                // Note: the address of the logging server is cached so
+                // that uploads which follow don't need to look it up
+                strncpy(_loggingServerUrl, pLoggingServerUrl, sizeof(_loggingServerUrl) - 1);
+                _loggingServerUrl[sizeof(_loggingServerUrl) - 1] = 0;
+                if (getLoggingServerAddress(pNetworkInterface, pLoggingServerUrl, &_loggingServer)) {
+                    // Note: this will be destroyed by the log file upload
+                    // thread, or state machine, when it finishes
+                    _pLogFileUploadData = LOGGING_NEW(_logFileUploadDataStore) LogFileUploadData();
+                    _pLogFileUploadData->pFileSystem = pFileSystem;
+                    _pLogFileUploadData->pNetworkInterface = pNetworkInterface;
+                    _pLogFileUploadData->pPlan = pPlan;
+                    _pLogFileUploadData->numPlanFiles = z;
+                    _pLogFileUploadData->numFiles = 0;
+                    _pLogFileUploadData->numUploaded = 0;
+                    _pLogFileUploadData->numWorkers = 0;
+                    _pLogFileUploadData->pMachine = NULL;
+                    if (_pLogUploadEventQueue != NULL) {
+                        startLogUploadMachine(_pLogUploadEventQueue);
+                        printf("[Log file upload is now running on the event queue]\n");
                         success = true;
+                    } else if ((_pLogUploadThread = LOGGING_NEW(_logUploadThreadStore[0])
+                                                    Thread(osPriorityNormal, OS_STACK_SIZE,
+                                                           LOGGING_STACK(_logUploadStackStore[0]))) != NULL) {
+                        if (_pLogUploadThread->start(callback(this, &LogInstance::logFileUploadCallback)) == osOK) {
+                            printf("[Log file upload background task is now running]\n");
+                            success = true;
+                        } else {
+                            deleteLogFileUploadData();
+                            printf("[Unable to start thread to upload files to logging server]\n");
+                        }
                     } else {
-                        delete gpLogFileUploadData;
-                        gpLogFileUploadData = NULL;
-                        printf("[Unable to start thread to upload files to logging server]\n");
+                        deleteLogFileUploadData();
+                        printf("[Unable to instantiate thread to upload files to logging server]\n");
                     }
                 } else {
-                    printf("[Unable to instantiate thread to upload files to logging server]\n");
+                    // No point in starting without a logging server
+                    LOGGING_DELETE_ARRAY(pPlan);
+                    printf("[Log files will not be uploaded until the logging server is found]\n");
                 }
             } else {
-                success = true; // Nothing to do
+                LOGGING_DELETE_ARRAY(pPlan);
+                success = true; // Nothing to do
+            }
+        }
+    } else {
+        printf("[Log file upload task already running]\n");
+    }
+
+    return success;
+}
+
+// Set the log file upload protocol.
+void LogInstance::setLogFileUploadProtocol(LogUploadProtocol protocol, unsigned int deviceId)
+{
+    _logUploadProtocol = protocol;
+    _logUploadDeviceId = deviceId;
+}
+
+// Set the rate limit on log file upload.
+void setLogFileUploadRate(unsigned int bytesPerSecond, unsigned int burstSize,
+                          bool (*pIdleCallback)(void))
+{
+    gLogUploadRateMutex.lock();
+    gLogUploadBytesPerSecond = bytesPerSecond;
+    gLogUploadBurstSize = burstSize;
+    if (gLogUploadBurstSize == 0) {
+        gLogUploadBurstSize = 1;
+    }
+    // Start with a full bucket
+    gLogUploadTokens = (unsigned long long) gLogUploadBurstSize * 1000000;
+    gLogUploadRateTimer.reset();
+    gLogUploadRateTimer.start();
+    gpLogUploadIdleCallback = pIdleCallback;
+    gLogUploadRateMutex.unlock();
+}
+
+// Set the limits at which a new log file is started.
+void LogInstance::setLogFileRotation(unsigned int maxSize, unsigned int maxAgeSeconds)
+{
+    _logFileMaxSize = maxSize;
+    _logFileMaxAgeSeconds = maxAgeSeconds;
+}
+
+// Set the limits on the log files kept awaiting upload.
+void LogInstance::setLogFileRetention(unsigned int maxTotalSize, int maxNumFiles)
+{
+    _logFileMaxTotalSize = maxTotalSize;
+    _logFileMaxNumFiles = maxNumFiles;
+}
+
+// Set the order in which log files are uploaded.
+void LogInstance::setLogFileUploadOrder(LogUploadOrder order)
+{
+    _logUploadOrder = order;
+}
+
+// Set the number of connections over which to upload log files at once.
+void LogInstance::setLogFileUploadConnections(int numConnections)
+{
+    if (numConnections < 1) {
+        numConnections = 1;
+    }
+    if (numConnections > LOGGING_UPLOAD_MAX_CONNECTIONS) {
+        numConnections = LOGGING_UPLOAD_MAX_CONNECTIONS;
+    }
+    _logUploadNumConnections = numConnections;
+}
+
+// Set the event queue to upload log files on.
+void LogInstance::setLogFileUploadEventQueue(EventQueue *pEventQueue)
+{
+    _pLogUploadEventQueue = pEventQueue;
+}
+
+// Stop uploading previous log files, returning memory.
+void LogInstance::stopLogFileUpload()
+{
+    Timer timer;
+
+    if (_pLogUploadThread != NULL) {
+        // Ask the log file upload threads to stop, which they do
+        // between one buffer and the next, or in the middle of
+        // one rather than wait to send it, closing everything
+        // behind them; the log file upload thread frees the log
+        // file upload data as it finishes
+        _logUploadStop = true;
+        timer.start();
+        while ((_pLogFileUploadData != NULL) &&
+               (timer.read_ms() < LOGGING_UPLOAD_STOP_TIMEOUT_MS)) {
+            wait_ms(LOGGING_UPLOAD_STOP_POLL_MS);
+        }
+        if (_pLogFileUploadData != NULL) {
+            // Too late, stop it dead
+            _pLogUploadThread->terminate();
+        }
+        _pLogUploadThread->join();
+        LOGGING_DELETE(Thread, _pLogUploadThread);
+        _pLogUploadThread = NULL;
+        _logUploadStop = false;
+    }
+
+    // A step of the log upload state machine may be running on
+    // its event queue, in which case wait for it; any step still
+    // posted finds nothing to do
+    _logUploadMachineMutex.lock();
+    if (_pLogFileUploadData != NULL) {
+        if (_pLogFileUploadData->pMachine != NULL) {
+            deleteLogUploadMachine(_pLogFileUploadData->pMachine);
+        }
+        deleteLogUploadWorkers(true);
+        deleteLogFileUploadData();
+    }
+    _logUploadMachineMutex.unlock();
+
+    closeLogUploadWarmSocket();
+}
+
+// Begin streaming the log.
+bool LogInstance::beginLogStream(NetworkInterface *pNetworkInterface,
+                                 const char *pLoggingServerUrl,
+                                 unsigned int deviceId)
+{
+    bool success = false;
+    LogStream *pStream;
+
+    if (_pLogStream == NULL) {
+        pStream = LOGGING_NEW(_logStreamStore) LogStream();
+        pStream->pNetworkInterface = pNetworkInterface;
+        pStream->deviceId = deviceId;
+        pStream->transport = _logStreamTransport;
+        pStream->pInstance = this;
+        pStream->stop = false;
+        pStream->nextIn = 0;
+        pStream->nextSend = 0;
+        pStream->oldest = 0;
+        if (getLoggingServerAddress(pNetworkInterface, pLoggingServerUrl, &(pStream->server))) {
+            pStream->pTcpSock = NULL;
+            pStream->pUdpSock = NULL;
+            if (pStream->transport == LOG_STREAM_TRANSPORT_UDP) {
+                pStream->pUdpSock = LOGGING_NEW(_logStreamSocketStore) UDPSocket();
+            } else {
+                pStream->pTcpSock = LOGGING_NEW(_logStreamSocketStore) TCPSocket();
+            }
+            pStream->pStop = LOGGING_NEW(_logStreamSemaphoreStore) Semaphore(0);
+            pStream->pThread = LOGGING_NEW(_logStreamThreadStore)
+                               Thread(osPriorityNormal, OS_STACK_SIZE,
+                                      LOGGING_STACK(_logStreamStackStore));
+            // From here on writeLog() feeds the stream
+            _logMutex.lock();
+            _pLogStream = pStream;
+            _logMutex.unlock();
+            if (pStream->pThread->start(callback(runLogStream, pStream)) == osOK) {
+                printf("[Log stream background task is now running]\n");
+                success = true;
+            } else {
+                deleteLogStream();
+                printf("[Unable to start thread to stream log to logging server]\n");
             }
         } else {
-            LOG(EVENT_DIR_OPEN_FAILURE, x);
-            printf("[Unable to open path \"%s\" (error %d)]\n", gLogPath, x);
+            LOGGING_DELETE(LogStream, pStream);
         }
-        delete pDir;
     } else {
-        printf("[Log file upload task already running]\n");
+        printf("[Log stream already running]\n");
     }
-    delete pBuf;
 
     return success;
 }
 
-// Stop uploading previous log files, returning memory.
-void stopLogFileUpload()
+// Set the transport over which to stream the log.
+void LogInstance::setLogStreamTransport(LogStreamTransport transport)
 {
-    if (gpLogUploadThread != NULL) {
-        gpLogUploadThread->terminate();
-        gpLogUploadThread->join();
-        delete gpLogUploadThread;
-        gpLogUploadThread = NULL;
-    }
-
-    if (gpLogFileUploadData != NULL) {
-        delete gpLogFileUploadData;
-        gpLogFileUploadData = NULL;
-    }
+    _logStreamTransport = transport;
+}
 
-    if (gpLoggingServer != NULL) {
-        delete gpLoggingServer;
-        gpLoggingServer = NULL;
+// Stop streaming the log; every wait of the stream thread
+// looks at pStream->stop, and is woken by pStream->pStop, so
+// the join is bounded.
+void LogInstance::stopLogStream()
+{
+    if (_pLogStream != NULL) {
+        _pLogStream->stop = true;
+        _pLogStream->pStop->release();
+        _pLogStream->pThread->join();
+        deleteLogStream();
     }
 }
 
@@ -560,44 +3774,51 @@ void stopLogFileUpload()
 // want any overheads or any cause for delay
 // so please just cope with any very occasional
 // logging corruption which may occur
-void LOG(LogEvent event, int parameter)
+void LogInstance::LOG(LogEvent event, int parameter)
 {
-    unsigned int timeStamp = ((unsigned int) gLogTime.read_us()) + gLogTimeOffset;
+    logAt(((unsigned int) _logTime.read_us()) + _fastPath.logTimeOffset, event, parameter);
+}
 
-    if (gpContext->pLogNextEmpty) {
+// Log an event plus parameter at a given timestamp: all of
+// LOG() but reading the timestamp, and what the inline LOG()
+// in log.h calls when it can't simply fill the next entry.
+void LogInstance::logAt(unsigned int timeStamp, LogEvent event, int parameter)
+{
+    // Nothing is logged before initLog() or after deinitLog()
+    if ((_fastPath.pContext != NULL) && _pContext->pLogNextEmpty) {
         // Check if the timestamp has wrapped and
         // insert a log point before this one if that's the
         // case (coding gods: please excuse my recursion)
-        if (timeStamp < gLastLogTime) {
-            gLastLogTime = timeStamp;
-            LOG(EVENT_LOG_TIME_WRAP, timeStamp);
+        if (timeStamp < _fastPath.lastLogTime) {
+            _fastPath.lastLogTime = timeStamp;
+            logAt(timeStamp, EVENT_LOG_TIME_WRAP, timeStamp);
         }
-        gLastLogTime = timeStamp;
-        gpContext->pLogNextEmpty->timestamp = timeStamp;
-        gpContext->pLogNextEmpty->event = (int) event;
-        gpContext->pLogNextEmpty->parameter = parameter;
+        _fastPath.lastLogTime = timeStamp;
+        _pContext->pLogNextEmpty->timestamp = timeStamp;
+        _pContext->pLogNextEmpty->event = (int) event;
+        _pContext->pLogNextEmpty->parameter = parameter;
 #if defined(LOG_PRINT) || defined(LOG_PRINT_ONLY)
-        printLogItem(gpContext->pLogNextEmpty, 0);
+        printLogItem(_pContext->pLogNextEmpty, 0);
 #endif
 #ifndef LOG_PRINT_ONLY
-        if (gpContext->pLogNextEmpty < gpContext->pLog + MAX_NUM_LOG_ENTRIES - 1) {
-            gpContext->pLogNextEmpty++;
+        if (_pContext->pLogNextEmpty < _pContext->pLog + _numLogEntries - 1) {
+            _pContext->pLogNextEmpty++;
         } else {
-            gpContext->pLogNextEmpty = gpContext->pLog;
+            _pContext->pLogNextEmpty = _pContext->pLog;
         }
 
-        if (gpContext->pLogNextEmpty == gpContext->pLogFirstFull) {
+        if (_pContext->pLogNextEmpty == _pContext->pLogFirstFull) {
             // Logging has wrapped, so move the
             // first pointer on to reflect the
             // overwrite
-            if (gpContext->pLogFirstFull < gpContext->pLog + MAX_NUM_LOG_ENTRIES - 1) {
-                gpContext->pLogFirstFull++;
+            if (_pContext->pLogFirstFull < _pContext->pLog + _numLogEntries - 1) {
+                _pContext->pLogFirstFull++;
             } else {
-                gpContext->pLogFirstFull = gpContext->pLog;
+                _pContext->pLogFirstFull = _pContext->pLog;
             }
-            gpContext->logEntriesOverwritten++;
+            _pContext->logEntriesOverwritten++;
         } else {
-            gpContext->numLogItems++;
+            _pContext->numLogItems++;
         }
 #endif
     }
@@ -606,143 +3827,204 @@ void LOG(LogEvent event, int parameter)
 // Log an event plus parameter, this time with mutex.
 // Note: use this version if you don't care about speed
 // so much
-void LOGX(LogEvent event, int parameter)
+void LogInstance::LOGX(LogEvent event, int parameter)
 {
     unsigned int timeStamp;
 
-    gLogMutex.lock();
-    timeStamp = ((unsigned int) gLogTime.read_us()) + gLogTimeOffset;
+    _logMutex.lock();
+    timeStamp = ((unsigned int) _logTime.read_us()) + _fastPath.logTimeOffset;
 
-    if (gpContext->pLogNextEmpty) {
+    // Nothing is logged before initLog() or after deinitLog()
+    if ((_fastPath.pContext != NULL) && _pContext->pLogNextEmpty) {
         // Check if the timestamp has wrapped and
         // insert a log point before this one if that's the
         // case
-        if (timeStamp < gLastLogTime) {
-            gLastLogTime = timeStamp;
+        if (timeStamp < _fastPath.lastLogTime) {
+            _fastPath.lastLogTime = timeStamp;
             LOG(EVENT_LOG_TIME_WRAP, timeStamp);
         }
-        gLastLogTime = timeStamp;
-        gpContext->pLogNextEmpty->timestamp = timeStamp;
-        gpContext->pLogNextEmpty->event = (int) event;
-        gpContext->pLogNextEmpty->parameter = parameter;
+        _fastPath.lastLogTime = timeStamp;
+        _pContext->pLogNextEmpty->timestamp = timeStamp;
+        _pContext->pLogNextEmpty->event = (int) event;
+        _pContext->pLogNextEmpty->parameter = parameter;
 #if defined(LOG_PRINT) || defined(LOG_PRINT_ONLY)
-        printLogItem(gpContext->pLogNextEmpty, 0);
+        printLogItem(_pContext->pLogNextEmpty, 0);
 #endif
 #ifndef LOG_PRINT_ONLY
-        if (gpContext->pLogNextEmpty < gpContext->pLog + MAX_NUM_LOG_ENTRIES - 1) {
-            gpContext->pLogNextEmpty++;
+        if (_pContext->pLogNextEmpty < _pContext->pLog + _numLogEntries - 1) {
+            _pContext->pLogNextEmpty++;
         } else {
-            gpContext->pLogNextEmpty = gpContext->pLog;
+            _pContext->pLogNextEmpty = _pContext->pLog;
         }
 
-        if (gpContext->pLogNextEmpty == gpContext->pLogFirstFull) {
+        if (_pContext->pLogNextEmpty == _pContext->pLogFirstFull) {
             // Logging has wrapped, so move the
             // first pointer on to reflect the
             // overwrite
-            if (gpContext->pLogFirstFull < gpContext->pLog + MAX_NUM_LOG_ENTRIES - 1) {
-                gpContext->pLogFirstFull++;
+            if (_pContext->pLogFirstFull < _pContext->pLog + _numLogEntries - 1) {
+                _pContext->pLogFirstFull++;
             } else {
-                gpContext->pLogFirstFull = gpContext->pLog;
+                _pContext->pLogFirstFull = _pContext->pLog;
             }
-            gpContext->logEntriesOverwritten++;
+            _pContext->logEntriesOverwritten++;
         } else {
-            gpContext->numLogItems++;
+            _pContext->numLogItems++;
         }
 #endif
     }
 
-    gLogMutex.unlock();
+    _logMutex.unlock();
+}
+
+// Write a log entry taken from RAM to the log file and/or
+// the live log stream.
+// Note: log file mutex, and log stream mutex if the log is
+// being streamed, must be locked before calling.
+void LogInstance::writeLogEntry(const LogEntry *pEntry)
+{
+    if (_pFile != NULL) {
+        writeLogFileEntry(pEntry);
+    }
+    if (_pLogStream != NULL) {
+        putLogStreamEntry(pEntry);
+    }
 }
 
 // Flush the log file.
 // Note: log file mutex must be locked before calling.
-void flushLog()
+void LogInstance::flushLog()
 {
-    if (gpFile != NULL) {
-        fclose(gpFile);
-        gpFile = fopen(gCurrentLogFileName, "ab+");
+    if (_pFile != NULL) {
+        fclose(_pFile);
+        _pFile = fopen(_currentLogFileName, "ab+");
     }
 }
 
 // This should be called periodically to write the log
-// to file, if a filename was provided to initLog().
-void writeLog()
+// to file, if a filename was provided to initLog(); it
+// also feeds the live log stream, if there is one.
+void LogInstance::writeLog()
 {
-    if (gLogMutex.trylock()) {
-        if (gpFile != NULL) {
-            gNumWrites++;
-            while (gpContext->pLogNextEmpty != gpContext->pLogFirstFull) {
-                if (gpContext->logEntriesOverwritten > 0) {
-                    LogEntry insert = {gpContext->pLogFirstFull->timestamp,
-                                       EVENT_LOG_ENTRIES_OVERWRITTEN,
-                                       (int) gpContext->logEntriesOverwritten};
-                    fwrite(&insert, sizeof(insert), 1, gpFile);
-                    gpContext->logEntriesOverwritten = 0;
-                }
-                fwrite(gpContext->pLogFirstFull, sizeof(LogEntry), 1, gpFile);
-                if (gpContext->pLogFirstFull < gpContext->pLog + MAX_NUM_LOG_ENTRIES - 1) {
-                    gpContext->pLogFirstFull++;
-                } else {
-                    gpContext->pLogFirstFull = gpContext->pLog;
+    if (_logMutex.trylock()) {
+        if ((_pFile != NULL) || (_pLogStream != NULL)) {
+            _numWrites++;
+            if (_pLogStream != NULL) {
+                _logStreamMutex.lock();
+            }
+            // Without a log file, entries that the stream has no
+            // room for are left in RAM, where any overwriting of
+            // them is counted, rather than being dropped
+            while (((_pFile != NULL) || ((_pLogStream != NULL) && logStreamHasRoom())) &&
+                   (_pContext->pLogNextEmpty != _pContext->pLogFirstFull)) {
+                // Start a new log file if this one is full or old
+                // enough (allowing for an inserted entry), so that
+                // the log is uploaded in pieces of a bounded size
+                if ((_pFile != NULL) && logFileIsDue(2 * sizeof(LogEntry))) {
+                    rotateLogFile();
                 }
-                if (gpContext->numLogItems > 0) {
-                    gpContext->numLogItems--;
+                if ((_pFile != NULL) || (_pLogStream != NULL)) {
+                    if (_pContext->logEntriesOverwritten > 0) {
+                        LogEntry insert = {_pContext->pLogFirstFull->timestamp,
+                                           EVENT_LOG_ENTRIES_OVERWRITTEN,
+                                           (int) _pContext->logEntriesOverwritten};
+                        writeLogEntry(&insert);
+                        _pContext->logEntriesOverwritten = 0;
+                    }
+                    writeLogEntry(_pContext->pLogFirstFull);
+                    if (_pContext->pLogFirstFull < _pContext->pLog + _numLogEntries - 1) {
+                        _pContext->pLogFirstFull++;
+                    } else {
+                        _pContext->pLogFirstFull = _pContext->pLog;
+                    }
+                    if (_pContext->numLogItems > 0) {
+                        _pContext->numLogItems--;
+                    }
                 }
             }
-            if (gNumWrites > LOGGING_NUM_WRITES_BEFORE_FLUSH) {
-                gNumWrites = 0;
+            if (_pLogStream != NULL) {
+                _logStreamMutex.unlock();
+            }
+            if (_numWrites > LOGGING_NUM_WRITES_BEFORE_FLUSH) {
+                _numWrites = 0;
                 flushLog();
             }
         }
-        gLogMutex.unlock();
+        _logMutex.unlock();
     }
 }
 
 // Close down logging.
-void deinitLog()
+void LogInstance::deinitLog()
 {
     stopLogFileUpload(); // Just in case
+    stopLogStream();
 
     LOG(EVENT_LOG_STOP, LOG_VERSION);
-    if (gpFile != NULL) {
+    if (_pFile != NULL) {
         writeLog();
         flushLog(); // Just in case
         LOG(EVENT_LOG_FILE_CLOSE, 0);
-        fclose(gpFile);
-        gpFile = NULL;
+        // Index whatever is left
+        _logMutex.lock();
+        closeLogManifestRecord(_currentLogFileSize);
+        fclose(_pFile);
+        _pFile = NULL;
+        writeLogIndexBlock();
+        _logMutex.unlock();
     }
 
-    gLogTime.stop();
+    _logTime.stop();
 
-    // Don't reset the variables
+    // Nothing more is logged, since the log store may be
+    // given up, but don't reset the other variables
     // here so that printLog() still
     // works afterwards if we're just
     // logging to RAM rather than
     // to file.
+    _fastPath.pContext = NULL;
 }
 
 // Print out the log.
-void printLog()
+void LogInstance::printLog()
+{
+    printLogSince(0);
+}
+
+// Print out the log from a given time onwards.
+void LogInstance::printLogSince(unsigned int timestamp)
 {
-    const LogEntry *pItem = gpContext->pLogNextEmpty;
+    const LogEntry *pItem = _pContext->pLogNextEmpty;
     LogEntry fileItem;
     bool loggingToFile = false;
-    FILE *pFile = gpFile;
-    unsigned int x = 0;
+    bool printing = (timestamp == 0);
+    FILE *pFile = _pFile;
+    int x = 0;
 
-    gLogMutex.lock();
+    _logMutex.lock();
     printf ("------------- Log starts -------------\n");
     if (pFile != NULL) {
         // If we were logging to file, read it back
         // First need to flush the file to disk
         loggingToFile = true;
-        fclose(gpFile);
-        gpFile = NULL;
+        fclose(_pFile);
+        _pFile = NULL;
         LOG(EVENT_LOG_FILE_CLOSE, 0);
-        pFile = fopen(gCurrentLogFileName, "rb");
+        pFile = fopen(_currentLogFileName, "rb");
         if (pFile != NULL) {
             LOG(EVENT_LOG_FILE_OPEN, 0);
+            if (!printing) {
+                // Binary search for the starting point rather
+                // than reading the whole file
+                x = logFileSeek(pFile, timestamp, _logIndexBlock.runStart);
+                if (x < 0) {
+                    x = 0;
+                    rewind(pFile);
+                }
+            }
             while (fread(&fileItem, sizeof(fileItem), 1, pFile) == 1) {
+                // Once there is something from the file, print
+                // everything that follows
+                printing = true;
                 printLogItem(&fileItem, x);
                 x++;
             }
@@ -758,20 +4040,25 @@ void printLog()
     }
 
     // Print the log items remaining in RAM
-    pItem = gpContext->pLogFirstFull;
-    while (pItem != gpContext->pLogNextEmpty) {
-        printLogItem(pItem, x);
+    pItem = _pContext->pLogFirstFull;
+    while (pItem != _pContext->pLogNextEmpty) {
+        if (!printing && (pItem->timestamp >= timestamp)) {
+            printing = true;
+        }
+        if (printing) {
+            printLogItem(pItem, x);
+        }
         x++;
         pItem++;
-        if (pItem >= gpContext->pLog + MAX_NUM_LOG_ENTRIES) {
-            pItem = gpContext->pLog;
+        if (pItem >= _pContext->pLog + _numLogEntries) {
+            pItem = _pContext->pLog;
         }
     }
 
     // Allow writeLog() to resume with the same file name
     if (loggingToFile) {
-        gpFile = fopen(gCurrentLogFileName, "ab+");
-        if (gpFile) {
+        _pFile = fopen(_currentLogFileName, "ab+");
+        if (_pFile) {
             LOG(EVENT_LOG_FILE_OPEN, 0);
         } else {
             LOG(EVENT_LOG_FILE_OPEN_FAILURE, errno);
@@ -780,7 +4067,382 @@ void printLog()
     }
 
     printf ("-------------- Log ends --------------\n");
-    gLogMutex.unlock();
+    _logMutex.unlock();
+}
+
+// The C API, which acts on the first log.
+
+// The slow path of the inline LOG() in log.h.
+void logOutOfLine(unsigned int timeStamp, LogEvent event, int parameter)
+{
+    gLogInstances[0].logAt(timeStamp, event, parameter);
+}
+
+// Log an event plus parameter, this time with mutex.
+void LOGX(LogEvent event, int parameter)
+{
+    gLogInstances[0].LOGX(event, parameter);
+}
+
+// Initialise logging.
+void initLog(void *pBuffer)
+{
+    gLogInstances[0].initLog(pBuffer, MAX_NUM_LOG_ENTRIES);
+}
+
+// Suspend logging.
+void suspendLog()
+{
+    gLogInstances[0].suspendLog();
+}
+
+// Resume logging.
+void resumeLog(unsigned int intervalUSeconds)
+{
+    gLogInstances[0].resumeLog(intervalUSeconds);
+}
+
+// Get the first N log entries.
+int getLog(LogEntry *pEntries, int numEntries)
+{
+    return gLogInstances[0].getLog(pEntries, numEntries);
+}
+
+// Get the number of log entries.
+int getNumLogEntries()
+{
+    return gLogInstances[0].getNumLogEntries();
+}
+
+// Initialise the log file.
+bool initLogFile(const char *pPath)
+{
+    return gLogInstances[0].initLogFile(pPath);
+}
+
+// Set the limits at which a new log file is started.
+void setLogFileRotation(unsigned int maxSize, unsigned int maxAgeSeconds)
+{
+    gLogInstances[0].setLogFileRotation(maxSize, maxAgeSeconds);
+}
+
+// Set the limits on the log files kept awaiting upload.
+void setLogFileRetention(unsigned int maxTotalSize, int maxNumFiles)
+{
+    gLogInstances[0].setLogFileRetention(maxTotalSize, maxNumFiles);
+}
+
+// Upload previous log files.
+bool beginLogFileUpload(FATFileSystem *pFileSystem,
+                        NetworkInterface *pNetworkInterface,
+                        const char *pLoggingServerUrl)
+{
+    return gLogInstances[0].beginLogFileUpload(pFileSystem, pNetworkInterface, pLoggingServerUrl);
+}
+
+// Set the log file upload protocol.
+void setLogFileUploadProtocol(LogUploadProtocol protocol, unsigned int deviceId)
+{
+    gLogInstances[0].setLogFileUploadProtocol(protocol, deviceId);
+}
+
+// Set the number of connections over which to upload log files at once.
+void setLogFileUploadConnections(int numConnections)
+{
+    gLogInstances[0].setLogFileUploadConnections(numConnections);
+}
+
+// Set the order in which log files are uploaded.
+void setLogFileUploadOrder(LogUploadOrder order)
+{
+    gLogInstances[0].setLogFileUploadOrder(order);
+}
+
+// Set the event queue to upload log files on.
+void setLogFileUploadEventQueue(EventQueue *pEventQueue)
+{
+    gLogInstances[0].setLogFileUploadEventQueue(pEventQueue);
+}
+
+// Stop uploading previous log files, returning memory.
+void stopLogFileUpload()
+{
+    gLogInstances[0].stopLogFileUpload();
+}
+
+// Begin streaming the log.
+bool beginLogStream(NetworkInterface *pNetworkInterface,
+                    const char *pLoggingServerUrl,
+                    unsigned int deviceId)
+{
+    return gLogInstances[0].beginLogStream(pNetworkInterface, pLoggingServerUrl, deviceId);
+}
+
+// Set the transport over which to stream the log.
+void setLogStreamTransport(LogStreamTransport transport)
+{
+    gLogInstances[0].setLogStreamTransport(transport);
+}
+
+// Stop streaming the log.
+void stopLogStream()
+{
+    gLogInstances[0].stopLogStream();
+}
+
+// Close down logging.
+void deinitLog()
+{
+    gLogInstances[0].deinitLog();
+}
+
+// This should be called periodically to write the log
+void writeLog()
+{
+    gLogInstances[0].writeLog();
+}
+
+// Print out the log.
+void printLog()
+{
+    gLogInstances[0].printLog();
+}
+
+// Print out the log from a given time onwards.
+void printLogSince(unsigned int timestamp)
+{
+    gLogInstances[0].printLogSince(timestamp);
+}
+
+// Take a log for a LogClient.
+LogClient::LogClient()
+{
+    _pInstance = NULL;
+    _instanceOnHeap = false;
+    gLogInstancesMutex.lock();
+    for (int x = 1; (x < LOGGING_MAX_NUM_CLIENTS + 1) && (_pInstance == NULL); x++) {
+        if (!gLogInstanceTaken[x]) {
+            gLogInstanceTaken[x] = true;
+            // Start afresh from whatever the last LogClient left
+            _pInstance = &(gLogInstances[x]);
+            _pInstance->~LogInstance();
+            new (_pInstance) LogInstance();
+        }
+    }
+    gLogInstancesMutex.unlock();
+#ifndef LOG_STATIC_ALLOCATION
+    if (_pInstance == NULL) {
+        // All taken, make another
+        _pInstance = new LogInstance();
+        _instanceOnHeap = true;
+    }
+#endif
+    if (_pInstance == NULL) {
+        printf("[No log free for a LogClient, increase LOGGING_MAX_NUM_CLIENTS]\n");
+    }
+}
+
+// Close down the log of a LogClient and give it back.
+LogClient::~LogClient()
+{
+    if (_pInstance != NULL) {
+        if (_pInstance->_pContext != NULL) {
+            _pInstance->deinitLog();
+        }
+        if (_instanceOnHeap) {
+            delete _pInstance;
+        } else {
+            gLogInstancesMutex.lock();
+            gLogInstanceTaken[_pInstance - gLogInstances] = false;
+            gLogInstancesMutex.unlock();
+        }
+    }
+}
+
+// Return true if the LogClient has a log.
+bool LogClient::isValid()
+{
+    return (_pInstance != NULL);
+}
+
+// Log an event plus parameter.
+void LogClient::LOG(LogEvent event, int parameter)
+{
+    if (_pInstance != NULL) {
+        _pInstance->LOG(event, parameter);
+    }
+}
+
+// Log an event plus parameter, this time with mutex.
+void LogClient::LOGX(LogEvent event, int parameter)
+{
+    if (_pInstance != NULL) {
+        _pInstance->LOGX(event, parameter);
+    }
+}
+
+// Initialise logging.
+void LogClient::initLog(void *pBuffer, int numEntries)
+{
+    if (_pInstance != NULL) {
+        _pInstance->initLog(pBuffer, numEntries);
+    }
+}
+
+// Suspend logging.
+void LogClient::suspendLog()
+{
+    if (_pInstance != NULL) {
+        _pInstance->suspendLog();
+    }
+}
+
+// Resume logging.
+void LogClient::resumeLog(unsigned int intervalUSeconds)
+{
+    if (_pInstance != NULL) {
+        _pInstance->resumeLog(intervalUSeconds);
+    }
+}
+
+// Get the first N log entries.
+int LogClient::getLog(LogEntry *pEntries, int numEntries)
+{
+    return (_pInstance != NULL) ? _pInstance->getLog(pEntries, numEntries) : 0;
+}
+
+// Get the number of log entries.
+int LogClient::getNumLogEntries()
+{
+    return (_pInstance != NULL) ? _pInstance->getNumLogEntries() : 0;
+}
+
+// Initialise the log file.
+bool LogClient::initLogFile(const char *pPath)
+{
+    return (_pInstance != NULL) && _pInstance->initLogFile(pPath);
+}
+
+// Set the limits at which a new log file is started.
+void LogClient::setLogFileRotation(unsigned int maxSize, unsigned int maxAgeSeconds)
+{
+    if (_pInstance != NULL) {
+        _pInstance->setLogFileRotation(maxSize, maxAgeSeconds);
+    }
+}
+
+// Set the limits on the log files kept awaiting upload.
+void LogClient::setLogFileRetention(unsigned int maxTotalSize, int maxNumFiles)
+{
+    if (_pInstance != NULL) {
+        _pInstance->setLogFileRetention(maxTotalSize, maxNumFiles);
+    }
+}
+
+// Upload previous log files.
+bool LogClient::beginLogFileUpload(FATFileSystem *pFileSystem,
+                                   NetworkInterface *pNetworkInterface,
+                                   const char *pLoggingServerUrl)
+{
+    return (_pInstance != NULL) &&
+           _pInstance->beginLogFileUpload(pFileSystem, pNetworkInterface, pLoggingServerUrl);
+}
+
+// Set the log file upload protocol.
+void LogClient::setLogFileUploadProtocol(LogUploadProtocol protocol, unsigned int deviceId)
+{
+    if (_pInstance != NULL) {
+        _pInstance->setLogFileUploadProtocol(protocol, deviceId);
+    }
+}
+
+// Set the number of connections over which to upload log files at once.
+void LogClient::setLogFileUploadConnections(int numConnections)
+{
+    if (_pInstance != NULL) {
+        _pInstance->setLogFileUploadConnections(numConnections);
+    }
+}
+
+// Set the order in which log files are uploaded.
+void LogClient::setLogFileUploadOrder(LogUploadOrder order)
+{
+    if (_pInstance != NULL) {
+        _pInstance->setLogFileUploadOrder(order);
+    }
+}
+
+// Set the event queue to upload log files on.
+void LogClient::setLogFileUploadEventQueue(EventQueue *pEventQueue)
+{
+    if (_pInstance != NULL) {
+        _pInstance->setLogFileUploadEventQueue(pEventQueue);
+    }
+}
+
+// Stop uploading previous log files, returning memory.
+void LogClient::stopLogFileUpload()
+{
+    if (_pInstance != NULL) {
+        _pInstance->stopLogFileUpload();
+    }
+}
+
+// Begin streaming the log.
+bool LogClient::beginLogStream(NetworkInterface *pNetworkInterface,
+                               const char *pLoggingServerUrl,
+                               unsigned int deviceId)
+{
+    return (_pInstance != NULL) &&
+           _pInstance->beginLogStream(pNetworkInterface, pLoggingServerUrl, deviceId);
+}
+
+// Set the transport over which to stream the log.
+void LogClient::setLogStreamTransport(LogStreamTransport transport)
+{
+    if (_pInstance != NULL) {
+        _pInstance->setLogStreamTransport(transport);
+    }
+}
+
+// Stop streaming the log.
+void LogClient::stopLogStream()
+{
+    if (_pInstance != NULL) {
+        _pInstance->stopLogStream();
+    }
+}
+
+// Close down logging.
+void LogClient::deinitLog()
+{
+    if (_pInstance != NULL) {
+        _pInstance->deinitLog();
+    }
+}
+
+// This should be called periodically to write the log
+void LogClient::writeLog()
+{
+    if (_pInstance != NULL) {
+        _pInstance->writeLog();
+    }
+}
+
+// Print out the log.
+void LogClient::printLog()
+{
+    if (_pInstance != NULL) {
+        _pInstance->printLog();
+    }
+}
+
+// Print out the log from a given time onwards.
+void LogClient::printLogSince(unsigned int timestamp)
+{
+    if (_pInstance != NULL) {
+        _pInstance->printLogSince(timestamp);
+    }
 }
 
 // End of file
@@ -25,6 +25,7 @@
 #include "stdbool.h"
 #include "FATFileSystem.h"
 #include "log_enum.h"
+#include "log_entry.h"
 
 #ifndef _LOG_
 #define _LOG_
@@ -39,27 +40,141 @@
 # define MAX_NUM_LOG_ENTRIES 500
 #endif
 
+/** The number of LogClients whose logs are set aside statically,
+ * in addition to the log of the C API, each costing as much RAM as
+ * that of the C API (with MBED_CONF_APP_LOG_STATIC_ALLOCATION, tens
+ * of kbytes), so this is 0 unless LogClient is used.  Beyond these
+ * the log of a LogClient is allocated from the heap, except with
+ * MBED_CONF_APP_LOG_STATIC_ALLOCATION, where this is the number of
+ * LogClients there may be at once.
+ */
+#ifndef LOGGING_MAX_NUM_CLIENTS
+# define LOGGING_MAX_NUM_CLIENTS 0
+#endif
+
 // Increase this from 1 to skip flushing on file writes if the
 // processor load of writing the log file is too high.
 #ifndef LOGGING_NUM_WRITES_BEFORE_FLUSH
 # define LOGGING_NUM_WRITES_BEFORE_FLUSH 1
 #endif
 
+// The size of each of the buffers through which log files are
+// read and sent to the logging server during upload; larger
+// buffers make for fewer, more efficient, file reads and sends.
+#ifndef LOGGING_UPLOAD_BUFFER_SIZE
+# define LOGGING_UPLOAD_BUFFER_SIZE (128 * sizeof(LogEntry))
+#endif
+
+// The number of upload buffers: one is filled from the log file
+// while another is being sent, so there must be at least two.
+#ifndef LOGGING_UPLOAD_NUM_BUFFERS
+# define LOGGING_UPLOAD_NUM_BUFFERS 3
+#endif
+
+// The stack size of the thread which reads log files during upload.
+#ifndef LOGGING_UPLOAD_READER_STACK_SIZE
+# define LOGGING_UPLOAD_READER_STACK_SIZE 2048
+#endif
+
+// The maximum number of connections over which log files
+// may be uploaded at once, each with a thread and
+// LOGGING_UPLOAD_NUM_BUFFERS buffers of its own.
+#ifndef LOGGING_UPLOAD_MAX_CONNECTIONS
+# define LOGGING_UPLOAD_MAX_CONNECTIONS 4
+#endif
+
+// How long, in seconds, the address of a logging server is used
+// for once it has been looked up, before it is looked up again.
+#ifndef LOGGING_DNS_CACHE_SECONDS
+# define LOGGING_DNS_CACHE_SECONDS 3600
+#endif
+
+// How long, in seconds, a failure to look up the address of a
+// logging server is remembered, during which it isn't tried again.
+#ifndef LOGGING_DNS_NEGATIVE_CACHE_SECONDS
+# define LOGGING_DNS_NEGATIVE_CACHE_SECONDS 60
+#endif
+
+// How long, in seconds, the connection to the logging server is
+// kept open after an upload with the framed protocol, for the next
+// beginLogFileUpload() to use; 0 to close it straight away.
+#ifndef LOGGING_UPLOAD_WARM_CONNECTION_SECONDS
+# define LOGGING_UPLOAD_WARM_CONNECTION_SECONDS 60
+#endif
+
+// The number of attempts made at uploading a log file, when they
+// fail, before it is left for the next beginLogFileUpload().
+#ifndef LOGGING_UPLOAD_MAX_FILE_ATTEMPTS
+# define LOGGING_UPLOAD_MAX_FILE_ATTEMPTS 3
+#endif
+
+// The delay, in milliseconds, before the first retry of a failed
+// log file upload; each retry after that waits twice as long as
+// the one before, up to LOGGING_UPLOAD_RETRY_MAX_MS, less a random
+// amount of up to half so that devices don't retry in step (seeded
+// from the MAC address and device ID, see beginLogFileUpload()).
+#ifndef LOGGING_UPLOAD_RETRY_BASE_MS
+# define LOGGING_UPLOAD_RETRY_BASE_MS 1000
+#endif
+
+// The longest delay, in milliseconds, before a retry of a failed
+// log file upload.
+#ifndef LOGGING_UPLOAD_RETRY_MAX_MS
+# define LOGGING_UPLOAD_RETRY_MAX_MS 60000
+#endif
+
+// The number of times in a row that the connection to the logging
+// server may fail before log file upload gives up on it.
+#ifndef LOGGING_UPLOAD_MAX_FAILURES
+# define LOGGING_UPLOAD_MAX_FAILURES 5
+#endif
+
+// How long, in seconds, log file upload is not tried again once
+// it has given up on the connection to the logging server.
+#ifndef LOGGING_UPLOAD_BACK_OFF_SECONDS
+# define LOGGING_UPLOAD_BACK_OFF_SECONDS 600
+#endif
+
+// How long, in milliseconds, stopLogFileUpload() waits for log
+// file upload to stop of its own accord before stopping it dead;
+// since it may be blocked on the socket for one socket timeout
+// (LOGGING_UPLOAD_TIMEOUT_MS in log.cpp) this should be longer.
+#ifndef LOGGING_UPLOAD_STOP_TIMEOUT_MS
+# define LOGGING_UPLOAD_STOP_TIMEOUT_MS 11000
+#endif
+
+// The number of log entries which may wait to be streamed to
+// the logging server (see beginLogStream()), e.g. while it can't
+// be reached, in addition to those in RAM.
+#ifndef LOGGING_STREAM_BUFFER_ENTRIES
+# define LOGGING_STREAM_BUFFER_ENTRIES 128
+#endif
+
+// The most log entries streamed in one frame, which must fit
+// in LOG_PROTOCOL_MAX_ENTRIES_SIZE.
+#ifndef LOGGING_STREAM_MAX_BATCH
+# define LOGGING_STREAM_MAX_BATCH 32
+#endif
+
+// How often, in milliseconds, new log entries are streamed.
+#ifndef LOGGING_STREAM_INTERVAL_MS
+# define LOGGING_STREAM_INTERVAL_MS 1000
+#endif
+
+// When the library is built not to allocate memory itself
+// (MBED_CONF_APP_LOG_STATIC_ALLOCATION), the number of log files
+// awaiting upload that the upload manifest is read for at a time;
+// beyond this the oldest are taken first and the rest are left
+// for the next beginLogFileUpload(), which looks through the log
+// directory for them again.
+#ifndef LOGGING_STATIC_MAX_LOG_FILES
+# define LOGGING_STATIC_MAX_LOG_FILES 64
+#endif
+
 /* ----------------------------------------------------------------
  * TYPES
  * -------------------------------------------------------------- */
 
-/** An entry in the log.
- */
-typedef struct {
-    unsigned int timestamp;
-    int event; // This will be LogEvent but it is stored as an int
-               // so that we are guaranteed to get a 32-bit value,
-               // making it easier to decode logs on another platform
-    int parameter;
-} LogEntry;
-
-
 /** Type used to store logging context data.
  */
 typedef struct {
@@ -72,9 +187,56 @@ typedef struct {
     unsigned int logEntriesOverwritten;
 } LogContext;
 
+/** What LOG() works on, for the inline part of LOG() below;
+ * the application should leave it alone.
+ */
+typedef struct {
+    LogContext *pContext;       //!< the log store, NULL before initLog()
+                                //!< and after deinitLog().
+    LogEntry *pLogLast;         //!< the last entry of the log store.
+    Timer *pLogTime;            //!< the logging timestamp.
+    unsigned int logTimeOffset; //!< the offset in the logging timestamp.
+    unsigned int lastLogTime;   //!< the last logging timestamp.
+} LogFastPath;
+
+/** The protocols with which log files may be uploaded to
+ * a logging server.
+ */
+typedef enum {
+    LOG_UPLOAD_PROTOCOL_LEGACY, //!< the raw contents of each log file
+                                //!< over its own TCP connection.
+    LOG_UPLOAD_PROTOCOL_FRAMED  //!< all log files over one TCP connection,
+                                //!< each preceded by a header (see
+                                //!< log_protocol.h).
+} LogUploadProtocol;
+
+/** The orders in which log files may be uploaded.
+ */
+typedef enum {
+    LOG_UPLOAD_ORDER_OLDEST_FIRST,   //!< the order in which they were
+                                     //!< created.
+    LOG_UPLOAD_ORDER_NEWEST_FIRST,   //!< the most recent log file first.
+    LOG_UPLOAD_ORDER_SEVERE_FIRST,   //!< log files containing a severe
+                                     //!< event ("*" prefix) first, then
+                                     //!< newest first.
+    LOG_UPLOAD_ORDER_SMALLEST_FIRST  //!< the smallest log file first.
+} LogUploadOrder;
+
+/** The transports over which the log may be streamed.
+ */
+typedef enum {
+    LOG_STREAM_TRANSPORT_TCP, //!< a TCP connection.
+    LOG_STREAM_TRANSPORT_UDP  //!< UDP datagrams, lost ones being
+                              //!< sent again on request.
+} LogStreamTransport;
+
+/** The size of the log store for a given number of entries.
+ */
+#define LOG_STORE_SIZE_ENTRIES(numEntries) (sizeof(LogContext) + (sizeof(LogEntry) * (numEntries)))
+
 /** The size of the log store, given the number of entries requested.
  */
-#define LOG_STORE_SIZE (sizeof(LogContext) + (sizeof(LogEntry) * MAX_NUM_LOG_ENTRIES))
+#define LOG_STORE_SIZE LOG_STORE_SIZE_ENTRIES(MAX_NUM_LOG_ENTRIES)
 
 /* ----------------------------------------------------------------
  * FUNCTIONS
@@ -84,12 +246,60 @@ typedef struct {
 extern "C" {
 #endif
 
-/** Log an event plus parameter.
+/** What LOG() works on; for LOG() only.
+ */
+extern LogFastPath * const gpLogFastPath;
+
+/** The slow path of LOG(), for where the timestamp has
+ * wrapped, the log store has wrapped or is full, or
+ * LOG_PRINT/LOG_PRINT_ONLY is defined; for LOG() only.
+ *
+ * @param timeStamp the timestamp.
+ * @param event     the event.
+ * @param parameter the parameter.
+ */
+void logOutOfLine(unsigned int timeStamp, LogEvent event, int parameter);
+
+/** Log an event plus parameter; before initLog() and after
+ * deinitLog() this does nothing.  This is inline so that, other
+ * than reading the logging timestamp, the usual case of filling
+ * the next entry of the log store costs no call; anything else
+ * is left to logOutOfLine().
  *
  * @param event     the event.
  * @param parameter the parameter.
  */
-void LOG(LogEvent event, int parameter);
+static inline void LOG(LogEvent event, int parameter)
+{
+    LogFastPath *pFastPath = gpLogFastPath;
+    LogContext *pContext = pFastPath->pContext;
+    unsigned int timeStamp;
+#if !defined(LOG_PRINT) && !defined(LOG_PRINT_ONLY)
+    LogEntry *pEntry;
+#endif
+
+    if (pContext != NULL) {
+        timeStamp = ((unsigned int) pFastPath->pLogTime->read_us()) + pFastPath->logTimeOffset;
+#if defined(LOG_PRINT) || defined(LOG_PRINT_ONLY)
+        logOutOfLine(timeStamp, event, parameter);
+#else
+        pEntry = pContext->pLogNextEmpty;
+        if ((pEntry != NULL) &&
+            (timeStamp >= pFastPath->lastLogTime) &&
+            (pEntry < pFastPath->pLogLast) &&
+            (pEntry + 1 != pContext->pLogFirstFull)) {
+            pFastPath->lastLogTime = timeStamp;
+            pEntry->timestamp = timeStamp;
+            pEntry->event = (int) event;
+            pEntry->parameter = parameter;
+            pContext->pLogNextEmpty = pEntry + 1;
+            pContext->numLogItems++;
+        } else {
+            logOutOfLine(timeStamp, event, parameter);
+        }
+#endif
+    }
+}
 
 /** Log an event plus parameter, employing
  * a mutex to protect the log contents.
@@ -155,7 +365,56 @@ int getNumLogEntries();
  */
 bool initLogFile(const char *pPath);
 
-/** Begin upload of log files to a logging server.
+/** Set when writeLog() is to close the current log file and
+ * start a new one, so that the log is kept, and uploaded, in
+ * pieces of a bounded size rather than one file per
+ * initLogFile() that grows for ever; a closed log file can be
+ * uploaded by the next beginLogFileUpload() while logging
+ * carries on.  By default there is no limit.
+ *
+ * @param maxSize       the size, in bytes, beyond which a log
+ *                      file is not allowed to grow, 0 for no
+ *                      limit.
+ * @param maxAgeSeconds the time after which a log file is closed
+ *                      (at the next writeLog() that has anything
+ *                      to write), 0 for no limit.
+ */
+void setLogFileRotation(unsigned int maxSize, unsigned int maxAgeSeconds);
+
+/** Set a limit on the log files kept awaiting upload, so that
+ * they can't fill the file system if they can't be uploaded:
+ * when a new log file is started, the oldest log files are
+ * deleted until those left are within the limits, logging
+ * EVENT_LOG_FILE_DISCARDED for each.  Log files are not deleted
+ * while an upload is in progress.  By default there is no
+ * limit.
+ *
+ * @param maxTotalSize the total size, in bytes, of the log files
+ *                     awaiting upload, 0 for no limit.
+ * @param maxNumFiles  the number of log files awaiting upload,
+ *                     0 for no limit.
+ */
+void setLogFileRetention(unsigned int maxTotalSize, int maxNumFiles);
+
+/** Begin upload of log files to a logging server.  The address
+ * of the logging server is cached for LOGGING_DNS_CACHE_SECONDS
+ * (and a failure to find it for LOGGING_DNS_NEGATIVE_CACHE_SECONDS,
+ * in which case nothing is uploaded) so that periodic uploads
+ * don't each pay for a lookup.  With the framed protocol the
+ * connection is kept open for LOGGING_UPLOAD_WARM_CONNECTION_SECONDS
+ * after the upload, for the next beginLogFileUpload() to use;
+ * stopLogFileUpload() closes it.
+ *
+ * A log file whose upload fails is tried again, after a delay
+ * which doubles each time (see LOGGING_UPLOAD_RETRY_BASE_MS), up
+ * to LOGGING_UPLOAD_MAX_FILE_ATTEMPTS times; the random part of the
+ * delay is seeded from the MAC address of pNetworkInterface and the
+ * device ID of setLogFileUploadProtocol(), so where there is no MAC
+ * address give each device its own device ID.  If the connection
+ * to the logging server fails LOGGING_UPLOAD_MAX_FAILURES times in
+ * a row, EVENT_SOCKET_ERRORS_FOR_TOO_LONG is logged, the upload
+ * stops and nothing is uploaded for LOGGING_UPLOAD_BACK_OFF_SECONDS;
+ * after that the first failure stops it again.
  *
  * @param pFileSysem        a pointer to the file system where
  *                          the logs are stored.
@@ -170,15 +429,167 @@ bool beginLogFileUpload(FATFileSystem *pFileSystem,
                         NetworkInterface *pNetworkInterface,
                         const char *pLoggingServerUrl);
 
-/** Stop uploading log files to the logging server and free resources.
+/** Set the protocol with which log files are uploaded; if
+ * this is not called LOG_UPLOAD_PROTOCOL_LEGACY is used, which
+ * any logging server understands.  Call this before
+ * beginLogFileUpload().
+ *
+ * @param protocol the protocol to use.
+ * @param deviceId an ID for this device, sent with each log
+ *                 file in the framed protocol so that the
+ *                 logging server can tell devices apart.
+ */
+void setLogFileUploadProtocol(LogUploadProtocol protocol, unsigned int deviceId);
+
+/** Limit the rate at which log files are uploaded, so that
+ * the upload doesn't starve the application of bandwidth.
+ * The limit is a token bucket: bytes may be sent at up to
+ * bytesPerSecond on average, in bursts of up to burstSize
+ * bytes.  The rate achieved for each log file is logged as
+ * EVENT_LOG_FILE_UPLOAD_RATE, in bytes per second.  May be
+ * called at any time.
+ *
+ * @param bytesPerSecond the average rate limit, 0 for no limit.
+ * @param burstSize      the most that may be sent in one go
+ *                       after a quiet period; a value of at
+ *                       least LOGGING_UPLOAD_BUFFER_SIZE is best.
+ * @param pIdleCallback  if not NULL, log files are only uploaded
+ *                       while this function returns true, e.g.
+ *                       while the application isn't using the
+ *                       network itself; it is polled every
+ *                       100 ms while it returns false.
+ */
+void setLogFileUploadRate(unsigned int bytesPerSecond, unsigned int burstSize,
+                          bool (*pIdleCallback)(void));
+
+/** Set the number of connections over which log files are
+ * uploaded at once, each uploading a different log file.  On
+ * a link where the round trip time rather than the bandwidth
+ * limits the upload, e.g. cellular, several connections finish
+ * the job sooner than one; each costs a thread, a socket and
+ * LOGGING_UPLOAD_NUM_BUFFERS buffers.  Log files are still each
+ * deleted only once they have been uploaded in full.  The
+ * default is 1; this has no effect on upload on an event queue,
+ * which always uses one connection.  Call this before
+ * beginLogFileUpload().
+ *
+ * @param numConnections the number of connections, limited to
+ *                       between 1 and LOGGING_UPLOAD_MAX_CONNECTIONS.
+ */
+void setLogFileUploadConnections(int numConnections);
+
+/** Set the order in which log files are uploaded, so that when
+ * a device only gets a short window of connectivity the most
+ * valuable log files go first.  The plan is made once, when
+ * beginLogFileUpload() looks for log files to upload, from the
+ * size and severity recorded in the upload manifest when each
+ * log file was closed; for a log file which wasn't closed
+ * (e.g. because of a reset) whether it contains a severe event
+ * is found from the bloom filters in its index file, a log file
+ * without an index file being taken not to.  The default is
+ * LOG_UPLOAD_ORDER_OLDEST_FIRST.  Call this before
+ * beginLogFileUpload().
+ *
+ * @param order the order in which to upload log files.
+ */
+void setLogFileUploadOrder(LogUploadOrder order);
+
+/** Set an event queue on which log files are to be uploaded.
+ * By default beginLogFileUpload() starts a thread which uploads
+ * the log files with blocking sockets; if an event queue is set
+ * the upload is instead run as a state machine on that event
+ * queue, driven by the non-blocking socket, which makes a little
+ * progress each time the socket is ready and yields between
+ * each LOGGING_UPLOAD_BUFFER_SIZE of the log file.  This saves
+ * the RAM of the thread stacks and lets the upload share the
+ * event queue with the application.  Call this before
+ * beginLogFileUpload(); stopLogFileUpload() may then be called
+ * from any thread, waiting for a step of the state machine that
+ * is running on the event queue to finish.
+ *
+ * @param pEventQueue the event queue, NULL to go back to
+ *                    uploading in a thread.
+ */
+void setLogFileUploadEventQueue(EventQueue *pEventQueue);
+
+/** Stop uploading log files to the logging server and free
+ * resources, closing any connection kept open for the next upload.
+ * The upload stops between one buffer and the next, or part-way
+ * through a buffer rather than wait for the rate limit, the idle
+ * callback or a send that timed out to be retried, closing the
+ * log file and the connection behind it, so that a log file which
+ * was part-way through is simply uploaded again (or, with the
+ * framed protocol, resumed) by the next beginLogFileUpload();
+ * only if it hasn't stopped within LOGGING_UPLOAD_STOP_TIMEOUT_MS
+ * are its threads stopped dead.
  */
 void stopLogFileUpload();
 
-/** Close down logging.
+/** Begin streaming the log to a logging server as it is logged,
+ * rather than only uploading log files afterwards, so that it
+ * can be seen within seconds; this works with or without a file
+ * system.  A thread takes the new log entries from RAM every
+ * LOGGING_STREAM_INTERVAL_MS, by calling writeLog() (so that
+ * they are still written to the log file, if there is one), and
+ * sends them in batches of up to LOGGING_STREAM_MAX_BATCH over a
+ * TCP connection of its own (or as UDP datagrams, see
+ * setLogStreamTransport()) using LOG_FRAME_ENTRIES frames of
+ * the framed protocol (see log_protocol.h), connecting again if
+ * the connection fails.  Up to LOGGING_STREAM_BUFFER_ENTRIES
+ * entries wait to be sent while the logging server can't be
+ * reached or the log is busier than the link; beyond that,
+ * without a log file, entries are left in RAM, where the oldest
+ * are overwritten as usual (and counted, the count being
+ * streamed), while with a log file the oldest are dropped from
+ * the stream, leaving a gap in the sequence numbers of the
+ * batches, though not from the log file.  The stream keeps
+ * to the rate limit and idle condition set by
+ * setLogFileUploadRate().  Don't call getLog() while streaming,
+ * since both take entries from RAM.
+ *
+ * @param pNetworkInterface a pointer to the network interface
+ *                          to use.
+ * @param pLoggingServerUrl the logging server to connect to
+ *                          (including port number).
+ * @param deviceId          an ID for this device, sent with each
+ *                          batch so that the logging server can
+ *                          tell devices apart.
+ * @return                  true if streaming begins successfully,
+ *                          otherwise false.
+ */
+bool beginLogStream(NetworkInterface *pNetworkInterface,
+                    const char *pLoggingServerUrl,
+                    unsigned int deviceId);
+
+/** Set the transport over which the log is streamed.  With
+ * LOG_STREAM_TRANSPORT_TCP, the default, a connection is set up
+ * and kept.  With LOG_STREAM_TRANSPORT_UDP each batch is sent as
+ * a single datagram, with no connection to set up or keep, which
+ * suits frequent small batches on links such as NB-IoT; the
+ * logging server finds lost datagrams from the gaps in the
+ * sequence numbers and asks for them again, and those entries
+ * which are still in the LOGGING_STREAM_BUFFER_ENTRIES ring are
+ * sent again.  Call this before beginLogStream().
+ *
+ * @param transport the transport to use.
+ */
+void setLogStreamTransport(LogStreamTransport transport);
+
+/** Stop streaming the log, sending whatever is left first if
+ * there is a connection to the logging server and that can be
+ * done without waiting for the rate limit, and free resources.
+ * This returns within one send timeout of the connection.
+ */
+void stopLogStream();
+
+/** Close down logging; nothing more is logged until initLog()
+ * is called again, but printLog() still works while the log
+ * store is kept.
  */
 void deinitLog();
 
-/** Write the logging buffer to the log file.
+/** Write the logging buffer to the log file and/or, if the log
+ * is being streamed, to the stream.
  */
 void writeLog();
 
@@ -186,10 +597,173 @@ void writeLog();
  */
 void printLog();
 
+/** Print out the logged items from a given time onwards.
+ * Where the log is being written to file the starting
+ * point in the file is found with a binary search (see
+ * logFileSeek() in log_reader.h) rather than by reading
+ * the file from the start, so this is much quicker than
+ * printLog() for looking at the end of a large log.
+ *
+ * @param timestamp the log time, in microseconds, to print
+ *                  from; 0 prints everything.
+ */
+void printLogSince(unsigned int timestamp);
+
 #ifdef __cplusplus
 }
 #endif
 
+#ifdef __cplusplus
+
+class LogInstance;
+
+/** A log of its own, for where one isn't enough: e.g. a small
+ * log which a radio stack logs to at a high rate alongside a
+ * large one for application events, each with its own store,
+ * log file and logging server, written and uploaded independently
+ * of the other.  The methods are the functions of the C API
+ * above, acting on this log rather than that of the C API; each
+ * log must be given a directory of its own for its log files.
+ * The rate limit of setLogFileUploadRate() is shared by all logs,
+ * since they share the network.  The logs of up to
+ * LOGGING_MAX_NUM_CLIENTS LogClients are set aside statically and
+ * any more are allocated from the heap; with
+ * MBED_CONF_APP_LOG_STATIC_ALLOCATION there can be no more, so
+ * define it to the number needed and check isValid().
+ */
+class LogClient {
+public:
+    /** Take a log of its own.
+     */
+    LogClient();
+
+    /** Close down the log (see deinitLog()) and give it back.
+     */
+    ~LogClient();
+
+    /** Find out whether this LogClient got a log of its own,
+     * which it can only fail to with
+     * MBED_CONF_APP_LOG_STATIC_ALLOCATION when there are already
+     * LOGGING_MAX_NUM_CLIENTS LogClients.  If it didn't, every
+     * method does nothing, returning false or 0.
+     *
+     * @return true if this LogClient has a log.
+     */
+    bool isValid();
+
+    /** See LOG().
+     */
+    void LOG(LogEvent event, int parameter);
+
+    /** See LOGX().
+     */
+    void LOGX(LogEvent event, int parameter);
+
+    /** Initialise logging, as initLog() but with a store
+     * of a given size.
+     *
+     * @param pBuffer    must point to LOG_STORE_SIZE_ENTRIES(numEntries)
+     *                   bytes of storage.
+     * @param numEntries the number of log entries (must be 1
+     *                   or greater).
+     */
+    void initLog(void *pBuffer, int numEntries = MAX_NUM_LOG_ENTRIES);
+
+    /** See suspendLog().
+     */
+    void suspendLog();
+
+    /** See resumeLog().
+     */
+    void resumeLog(unsigned int intervalUSeconds);
+
+    /** See getLog().
+     */
+    int getLog(LogEntry *pEntries, int numEntries);
+
+    /** See getNumLogEntries().
+     */
+    int getNumLogEntries();
+
+    /** See initLogFile().
+     */
+    bool initLogFile(const char *pPath);
+
+    /** See setLogFileRotation().
+     */
+    void setLogFileRotation(unsigned int maxSize, unsigned int maxAgeSeconds);
+
+    /** See setLogFileRetention().
+     */
+    void setLogFileRetention(unsigned int maxTotalSize, int maxNumFiles);
+
+    /** See beginLogFileUpload().
+     */
+    bool beginLogFileUpload(FATFileSystem *pFileSystem,
+                            NetworkInterface *pNetworkInterface,
+                            const char *pLoggingServerUrl);
+
+    /** See setLogFileUploadProtocol().
+     */
+    void setLogFileUploadProtocol(LogUploadProtocol protocol, unsigned int deviceId);
+
+    /** See setLogFileUploadConnections().
+     */
+    void setLogFileUploadConnections(int numConnections);
+
+    /** See setLogFileUploadOrder().
+     */
+    void setLogFileUploadOrder(LogUploadOrder order);
+
+    /** See setLogFileUploadEventQueue().
+     */
+    void setLogFileUploadEventQueue(EventQueue *pEventQueue);
+
+    /** See stopLogFileUpload().
+     */
+    void stopLogFileUpload();
+
+    /** See beginLogStream().
+     */
+    bool beginLogStream(NetworkInterface *pNetworkInterface,
+                        const char *pLoggingServerUrl,
+                        unsigned int deviceId);
+
+    /** See setLogStreamTransport().
+     */
+    void setLogStreamTransport(LogStreamTransport transport);
+
+    /** See stopLogStream().
+     */
+    void stopLogStream();
+
+    /** See deinitLog().
+     */
+    void deinitLog();
+
+    /** See writeLog().
+     */
+    void writeLog();
+
+    /** See printLog().
+     */
+    void printLog();
+
+    /** See printLogSince().
+     */
+    void printLogSince(unsigned int timestamp);
+
+private:
+    // A log can't be shared
+    LogClient(const LogClient &);
+    LogClient &operator=(const LogClient &);
+
+    LogInstance *_pInstance;
+    bool _instanceOnHeap;   // True if _pInstance is not one set aside
+};
+
+#endif
+
 #endif
 
 // End of file
@@ -0,0 +1,42 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The format of a single log entry, as held in RAM and as
+ * written to log files.  This is kept free of any mbed
+ * dependencies so that it can be included by host-side
+ * tools which decode log files.
+ */
+
+#ifndef _LOG_ENTRY_
+#define _LOG_ENTRY_
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+/** An entry in the log.
+ */
+typedef struct {
+    unsigned int timestamp;
+    int event; // This will be LogEvent but it is stored as an int
+               // so that we are guaranteed to get a 32-bit value,
+               // making it easier to decode logs on another platform
+    int parameter;
+} LogEntry;
+
+#endif
+
+// End of file
@@ -17,8 +17,11 @@ extern "C" {
 //                EVENT_LOG_OVERWRITE_ENDED and add
 //                EVENT_LOG_ENTRIES_OVERWRITTEN
 // LOG_VERSION 4: add EVENT_LOG_RESTART
+// LOG_VERSION 5: add EVENT_LOG_FILE_UPLOAD_RATE
+// LOG_VERSION 6: add EVENT_LOG_FILE_DISCARDED
+// LOG_VERSION 7: add EVENT_LOG_FILE_ALREADY_UPLOADED
 
-#define LOG_VERSION 4
+#define LOG_VERSION 7
 
 // The possible events for the RAM log
 // If you add an item here, don't forget to
@@ -68,6 +71,9 @@ typedef enum {
     EVENT_SOCKET_BAD,
     EVENT_SOCKET_ERRORS_FOR_TOO_LONG,
     EVENT_TCP_SEND_TIMEOUT,
+    EVENT_LOG_FILE_UPLOAD_RATE,
+    EVENT_LOG_FILE_DISCARDED,
+    EVENT_LOG_FILE_ALREADY_UPLOADED,
     // Generic log points for the user, do not change
     EVENT_USER_0,
     EVENT_USER_1,
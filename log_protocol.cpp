@@ -0,0 +1,149 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "log_protocol.h"
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The CRC32 of each value of a nibble, so that a CRC32 can be
+// worked out a nibble at a time for 64 bytes of table.
+static const unsigned int gCrc32NibbleTable[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Write a little-endian 32-bit value.
+static void putUint32(char *pBuf, unsigned int value)
+{
+    *pBuf = (char) value;
+    *(pBuf + 1) = (char) (value >> 8);
+    *(pBuf + 2) = (char) (value >> 16);
+    *(pBuf + 3) = (char) (value >> 24);
+}
+
+// Read a little-endian 32-bit value.
+static unsigned int getUint32(const char *pBuf)
+{
+    return ((unsigned int) (unsigned char) *pBuf) |
+           (((unsigned int) (unsigned char) *(pBuf + 1)) << 8) |
+           (((unsigned int) (unsigned char) *(pBuf + 2)) << 16) |
+           (((unsigned int) (unsigned char) *(pBuf + 3)) << 24);
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Encode a frame.
+int logFrameEncode(const LogFrame *pFrame, char *pBuf)
+{
+    int lenName = strlen(pFrame->name);
+
+    if (lenName > LOG_PROTOCOL_MAX_LEN_NAME) {
+        lenName = LOG_PROTOCOL_MAX_LEN_NAME;
+    }
+
+    putUint32(pBuf, LOG_PROTOCOL_MAGIC);
+    *(pBuf + 4) = (char) pFrame->type;
+    *(pBuf + 5) = (char) lenName;
+    *(pBuf + 6) = (char) LOG_PROTOCOL_VERSION;
+    *(pBuf + 7) = 0;
+    putUint32(pBuf + 8, pFrame->deviceId);
+    putUint32(pBuf + 12, pFrame->size);
+    putUint32(pBuf + 16, pFrame->crc);
+    memcpy(pBuf + LOG_PROTOCOL_HEADER_SIZE, pFrame->name, lenName);
+
+    return LOG_PROTOCOL_HEADER_SIZE + lenName;
+}
+
+// Decode the header of a frame.
+int logFrameDecodeHeader(const char *pBuf, LogFrame *pFrame)
+{
+    int lenName = -1;
+
+    if (logFrameIsStart(pBuf)) {
+        lenName = (unsigned char) *(pBuf + 5);
+        if (lenName > LOG_PROTOCOL_MAX_LEN_NAME) {
+            lenName = -1;
+        }
+        pFrame->type = (LogFrameType) *(pBuf + 4);
+        pFrame->deviceId = getUint32(pBuf + 8);
+        pFrame->size = getUint32(pBuf + 12);
+        pFrame->crc = getUint32(pBuf + 16);
+        pFrame->name[0] = 0;
+    }
+
+    return lenName;
+}
+
+// Decode the name of a frame.
+void logFrameDecodeName(const char *pBuf, int length, LogFrame *pFrame)
+{
+    if (length > LOG_PROTOCOL_MAX_LEN_NAME) {
+        length = LOG_PROTOCOL_MAX_LEN_NAME;
+    }
+    memcpy(pFrame->name, pBuf, length);
+    pFrame->name[length] = 0;
+}
+
+// Encode the sequence number of a batch of entries.
+void logFrameEncodeSequence(unsigned int sequence, char *pBuf)
+{
+    putUint32(pBuf, sequence);
+}
+
+// Decode the sequence number of a batch of entries.
+unsigned int logFrameDecodeSequence(const char *pBuf)
+{
+    return getUint32(pBuf);
+}
+
+// Check for the start of a frame.
+bool logFrameIsStart(const char *pBuf)
+{
+    return (getUint32(pBuf) == LOG_PROTOCOL_MAGIC) &&
+           (*(pBuf + 6) == (char) LOG_PROTOCOL_VERSION);
+}
+
+// Calculate a CRC32, a nibble at a time: since it is worked
+// out for every entry that writeLog() writes this is over twice as
+// fast as bit-wise, while a table of 16 entries, unlike the
+// 1 kbyte of a byte-wise table, costs next to nothing.
+unsigned int logCrc32(unsigned int crc, const void *pData, int length)
+{
+    const unsigned char *pByte = (const unsigned char *) pData;
+
+    crc = ~crc;
+    for (int x = 0; x < length; x++) {
+        crc ^= *pByte;
+        pByte++;
+        crc = (crc >> 4) ^ gCrc32NibbleTable[crc & 0x0F];
+        crc = (crc >> 4) ^ gCrc32NibbleTable[crc & 0x0F];
+    }
+
+    return ~crc;
+}
+
+// End of file
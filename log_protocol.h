@@ -0,0 +1,224 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The framed protocol for uploading log files to a logging server.
+ *
+ * In the legacy protocol each log file is sent as the raw contents
+ * of its own TCP connection; the logging server separates files by
+ * connection.  In the framed protocol any number of log files are
+ * sent over a single TCP connection, each one preceded by a header
+ * frame which carries the name, size and CRC32 of the file and the
+ * ID of the device it came from:
+ *
+ * offset  size  field
+ *      0     4  magic number, LOG_PROTOCOL_MAGIC
+ *      4     1  frame type, a LogFrameType
+ *      5     1  the length of the name which follows the header
+ *      6     1  protocol version, LOG_PROTOCOL_VERSION
+ *      7     1  reserved, 0
+ *      8     4  device ID
+ *     12     4  size of the file in bytes
+ *     16     4  CRC32 of the file
+ *     20     n  name of the file, no terminator
+ *
+ * A LOG_FRAME_FILE header is sent by the device, to which the
+ * logging server replies with a LOG_FRAME_ACK header, with the same
+ * name, whose size field is the number of bytes of the file (as
+ * identified by device ID, name, size and CRC32) that it already
+ * has, e.g. from an earlier upload that was interrupted.  The device
+ * then sends the rest of the file from that offset, after which the
+ * logging server checks the CRC32 of the whole file and replies
+ * with a second LOG_FRAME_ACK whose size field is the size of the
+ * file or, if the check failed, zero.  Only then may the device
+ * delete the file.  The next LOG_FRAME_FILE header may then follow.
+ * A LOG_FRAME_END header (with all other fields zero) ends the
+ * session.  All values are little-endian.  A legacy log file starts with a LogEntry, the
+ * seventh byte of which is the third byte of an event number and
+ * hence zero, whereas the protocol version is not, so a server can
+ * support both protocols by looking at the first eight bytes of a
+ * connection (see logFrameIsStart()).
+ *
+ * A device may also stream its log as it is logged (see
+ * beginLogStream()), over a connection of its own, in batches of
+ * entries: each is a LOG_FRAME_ENTRIES header with an empty name,
+ * whose size field is the number of bytes which follow, at most
+ * LOG_PROTOCOL_MAX_ENTRIES_SIZE, and whose CRC32 field is that of
+ * those bytes.  They are the sequence number of the first entry of
+ * the batch (4 bytes), counting from zero when the stream began,
+ * then the LogEntry structures themselves, as they would be in a
+ * log file.  Batches are not acknowledged; a gap in the sequence
+ * numbers means that entries were lost.
+ *
+ * Batches may instead be streamed as UDP datagrams, each holding
+ * one LOG_FRAME_ENTRIES frame; since datagrams may be lost, the
+ * logging server may then send the device a LOG_FRAME_RESEND
+ * datagram, a header with an empty name whose size field is a
+ * number of entries, followed by the sequence number of the first
+ * of them, to which the device replies by sending again, as new
+ * LOG_FRAME_ENTRIES datagrams, those of them that it still has.
+ *
+ * This depends only on the C library so that it can be used by
+ * the target and by a host-side logging server.
+ */
+
+#ifndef _LOG_PROTOCOL_
+#define _LOG_PROTOCOL_
+
+#include <stdbool.h>
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+/** The magic number at the start of every frame ("ULOG").
+ */
+#define LOG_PROTOCOL_MAGIC 0x474f4c55
+
+/** The version of the framed protocol.
+ */
+#define LOG_PROTOCOL_VERSION 1
+
+/** The size of a frame header, excluding the name.
+ */
+#define LOG_PROTOCOL_HEADER_SIZE 20
+
+/** The number of bytes at the start of a connection needed
+ * by logFrameIsStart().
+ */
+#define LOG_PROTOCOL_START_SIZE 8
+
+/** The maximum length of the name in a frame.
+ */
+#define LOG_PROTOCOL_MAX_LEN_NAME 32
+
+/** The maximum size of an encoded frame.
+ */
+#define LOG_PROTOCOL_MAX_FRAME_SIZE (LOG_PROTOCOL_HEADER_SIZE + LOG_PROTOCOL_MAX_LEN_NAME)
+
+/** The maximum number of bytes which may follow a
+ * LOG_FRAME_ENTRIES header.
+ */
+#define LOG_PROTOCOL_MAX_ENTRIES_SIZE 4096
+
+/** The size of the sequence number at the start of the
+ * bytes following a LOG_FRAME_ENTRIES header.
+ */
+#define LOG_PROTOCOL_SEQUENCE_SIZE 4
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+/** The types of frame.
+ */
+typedef enum {
+    LOG_FRAME_NONE = 0,
+    LOG_FRAME_FILE = 1,
+    LOG_FRAME_END = 2,
+    LOG_FRAME_ACK = 3,
+    LOG_FRAME_ENTRIES = 4,
+    LOG_FRAME_RESEND = 5
+} LogFrameType;
+
+/** A frame, decoded.
+ */
+typedef struct {
+    LogFrameType type;
+    unsigned int deviceId;
+    unsigned int size;
+    unsigned int crc;
+    char name[LOG_PROTOCOL_MAX_LEN_NAME + 1];
+} LogFrame;
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Encode a frame.
+ *
+ * @param pFrame the frame; a name longer than
+ *               LOG_PROTOCOL_MAX_LEN_NAME is truncated.
+ * @param pBuf   a buffer of at least LOG_PROTOCOL_MAX_FRAME_SIZE
+ *               bytes.
+ * @return       the number of bytes encoded.
+ */
+int logFrameEncode(const LogFrame *pFrame, char *pBuf);
+
+/** Decode the fixed-length header of a frame.
+ *
+ * @param pBuf   LOG_PROTOCOL_HEADER_SIZE bytes.
+ * @param pFrame a place to put the frame; the name is
+ *               set to empty.
+ * @return       the length of the name which follows the
+ *               header, negative if this is not a valid frame.
+ */
+int logFrameDecodeHeader(const char *pBuf, LogFrame *pFrame);
+
+/** Decode the name of a frame, which follows the header.
+ *
+ * @param pBuf   the name, of the length returned by
+ *               logFrameDecodeHeader().
+ * @param length the length of the name.
+ * @param pFrame the frame to put the name in.
+ */
+void logFrameDecodeName(const char *pBuf, int length, LogFrame *pFrame);
+
+/** Encode the sequence number which starts the bytes
+ * following a LOG_FRAME_ENTRIES header.
+ *
+ * @param sequence the sequence number of the first entry.
+ * @param pBuf     a buffer of at least LOG_PROTOCOL_SEQUENCE_SIZE
+ *                 bytes.
+ */
+void logFrameEncodeSequence(unsigned int sequence, char *pBuf);
+
+/** Decode the sequence number which starts the bytes
+ * following a LOG_FRAME_ENTRIES header.
+ *
+ * @param pBuf LOG_PROTOCOL_SEQUENCE_SIZE bytes.
+ * @return     the sequence number of the first entry.
+ */
+unsigned int logFrameDecodeSequence(const char *pBuf);
+
+/** Determine whether the start of a connection is a frame
+ * rather than a log file sent with the legacy protocol.
+ *
+ * @param pBuf the first LOG_PROTOCOL_START_SIZE bytes received.
+ * @return     true if pBuf is the start of a frame.
+ */
+bool logFrameIsStart(const char *pBuf);
+
+/** Calculate a CRC32 (IEEE 802.3, as used by zlib), which
+ * may be done in pieces.
+ *
+ * @param crc    the CRC so far, 0 to begin with.
+ * @param pData  the data.
+ * @param length the length of the data.
+ * @return       the CRC including the data.
+ */
+unsigned int logCrc32(unsigned int crc, const void *pData, int length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+// End of file
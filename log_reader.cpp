@@ -0,0 +1,483 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <limits.h>
+#include <string.h>
+#include "log_enum.h"
+#include "log_reader.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The number of bits in the bloom filter of an index block.
+#define LOG_INDEX_BLOOM_BITS (LOG_INDEX_BLOOM_WORDS * 32)
+
+// The number of entries read in one go when scanning.
+#define LOG_READER_SCAN_ENTRIES 32
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Binary search for the first entry in the range
+// (lower, upper] with a timestamp at or after the given
+// time and no later than maxTimestamp, assuming that
+// entry upper is known to qualify.
+static int findInRange(FILE *pFile, int lower, int upper,
+                       unsigned int timestamp, unsigned int maxTimestamp)
+{
+    LogEntry entry;
+    int middle;
+
+    while ((upper >= 0) && (upper - lower > 1)) {
+        middle = lower + (upper - lower) / 2;
+        if (logFileReadEntry(pFile, middle, &entry)) {
+            if ((entry.timestamp >= timestamp) &&
+                (entry.timestamp <= maxTimestamp)) {
+                upper = middle;
+            } else {
+                lower = middle;
+            }
+        } else {
+            upper = -1;
+        }
+    }
+
+    return upper;
+}
+
+// Return true if an event starts a new run.
+static bool isRunStart(int event)
+{
+    return (event == EVENT_LOG_TIME_WRAP) ||
+           (event == EVENT_LOG_START) ||
+           (event == EVENT_LOG_START_AGAIN);
+}
+
+// The two bloom filter bit positions of an event.
+static unsigned int bloomBitA(int event)
+{
+    return (((unsigned int) event * 0x9E3779B1) >> 16) % LOG_INDEX_BLOOM_BITS;
+}
+
+static unsigned int bloomBitB(int event)
+{
+    return (((unsigned int) event * 0x85EBCA77) >> 16) % LOG_INDEX_BLOOM_BITS;
+}
+
+// Return true if an entry is wanted by logIndexFind().
+static bool isWanted(const LogEntry *pEntry, int event,
+                     unsigned int minTimestamp, unsigned int maxTimestamp)
+{
+    return ((event < 0) || (pEntry->event == event)) &&
+           (pEntry->timestamp >= minTimestamp) &&
+           (pEntry->timestamp <= maxTimestamp);
+}
+
+// Read entries [firstEntry, endEntry) of a log file in order,
+// calling pCallback for those that are wanted; returns the number
+// found, negative on error, and sets *pStop if the callback
+// asked to stop.
+static int scanEntries(FILE *pFile, int firstEntry, int endEntry, int event,
+                       unsigned int minTimestamp, unsigned int maxTimestamp,
+                       LogIndexFindCallback pCallback, void *pParam, bool *pStop)
+{
+    LogEntry entries[LOG_READER_SCAN_ENTRIES];
+    int numFound = 0;
+    int index = firstEntry;
+    int wanted;
+    int got;
+
+    if ((index < endEntry) &&
+        (fseek(pFile, (long) index * sizeof(LogEntry), SEEK_SET) != 0)) {
+        numFound = -1;
+    }
+
+    while ((numFound >= 0) && !*pStop && (index < endEntry)) {
+        wanted = endEntry - index;
+        if (wanted > LOG_READER_SCAN_ENTRIES) {
+            wanted = LOG_READER_SCAN_ENTRIES;
+        }
+        got = fread(entries, sizeof(LogEntry), wanted, pFile);
+        for (int x = 0; (x < got) && !*pStop; x++) {
+            if (isWanted(&entries[x], event, minTimestamp, maxTimestamp)) {
+                numFound++;
+                if ((pCallback != NULL) &&
+                    !pCallback(&entries[x], index + x, pParam)) {
+                    *pStop = true;
+                }
+            }
+        }
+        index += got;
+        if (got < wanted) {
+            numFound = -1;
+        }
+    }
+
+    return numFound;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Get the number of entries in a log file.
+int logFileNumEntries(FILE *pFile)
+{
+    long size = -1;
+
+    if (fseek(pFile, 0, SEEK_END) == 0) {
+        size = ftell(pFile);
+    }
+
+    return (size >= 0) ? (int) (size / sizeof(LogEntry)) : -1;
+}
+
+// Read a single entry from a log file.
+bool logFileReadEntry(FILE *pFile, int index, LogEntry *pEntry)
+{
+    return (index >= 0) &&
+           (fseek(pFile, (long) index * sizeof(LogEntry), SEEK_SET) == 0) &&
+           (fread(pEntry, sizeof(*pEntry), 1, pFile) == 1);
+}
+
+// Find a time in an ordered range of a log file.
+int logFileFindTime(FILE *pFile, int firstEntry, int numEntries,
+                    unsigned int timestamp)
+{
+    LogEntry entry;
+    int index = firstEntry + numEntries;
+
+    if (numEntries > 0) {
+        if (logFileReadEntry(pFile, index - 1, &entry)) {
+            if (entry.timestamp >= timestamp) {
+                index = findInRange(pFile, firstEntry - 1, index - 1,
+                                    timestamp, entry.timestamp);
+            }
+        } else {
+            index = -1;
+        }
+    }
+
+    return index;
+}
+
+// Find a time in the last run of a log file.
+int logFileSeek(FILE *pFile, unsigned int timestamp, int runStart)
+{
+    LogEntry entry;
+    unsigned int lastTimestamp;
+    unsigned int previousTimestamp;
+    int numEntries = logFileNumEntries(pFile);
+    int index = numEntries;
+    int previous;
+    int probe;
+    int step;
+
+    if ((numEntries > 0) && (runStart >= 0) && (runStart < numEntries)) {
+        // Exact: the run is known
+        index = logFileFindTime(pFile, runStart, numEntries - runStart, timestamp);
+    } else if (numEntries > 0) {
+        if (logFileReadEntry(pFile, numEntries - 1, &entry)) {
+            lastTimestamp = entry.timestamp;
+            if (lastTimestamp >= timestamp) {
+                // Gallop backwards from the end while the entries
+                // are in order and not earlier than timestamp
+                previous = numEntries - 1;
+                previousTimestamp = lastTimestamp;
+                probe = previous;
+                for (step = 1; probe >= 0; step <<= 1) {
+                    probe = previous - step;
+                    if (probe >= 0) {
+                        if (!logFileReadEntry(pFile, probe, &entry)) {
+                            previous = -1;
+                            break;
+                        }
+                        if ((entry.timestamp < timestamp) ||
+                            (entry.timestamp > previousTimestamp)) {
+                            break;
+                        }
+                        previous = probe;
+                        previousTimestamp = entry.timestamp;
+                    }
+                }
+                if (probe < 0) {
+                    probe = -1;
+                }
+                // The answer is now in (probe, previous]
+                index = findInRange(pFile, probe, previous, timestamp, lastTimestamp);
+            }
+        } else {
+            index = -1;
+        }
+    }
+
+    // Leave the file positioned at the entry found
+    if ((index >= 0) && (fseek(pFile, (long) index * sizeof(LogEntry), SEEK_SET) != 0)) {
+        index = -1;
+    }
+
+    return index;
+}
+
+// Start a new index block.
+void logIndexBlockInit(LogIndexBlock *pBlock, unsigned int firstEntry,
+                       unsigned int runStart)
+{
+    memset(pBlock, 0, sizeof(*pBlock));
+    pBlock->firstEntry = firstEntry;
+    pBlock->runStart = runStart;
+    pBlock->minTimestamp = UINT_MAX;
+    pBlock->maxTimestamp = 0;
+}
+
+// Add an entry to an index block.
+void logIndexBlockAdd(LogIndexBlock *pBlock, const LogEntry *pEntry)
+{
+    unsigned int bit;
+
+    if (isRunStart(pEntry->event)) {
+        pBlock->runStart = pBlock->firstEntry + pBlock->numEntries;
+    }
+    if (pEntry->timestamp < pBlock->minTimestamp) {
+        pBlock->minTimestamp = pEntry->timestamp;
+    }
+    if (pEntry->timestamp > pBlock->maxTimestamp) {
+        pBlock->maxTimestamp = pEntry->timestamp;
+    }
+    bit = bloomBitA(pEntry->event);
+    pBlock->bloom[bit >> 5] |= 1U << (bit & 0x1f);
+    bit = bloomBitB(pEntry->event);
+    pBlock->bloom[bit >> 5] |= 1U << (bit & 0x1f);
+    pBlock->numEntries++;
+}
+
+// Determine whether an index block may contain an event.
+bool logIndexBlockMayContain(const LogIndexBlock *pBlock, int event)
+{
+    unsigned int bitA = bloomBitA(event);
+    unsigned int bitB = bloomBitB(event);
+
+    return ((pBlock->bloom[bitA >> 5] & (1U << (bitA & 0x1f))) != 0) &&
+           ((pBlock->bloom[bitB >> 5] & (1U << (bitB & 0x1f))) != 0);
+}
+
+// Write the header of an index file.
+bool logIndexWriteHeader(FILE *pIndexFile)
+{
+    LogIndexHeader header = {LOG_INDEX_MAGIC, LOG_INDEX_VERSION,
+                             LOG_INDEX_BLOCK_ENTRIES, LOG_INDEX_BLOOM_WORDS};
+
+    return fwrite(&header, sizeof(header), 1, pIndexFile) == 1;
+}
+
+// Append a block to an index file.
+bool logIndexWriteBlock(FILE *pIndexFile, const LogIndexBlock *pBlock)
+{
+    return fwrite(pBlock, sizeof(*pBlock), 1, pIndexFile) == 1;
+}
+
+// Build the index of a log file.
+int logIndexBuild(FILE *pFile, FILE *pIndexFile)
+{
+    LogEntry entries[LOG_READER_SCAN_ENTRIES];
+    LogIndexBlock block;
+    int numBlocks = 0;
+    int got;
+
+    logIndexBlockInit(&block, 0, 0);
+    rewind(pFile);
+    if (!logIndexWriteHeader(pIndexFile)) {
+        numBlocks = -1;
+    }
+
+    do {
+        got = fread(entries, sizeof(LogEntry), LOG_READER_SCAN_ENTRIES, pFile);
+        for (int x = 0; (x < got) && (numBlocks >= 0); x++) {
+            logIndexBlockAdd(&block, &entries[x]);
+            if (block.numEntries >= LOG_INDEX_BLOCK_ENTRIES) {
+                if (logIndexWriteBlock(pIndexFile, &block)) {
+                    numBlocks++;
+                    logIndexBlockInit(&block, block.firstEntry + block.numEntries, block.runStart);
+                } else {
+                    numBlocks = -1;
+                }
+            }
+        }
+    } while ((got > 0) && (numBlocks >= 0));
+
+    if ((numBlocks >= 0) && (block.numEntries > 0)) {
+        if (logIndexWriteBlock(pIndexFile, &block)) {
+            numBlocks++;
+        } else {
+            numBlocks = -1;
+        }
+    }
+
+    return numBlocks;
+}
+
+// Check an index file and get the number of blocks in it.
+int logIndexNumBlocks(FILE *pIndexFile)
+{
+    LogIndexHeader header;
+    long size = -1;
+    int numBlocks = -1;
+
+    rewind(pIndexFile);
+    if ((fread(&header, sizeof(header), 1, pIndexFile) == 1) &&
+        (header.magic == LOG_INDEX_MAGIC) &&
+        (header.version == LOG_INDEX_VERSION) &&
+        (header.bloomWords == LOG_INDEX_BLOOM_WORDS) &&
+        (fseek(pIndexFile, 0, SEEK_END) == 0)) {
+        size = ftell(pIndexFile);
+        if (size >= (long) sizeof(header)) {
+            numBlocks = (size - sizeof(header)) / sizeof(LogIndexBlock);
+        }
+    }
+
+    return numBlocks;
+}
+
+// Read a block from an index file.
+bool logIndexReadBlock(FILE *pIndexFile, int index, LogIndexBlock *pBlock)
+{
+    return (index >= 0) &&
+           (fseek(pIndexFile, sizeof(LogIndexHeader) + (long) index * sizeof(*pBlock), SEEK_SET) == 0) &&
+           (fread(pBlock, sizeof(*pBlock), 1, pIndexFile) == 1);
+}
+
+// Find the first entry of the last run of a log file.
+int logIndexRunStart(FILE *pFile, FILE *pIndexFile)
+{
+    LogEntry entry;
+    LogIndexBlock block;
+    int numEntries = logFileNumEntries(pFile);
+    int numBlocks = logIndexNumBlocks(pIndexFile);
+    int runStart = -1;
+    int index = 0;
+
+    if ((numEntries >= 0) && (numBlocks >= 0)) {
+        runStart = 0;
+        if ((numBlocks > 0) && logIndexReadBlock(pIndexFile, numBlocks - 1, &block)) {
+            runStart = block.runStart;
+            index = block.firstEntry + block.numEntries;
+        }
+        // Check the entries that are not yet indexed
+        if ((index < numEntries) &&
+            (fseek(pFile, (long) index * sizeof(LogEntry), SEEK_SET) != 0)) {
+            runStart = -1;
+        }
+        for (; (runStart >= 0) && (index < numEntries); index++) {
+            if (fread(&entry, sizeof(entry), 1, pFile) == 1) {
+                if (isRunStart(entry.event)) {
+                    runStart = index;
+                }
+            } else {
+                runStart = -1;
+            }
+        }
+        if (runStart >= numEntries) {
+            // The index is not for this log file
+            runStart = -1;
+        }
+    }
+
+    return runStart;
+}
+
+// Find entries with the help of an index.
+int logIndexFind(FILE *pFile, FILE *pIndexFile, int event,
+                 unsigned int minTimestamp, unsigned int maxTimestamp,
+                 LogIndexFindCallback pCallback, void *pParam)
+{
+    LogIndexBlock block;
+    int numEntries = logFileNumEntries(pFile);
+    int numBlocks = -1;
+    int numFound = 0;
+    int indexedEnd = 0;
+    int firstEntry;
+    int endEntry;
+    int x;
+    bool stop = false;
+
+    if (pIndexFile != NULL) {
+        // An invalid index is treated as no index
+        numBlocks = logIndexNumBlocks(pIndexFile);
+    }
+
+    if (numEntries < 0) {
+        numFound = -1;
+    }
+
+    // indexedEnd is the end of the entries covered so far, by
+    // the index or by reading them; a block which couldn't be
+    // read, or was never written, leaves a gap which is read
+    // like the entries after the last block
+    for (int y = 0; (y < numBlocks) && (numFound >= 0) && !stop; y++) {
+        if (logIndexReadBlock(pIndexFile, y, &block)) {
+            firstEntry = block.firstEntry;
+            if (firstEntry > numEntries) {
+                firstEntry = numEntries;
+            }
+            endEntry = block.firstEntry + block.numEntries;
+            if (endEntry > numEntries) {
+                endEntry = numEntries;
+            }
+            if (firstEntry > indexedEnd) {
+                x = scanEntries(pFile, indexedEnd, firstEntry, event,
+                                minTimestamp, maxTimestamp, pCallback, pParam, &stop);
+                if (x >= 0) {
+                    numFound += x;
+                    indexedEnd = firstEntry;
+                } else {
+                    numFound = -1;
+                }
+            }
+            if ((numFound >= 0) && !stop && (endEntry > indexedEnd) &&
+                ((event < 0) || logIndexBlockMayContain(&block, event)) &&
+                (block.minTimestamp <= maxTimestamp) &&
+                (block.maxTimestamp >= minTimestamp)) {
+                x = scanEntries(pFile, indexedEnd, endEntry, event,
+                                minTimestamp, maxTimestamp, pCallback, pParam, &stop);
+                if (x >= 0) {
+                    numFound += x;
+                } else {
+                    numFound = -1;
+                }
+            }
+            if (endEntry > indexedEnd) {
+                indexedEnd = endEntry;
+            }
+        }
+    }
+
+    // Whatever isn't covered by the index has to be read
+    if ((numFound >= 0) && !stop && (indexedEnd < numEntries)) {
+        x = scanEntries(pFile, indexedEnd, numEntries, event,
+                        minTimestamp, maxTimestamp, pCallback, pParam, &stop);
+        if (x >= 0) {
+            numFound += x;
+        } else {
+            numFound = -1;
+        }
+    }
+
+    return numFound;
+}
+
+// End of file
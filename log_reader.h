@@ -0,0 +1,282 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Functions to read log files written by writeLog() without
+ * scanning them from the start.  These depend only on stdio so
+ * that the same code can be used on the target and by host-side
+ * tools.
+ *
+ * Entries in a log file are of fixed size and timestamps increase
+ * within a "run": a run ends where the timestamp wraps (the first
+ * entry of the next run is an EVENT_LOG_TIME_WRAP) or where logging
+ * is restarted (EVENT_LOG_START/EVENT_LOG_START_AGAIN).
+ *
+ * A log file may be accompanied by a sidecar index file, of the
+ * same name but with the extension LOG_INDEX_FILE_EXTENSION, which
+ * summarises each block of LOG_INDEX_BLOCK_ENTRIES entries: the
+ * range of timestamps in the block, a bloom filter of the events
+ * in the block and where the run containing the end of the block
+ * started.  Queries can then skip the blocks which cannot contain
+ * what they are looking for.  The index is written by the log
+ * client as the log file is written and can be built for any
+ * log file with logIndexBuild().
+ */
+
+#ifndef _LOG_READER_
+#define _LOG_READER_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "log_entry.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+/** The number of log entries summarised by each block of an
+ * index file.  This is only used when writing an index, the
+ * value is stored in the index file for readers.
+ */
+#ifndef LOG_INDEX_BLOCK_ENTRIES
+# define LOG_INDEX_BLOCK_ENTRIES 256
+#endif
+
+/** The extension of an index file.
+ */
+#define LOG_INDEX_FILE_EXTENSION ".idx"
+
+/** The magic number at the start of an index file.
+ */
+#define LOG_INDEX_MAGIC 0x58444e49
+
+/** The version of the index file format.
+ */
+#define LOG_INDEX_VERSION 1
+
+/** The number of 32-bit words in the bloom filter of a block.
+ */
+#define LOG_INDEX_BLOOM_WORDS 4
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+/** The header at the start of an index file.
+ */
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int blockEntries;
+    unsigned int bloomWords;
+} LogIndexHeader;
+
+/** The summary of a block of entries in a log file.
+ */
+typedef struct {
+    unsigned int firstEntry;
+    unsigned int numEntries;
+    unsigned int minTimestamp;
+    unsigned int maxTimestamp;
+    unsigned int runStart; // The index of the first entry of the
+                           // run which the last entry of the
+                           // block is part of
+    unsigned int bloom[LOG_INDEX_BLOOM_WORDS];
+} LogIndexBlock;
+
+/** Callback for each entry found by logIndexFind().
+ *
+ * @param pEntry the entry.
+ * @param index  the index of the entry in the log file.
+ * @param pParam the parameter passed to logIndexFind().
+ * @return       true to continue, false to stop the search.
+ */
+typedef bool (*LogIndexFindCallback)(const LogEntry *pEntry, int index, void *pParam);
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Get the number of whole entries in a log file.
+ *
+ * @param pFile the log file, opened for reading.
+ * @return      the number of entries, negative on error.
+ */
+int logFileNumEntries(FILE *pFile);
+
+/** Read a single entry from a log file.
+ *
+ * @param pFile  the log file, opened for reading.
+ * @param index  the index of the entry.
+ * @param pEntry a place to put the entry.
+ * @return       true if the entry was read, otherwise false.
+ */
+bool logFileReadEntry(FILE *pFile, int index, LogEntry *pEntry);
+
+/** Find the first entry with a timestamp at or after a given
+ * time in a range of entries which is known to be in timestamp
+ * order (i.e. lies within a single run) using a binary search,
+ * so O(log n) reads.
+ *
+ * @param pFile      the log file, opened for reading.
+ * @param firstEntry the index of the first entry of the range.
+ * @param numEntries the number of entries in the range.
+ * @param timestamp  the time to look for.
+ * @return           the index of the entry found, firstEntry +
+ *                   numEntries if every entry in the range is
+ *                   earlier than timestamp, negative on error.
+ */
+int logFileFindTime(FILE *pFile, int firstEntry, int numEntries,
+                    unsigned int timestamp);
+
+/** Find the first entry at or after a given time within the
+ * last run of a log file, leaving the file positioned at that
+ * entry so that it can be read onwards with fread().
+ *
+ * If the index of the first entry of the last run is known
+ * (the log client keeps track of it for the file it is writing
+ * and logIndexRunStart() gets it from an index file) the search
+ * is exact.  If not, pass -1 and the start of the run
+ * is estimated by galloping backwards from the end of the file
+ * (reading entries 1, 2, 4, 8, etc. back) until an entry earlier
+ * than timestamp, or later than the one before it, is found;
+ * this is exact unless the galloping steps over the whole of an
+ * earlier, shorter, run whose timestamps happen to lie between
+ * timestamp and the timestamp of the last entry in the file.
+ * Either way the cost is O(log n) reads.
+ *
+ * @param pFile     the log file, opened for reading.
+ * @param timestamp the time to look for.
+ * @param runStart  the index of the first entry of the last
+ *                  run, -1 if not known.
+ * @return          the index of the entry found, the number of
+ *                  entries in the file if there is no entry at or
+ *                  after timestamp in the last run, negative on
+ *                  error.
+ */
+int logFileSeek(FILE *pFile, unsigned int timestamp, int runStart);
+
+/** Start a new index block.
+ *
+ * @param pBlock     the block.
+ * @param firstEntry the index of the first entry in the block.
+ * @param runStart   the index of the first entry of the run
+ *                   which is in progress.
+ */
+void logIndexBlockInit(LogIndexBlock *pBlock, unsigned int firstEntry,
+                       unsigned int runStart);
+
+/** Add an entry to an index block.
+ *
+ * @param pBlock the block.
+ * @param pEntry the entry, which must be the next in the log file.
+ */
+void logIndexBlockAdd(LogIndexBlock *pBlock, const LogEntry *pEntry);
+
+/** Determine whether an index block may contain an event.
+ *
+ * @param pBlock the block.
+ * @param event  the event.
+ * @return       false if the block definitely does not contain
+ *               the event, otherwise true.
+ */
+bool logIndexBlockMayContain(const LogIndexBlock *pBlock, int event);
+
+/** Write the header of an index file.
+ *
+ * @param pIndexFile the index file, opened for writing.
+ * @return           true on success, otherwise false.
+ */
+bool logIndexWriteHeader(FILE *pIndexFile);
+
+/** Append a block to an index file.
+ *
+ * @param pIndexFile the index file, opened for appending.
+ * @param pBlock     the block.
+ * @return           true on success, otherwise false.
+ */
+bool logIndexWriteBlock(FILE *pIndexFile, const LogIndexBlock *pBlock);
+
+/** Build the index of a log file.
+ *
+ * @param pFile      the log file, opened for reading.
+ * @param pIndexFile the index file, opened for writing.
+ * @return           the number of blocks written, negative
+ *                   on error.
+ */
+int logIndexBuild(FILE *pFile, FILE *pIndexFile);
+
+/** Check the header of an index file and get the number of
+ * blocks in it.
+ *
+ * @param pIndexFile the index file, opened for reading.
+ * @return           the number of blocks, negative if this is
+ *                   not a valid index file.
+ */
+int logIndexNumBlocks(FILE *pIndexFile);
+
+/** Read a block from an index file.
+ *
+ * @param pIndexFile the index file, opened for reading.
+ * @param index      the index of the block.
+ * @param pBlock     a place to put the block.
+ * @return           true if the block was read, otherwise false.
+ */
+bool logIndexReadBlock(FILE *pIndexFile, int index, LogIndexBlock *pBlock);
+
+/** Find the first entry of the last run of a log file with
+ * the help of its index, for passing to logFileSeek().  Only the
+ * entries beyond the end of the index (at most a block's worth,
+ * unless the index is out of date) need to be read.
+ *
+ * @param pFile      the log file, opened for reading.
+ * @param pIndexFile the index file, opened for reading.
+ * @return           the index of the first entry of the last
+ *                   run, negative on error.
+ */
+int logIndexRunStart(FILE *pFile, FILE *pIndexFile);
+
+/** Find the entries of a log file with a given event and a
+ * timestamp in a given range, reading only the blocks which the
+ * index says may contain them (plus any entries which no block
+ * of the index covers, e.g. beyond the end of the index or where
+ * a block is missing or can't be read).
+ *
+ * @param pFile        the log file, opened for reading.
+ * @param pIndexFile   the index file, opened for reading; may
+ *                     be NULL, in which case every entry is read.
+ * @param event        the event to find, negative for any event.
+ * @param minTimestamp the earliest timestamp to find.
+ * @param maxTimestamp the latest timestamp to find.
+ * @param pCallback    called for each entry found.
+ * @param pParam       passed to pCallback.
+ * @return             the number of entries found, negative
+ *                     on error.
+ */
+int logIndexFind(FILE *pFile, FILE *pIndexFile, int event,
+                 unsigned int minTimestamp, unsigned int maxTimestamp,
+                 LogIndexFindCallback pCallback, void *pParam);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+// End of file
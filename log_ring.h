@@ -0,0 +1,215 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A log in RAM whose capacity and entry layout are fixed at
+ * compile time, for where the LogEntry of the C API, 12 bytes
+ * per entry, is more than a product can spare.
+ *
+ * Each LogRing holds its own entries, in three arrays, one each
+ * for the timestamps, events and parameters, so that they take
+ * exactly numLogEntries * (sizeof(TimestampType) + sizeof(EventType) +
+ * sizeof(ParameterType)) bytes, without padding.  The number of
+ * entries must be a power of two so that LOG() finds the slot by
+ * masking and, overwriting the oldest entry when the ring is full
+ * without a branch, costs a handful of instructions whatever the
+ * instantiation.
+ *
+ * The timestamp is the microsecond timestamp of the C API shifted
+ * right by timestampShift, i.e. in units of 2 ^ timestampShift
+ * microseconds, truncated to TimestampType; events and parameters
+ * are truncated to EventType and ParameterType, so choose types
+ * wide enough for the events and parameters that are logged.
+ *
+ * getLog() widens the entries back into LogEntry, with the
+ * timestamp in microseconds, so that they can be handled like
+ * those of the C API; an EVENT_LOG_TIME_WRAP entry is inserted
+ * where the timestamp has wrapped and an
+ * EVENT_LOG_ENTRIES_OVERWRITTEN entry where entries have been
+ * lost.  Since a narrow timestamp wraps often, getLog() must be
+ * called more often than it wraps for the wraps to be seen.
+ */
+
+#ifndef _LOG_RING_
+#define _LOG_RING_
+
+#include "log.h"
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+/** A log in RAM of numLogEntries entries (a power of two), each
+ * a timestamp in units of 2 ^ timestampShift microseconds, an
+ * event and a parameter, of the given unsigned/integer types
+ * of up to 32 bits.
+ */
+template <int numLogEntries,
+          typename TimestampType = unsigned int,
+          typename EventType = int,
+          typename ParameterType = int,
+          int timestampShift = 0>
+class LogRing {
+public:
+    /** Start an empty log.
+     */
+    LogRing()
+    {
+        _nextIn = 0;
+        _nextOut = 0;
+        _numOverwritten = 0;
+        _lastTimestamp = 0;
+        _time.reset();
+        _time.start();
+    }
+
+    /** Log an event plus parameter; as for LOG() there is no
+     * mutex protection.
+     *
+     * @param event     the event.
+     * @param parameter the parameter.
+     */
+    void LOG(LogEvent event, int parameter)
+    {
+        unsigned int index = _nextIn & (numLogEntries - 1);
+        unsigned int overwritten;
+
+        _timestamps[index] = (TimestampType) (((unsigned int) _time.read_us()) >> timestampShift);
+        _events[index] = (EventType) event;
+        _parameters[index] = (ParameterType) parameter;
+        _nextIn++;
+        // If the ring was full the oldest entry has just been
+        // overwritten, so move it on
+        overwritten = (_nextIn - _nextOut) > (unsigned int) numLogEntries;
+        _nextOut += overwritten;
+        _numOverwritten += overwritten;
+    }
+
+    /** Log an event plus parameter, this time with mutex.
+     *
+     * @param event     the event.
+     * @param parameter the parameter.
+     */
+    void LOGX(LogEvent event, int parameter)
+    {
+        _mutex.lock();
+        LOG(event, parameter);
+        _mutex.unlock();
+    }
+
+    /** Get the oldest log entries, removing them from the
+     * log, as getLog().
+     *
+     * @param pEntries   a pointer to an array of at least
+     *                   numEntries LogEntry.
+     * @param numEntries the number of entries that pEntries
+     *                   can hold.
+     * @return           the number of entries returned.
+     */
+    int getLog(LogEntry *pEntries, int numEntries)
+    {
+        unsigned int index;
+        unsigned int timestamp;
+        int itemCount = 0;
+
+        _mutex.lock();
+
+        while ((_nextOut != _nextIn) && (itemCount < numEntries)) {
+            index = _nextOut & (numLogEntries - 1);
+            timestamp = ((unsigned int) _timestamps[index]) << timestampShift;
+            if (_numOverwritten > 0) {
+                pEntries->timestamp = timestamp;
+                pEntries->event = EVENT_LOG_ENTRIES_OVERWRITTEN;
+                pEntries->parameter = (int) _numOverwritten;
+                itemCount++;
+                pEntries++;
+                _numOverwritten = 0;
+            } else if (timestamp < _lastTimestamp) {
+                pEntries->timestamp = timestamp;
+                pEntries->event = EVENT_LOG_TIME_WRAP;
+                pEntries->parameter = (int) timestamp;
+                itemCount++;
+                pEntries++;
+                _lastTimestamp = timestamp;
+            } else {
+                pEntries->timestamp = timestamp;
+                pEntries->event = (int) _events[index];
+                pEntries->parameter = (int) _parameters[index];
+                itemCount++;
+                pEntries++;
+                _lastTimestamp = timestamp;
+                _nextOut++;
+            }
+        }
+
+        _mutex.unlock();
+
+        return itemCount;
+    }
+
+    /** Get the number of entries in the log.
+     *
+     * @return the number of entries in the log.
+     */
+    int getNumLogEntries()
+    {
+        return (int) (_nextIn - _nextOut);
+    }
+
+private:
+    MBED_STRUCT_STATIC_ASSERT((numLogEntries > 0) && ((numLogEntries & (numLogEntries - 1)) == 0),
+                              "the number of entries must be a power of two");
+    MBED_STRUCT_STATIC_ASSERT(((TimestampType) -1 > 0) && (sizeof(TimestampType) <= sizeof(unsigned int)),
+                              "the timestamp must be unsigned and of 32 bits or fewer");
+    MBED_STRUCT_STATIC_ASSERT(sizeof(EventType) <= sizeof(int),
+                              "the event must be of 32 bits or fewer");
+    MBED_STRUCT_STATIC_ASSERT(sizeof(ParameterType) <= sizeof(int),
+                              "the parameter must be of 32 bits or fewer");
+    MBED_STRUCT_STATIC_ASSERT((timestampShift >= 0) && (timestampShift < 32),
+                              "the timestamp shift must be from 0 to 31");
+
+    // A log can't be shared
+    LogRing(const LogRing &);
+    LogRing &operator=(const LogRing &);
+
+    // The entries, in separate arrays so that there is no padding.
+    TimestampType _timestamps[numLogEntries];
+    EventType _events[numLogEntries];
+    ParameterType _parameters[numLogEntries];
+
+    // The number of entries ever logged and ever taken out of the
+    // log (including those overwritten), the index of an entry
+    // being one of these masked by the number of entries.
+    unsigned int _nextIn;
+    unsigned int _nextOut;
+
+    // The number of entries overwritten since getLog() last
+    // reported it.
+    unsigned int _numOverwritten;
+
+    // The timestamp of the last entry returned by getLog(),
+    // in microseconds.
+    unsigned int _lastTimestamp;
+
+    // The logging timestamp.
+    Timer _time;
+
+    // Mutex for LOGX() and getLog().
+    Mutex _mutex;
+};
+
+#endif
+
+// End of file
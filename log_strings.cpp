@@ -45,6 +45,9 @@ const char *gLogStrings[] = {
     "* SOCKET_GONE_BAD",
     "* SOCKET_ERRORS_FOR_TOO_LONG",
     "* TCP_SEND_TIMEOUT",
+    "  LOG_FILE_UPLOAD_RATE",
+    "* LOG_FILE_DISCARDED",
+    "  LOG_FILE_ALREADY_UPLOADED",
     // Generic log points for the user, do not change
     "  USER_0",
     "  USER_1",